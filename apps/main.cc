@@ -8,8 +8,14 @@
 	Based on the implementation at http://paulbourke.net/geometry/polygonise/.
 */
 
-#include "marching_cubes/marching_cubes.h"
+#include "marching_cubes/chunk_arena.h"
+#include "marching_cubes/chunk_manager.h"
+#include "marching_cubes/extraction_job.h"
+#include "marching_cubes/mesh_stream.h"
+#include "marching_cubes/occlusion_culling.h"
 #include "marching_cubes/shader.h"
+#include "marching_cubes/stream_buffer.h"
+#include "marching_cubes/vertex_format.h"
 
 #include "glm/gtc/matrix_transform.hpp"
 
@@ -17,16 +23,54 @@
 #include "GL/glew.h"
 #include "SDL_opengl.h"
 
+#include <algorithm>
+#include <cstddef>
 #include <iostream>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 // OpenGL window size
 const GLint WIDTH = 512, HEIGHT = 512;
 
-// Parameters for the marching cubes algorithm.
-const glm::vec3 MIN = glm::vec3(-1.0f, -1.0f, -1.0f);
-const glm::vec3 MAX = glm::vec3(1.0f, 1.0f, 1.0f);
-const int RESOLUTION = 50;
+// Parameters for streaming chunks around the camera. Each chunk is meshed
+// from a lattice of CHUNK_RESOLUTION cubes per side.
+const float CHUNK_SIZE = 0.5f;
+const int CHUNK_RESOLUTION = 12;
+const float VIEW_DISTANCE = 8.0f;
+const size_t MEMORY_BUDGET = 64 << 20;
+
+// Chunks are stored in the 12-byte packed format, half the size of the
+// float format, both in the cache and on the GPU.
+const VertexFormat CHUNK_VERTEX_FORMAT = VERTEX_PACKED;
+
+// With flat shading, which F toggles, chunks are meshed without normals and
+// lit with face normals found in the fragment shader.
+const VertexFormat FLAT_CHUNK_VERTEX_FORMAT = VERTEX_POSITION;
+
+// Chunks with normals are indexed, with their triangles reordered for the
+// vertex cache and overdraw by the threads that mesh them.
+const bool CHUNK_INDEXED = true;
+
+// Chunks hidden behind the solid insides of nearer chunks are neither drawn
+// nor meshed. The nearest MAX_OCCLUDERS occluder boxes are drawn into a
+// software depth buffer a quarter of the window's size every frame.
+const int OCCLUSION_WIDTH = WIDTH / 4, OCCLUSION_HEIGHT = HEIGHT / 4;
+const size_t MAX_OCCLUDERS = 1024;
+const bool DEFER_HIDDEN_CHUNKS = true;
+
+// Parameters for the coarse mesh shown while the first chunks are meshed.
+const glm::vec3 PREVIEW_MIN = glm::vec3(-1.0f, -1.0f, -1.0f);
+const glm::vec3 PREVIEW_MAX = glm::vec3(1.0f, 1.0f, 1.0f);
+const int PREVIEW_RESOLUTION = 16;
+
+// Pressing 4 shows a torus whose radii change over time, remeshed whole at
+// ANIMATION_RESOLUTION. Each mesh is extracted on the pool while the previous
+// one is drawn, and uploaded through a ring of fenced buffer regions.
+const glm::vec3 ANIMATION_MIN = glm::vec3(-1.2f, -1.2f, -1.2f);
+const glm::vec3 ANIMATION_MAX = glm::vec3(1.2f, 1.2f, 1.2f);
+const int ANIMATION_RESOLUTION = 96;
 
 /*
 	Returns a vector representing the position of the camera as a function of time.
@@ -51,6 +95,162 @@ glm::mat4 mvp(float t)
 	return proj * view;
 }
 
+/*
+	Returns the animated torus as a function of time.
+*/
+std::shared_ptr<SignedDistanceFunction> animatedTorus(float t)
+{
+	return std::make_shared<TorusSDF>(glm::vec2(0.75f + 0.15f * glm::sin(2.0f * t), 0.2f + 0.08f * glm::sin(3.0f * t)));
+}
+
+/*
+ * A vertex array and buffer holding a mesh in one of the VertexFormats, with
+ * the box packed positions are quantized in.
+ */
+struct MeshBuffers
+{
+	GLuint VAO;
+	GLuint VBO;
+	GLsizei vertexCount;
+	VertexFormat format;
+	glm::vec3 min;
+	glm::vec3 extent;
+};
+
+MeshBuffers createMeshBuffers(VertexFormat format)
+{
+	MeshBuffers mesh = {0, 0, 0, format, glm::vec3(0.0f), glm::vec3(1.0f)};
+	glGenVertexArrays(1, &mesh.VAO);
+	glGenBuffers(1, &mesh.VBO);
+
+	glBindVertexArray(mesh.VAO);
+	glBindBuffer(GL_ARRAY_BUFFER, mesh.VBO);
+	if (format == VERTEX_PACKED)
+	{
+		glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(PackedVertex), (GLvoid*)offsetof(PackedVertex, position));
+		glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, sizeof(PackedVertex), (GLvoid*)offsetof(PackedVertex, normal));
+	}
+	else if (format == VERTEX_POSITION)
+	{
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (GLvoid*)0);
+	}
+	else
+	{
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (GLvoid*)0);
+		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (GLvoid*)(3 * sizeof(float)));
+	}
+	glEnableVertexAttribArray(0);
+	if (format != VERTEX_POSITION)
+	{
+		glEnableVertexAttribArray(1);
+	}
+	glBindVertexArray(0);
+	return mesh;
+}
+
+void uploadMesh(MeshBuffers &mesh, const std::vector<glm::vec3> &vertexBufferData)
+{
+	glBindBuffer(GL_ARRAY_BUFFER, mesh.VBO);
+	glBufferData(GL_ARRAY_BUFFER, vertexBufferData.size() * sizeof(glm::vec3),
+			vertexBufferData.data(), GL_STATIC_DRAW);
+	mesh.vertexCount = vertexBufferData.size() * sizeof(glm::vec3) / vertexSize(mesh.format);
+}
+
+void deleteMeshBuffers(MeshBuffers &mesh)
+{
+	glDeleteVertexArrays(1, &mesh.VAO);
+	glDeleteBuffers(1, &mesh.VBO);
+	mesh.VAO = 0;
+	mesh.VBO = 0;
+	mesh.vertexCount = 0;
+}
+
+void drawMesh(const MeshBuffers &mesh, GLint packedNormalsLocation)
+{
+	glVertexAttrib3fv(2, &mesh.min[0]);
+	glVertexAttrib3fv(3, &mesh.extent[0]);
+	glUniform1i(packedNormalsLocation, mesh.format == VERTEX_PACKED);
+	glBindVertexArray(mesh.VAO);
+	glDrawArrays(GL_TRIANGLES, 0, mesh.vertexCount);
+}
+
+/*
+ * Everything the viewer keeps for one shape in one shading mode. The chunk
+ * meshes live in GPU buffers, so switching shapes or modes only changes which
+ * buffers are drawn.
+ */
+struct ShapeView
+{
+	std::unique_ptr<ChunkManager> chunks;
+	std::unique_ptr<ChunkArena> arena;
+
+	// A coarse mesh of the whole shape, which takes milliseconds, stands in
+	// until the chunks in view have all been meshed once.
+	std::shared_ptr<AsyncMesh> preview;
+	MeshBuffers previewBuffers = {0, 0, 0, VERTEX_FLOAT, glm::vec3(0.0f), glm::vec3(1.0f)};
+	bool showPreview = false;
+
+	// Totals over the indexed chunks uploaded so far, for reporting how much
+	// optimizeMesh() saved: vertices transformed by a simulated cache before
+	// and after, triangles and vertices referenced.
+	double unoptimizedTransforms = 0.0;
+	double optimizedTransforms = 0.0;
+	double triangles = 0.0;
+	double vertices = 0.0;
+};
+
+/*
+ * Copies the chunk meshes that are new since the last call into the shape's
+ * arena, then has the chunk manager release their CPU copies, and removes the
+ * chunks that are no longer in view from the arena.
+ */
+void syncChunkBuffers(ShapeView &shape)
+{
+	std::unordered_set<glm::ivec3, IVec3Hash> current;
+	for (const std::shared_ptr<const ChunkMesh> &mesh : shape.chunks->meshes())
+	{
+		current.insert(mesh->key);
+		if (shape.arena->holds(*mesh))
+		{
+			continue;
+		}
+
+		if (!shape.arena->store(*mesh))
+		{
+			continue;
+		}
+		if (mesh->indexCount > 0)
+		{
+			double triangles = mesh->indexCount / 3;
+			shape.unoptimizedTransforms += mesh->unoptimized.acmr * triangles;
+			shape.optimizedTransforms += mesh->optimized.acmr * triangles;
+			shape.triangles += triangles;
+			shape.vertices += mesh->vertexCount;
+		}
+		shape.chunks->release(*mesh);
+	}
+	shape.arena->keepOnly(current);
+}
+
+/*
+ * Frees the GPU buffers of a shape and stops its background work.
+ */
+void releaseShape(ShapeView &shape)
+{
+	shape.arena.reset();
+	if (shape.previewBuffers.VAO != 0)
+	{
+		deleteMeshBuffers(shape.previewBuffers);
+	}
+	shape.chunks.reset();
+	if (shape.preview)
+	{
+		shape.preview->cancel();
+		shape.preview->wait();
+		shape.preview.reset();
+	}
+}
+
 /*
 	Takes care of rendering everything using SDL/OpenGL. Mostly boilerplate code.
 */
@@ -75,47 +275,53 @@ int main(int argc, char *argv[])
 
 	glEnable(GL_DEPTH_TEST);
 
-	Shader shader("marching_cubes.vs", "marching_cubes.fs");
-
-    
-    // Initialize sphere data.
-    SphereSDF unitSphere(glm::vec3(0.0f, 0.0f, 0.0f), 1.0f);
-    std::vector<glm::vec3> sphereVertexBufferData;
-    marchingCubes((SignedDistanceFunction*)&unitSphere, MIN, MAX, RESOLUTION,
-            sphereVertexBufferData);
-
-    // Initialize box data.
-    BoxSDF box(glm::vec3(0.8f, 0.8f, 0.8f));
-    std::vector<glm::vec3> boxVertexBufferData;
-    marchingCubes((SignedDistanceFunction*)&box, MIN, MAX, RESOLUTION,
-            boxVertexBufferData);
-
-    // initialize torus data
-    TorusSDF torus(glm::vec2(0.8f, 0.2f));
-	std::vector<glm::vec3> torusVertexBufferData;
-	marchingCubes((SignedDistanceFunction*)&torus, MIN, MAX, RESOLUTION,
-            torusVertexBufferData);
-
-    // Render sphere by default.
-    std::vector<glm::vec3> vertexBufferData = sphereVertexBufferData;
-
-    // Pass data to OpenGL.
-	GLuint VAO, VBO;
-	glGenVertexArrays(1, &VAO);
-	glGenBuffers(1, &VBO);
-
-	glBindVertexArray(VAO);
-
-	glBindBuffer(GL_ARRAY_BUFFER, VBO);
-	glBufferData(GL_ARRAY_BUFFER, vertexBufferData.size() * sizeof(glm::vec3), &vertexBufferData.front(), GL_STATIC_DRAW);
-
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (GLvoid*)0);
-	glEnableVertexAttribArray(0);
-
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (GLvoid*)0);
-	glEnableVertexAttribArray(1);
-
-	glBindVertexArray(0);
+	// Linked programs are cached next to the shaders, so later launches skip compiling them.
+	Shader shader("marching_cubes.vs", "marching_cubes.fs", "marching_cubes.shadercache");
+
+	SphereSDF unitSphere(glm::vec3(0.0f, 0.0f, 0.0f), 1.0f);
+	BoxSDF box(glm::vec3(0.8f, 0.8f, 0.8f));
+	TorusSDF torus(glm::vec2(0.8f, 0.2f));
+
+	// Chunks are meshed in the background, leaving a core free for rendering,
+	// so the window opens straight away and the shape fills in nearest first.
+	// Each shape is set up the first time it is selected and kept afterwards.
+	ThreadPool pool(std::max(workerCount() - 1, 1));
+	SignedDistanceFunction* sdfs[] = {&unitSphere, &box, &torus};
+	ShapeView shapes[2][3];
+	OcclusionBuffer occlusion(OCCLUSION_WIDTH, OCCLUSION_HEIGHT);
+	int active = 0;
+	bool flatShading = false;
+
+	// The animated torus is set up the first time it is shown. It is extracted
+	// on the chunks' pool, and the hidden shape stops meshing while it shows.
+	bool animating = false;
+	std::unique_ptr<MeshStream> animation;
+	std::unique_ptr<StreamBuffer> animationBuffer;
+	int animationFrames = 0;
+	int animationMeshes = 0;
+
+	auto selectShape = [&](int index)
+	{
+		active = index;
+		ShapeView &shape = shapes[flatShading][index];
+		if (shape.chunks)
+		{
+			return;
+		}
+		VertexFormat format = flatShading ? FLAT_CHUNK_VERTEX_FORMAT : CHUNK_VERTEX_FORMAT;
+		shape.chunks.reset(new ChunkManager(sdfs[index], CHUNK_SIZE,
+				CHUNK_RESOLUTION, VIEW_DISTANCE, MEMORY_BUDGET, pool, format,
+				CHUNK_INDEXED));
+		shape.arena.reset(new ChunkArena(format));
+		shape.preview = marchingCubesAsync(sdfs[index], PREVIEW_MIN,
+				PREVIEW_MAX, PREVIEW_RESOLUTION);
+		shape.previewBuffers = createMeshBuffers(VERTEX_FLOAT);
+		shape.showPreview = true;
+	};
+	selectShape(0);
+	std::cout << (shapes[0][0].arena->multiDraw
+			? "Drawing visible chunks with one glMultiDrawElementsIndirect per frame"
+			: "No indirect multi-draw, drawing visible chunks one by one") << std::endl;
 
 	// Uncomment for wireframe view.
 	//glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
@@ -138,51 +344,147 @@ int main(int argc, char *argv[])
                 }
                 else if (keypress == SDLK_1)
                 {
-                    vertexBufferData = sphereVertexBufferData;
-	                glBindBuffer(GL_ARRAY_BUFFER, VBO);
-	                glBufferData(GL_ARRAY_BUFFER,
-                            vertexBufferData.size() * sizeof(glm::vec3),
-                            &vertexBufferData.front(), GL_STATIC_DRAW);
+                    animating = false;
+                    selectShape(0);
                 }
                 else if (keypress == SDLK_2)
                 {
-                    vertexBufferData = boxVertexBufferData;
-	                glBindBuffer(GL_ARRAY_BUFFER, VBO);
-	                glBufferData(GL_ARRAY_BUFFER,
-                            vertexBufferData.size() * sizeof(glm::vec3),
-                            &vertexBufferData.front(), GL_STATIC_DRAW);
+                    animating = false;
+                    selectShape(1);
                 }
                 else if (keypress == SDLK_3)
                 {
-                    vertexBufferData = torusVertexBufferData;
-	                glBindBuffer(GL_ARRAY_BUFFER, VBO);
-	                glBufferData(GL_ARRAY_BUFFER,
-                            vertexBufferData.size() * sizeof(glm::vec3),
-                            &vertexBufferData.front(), GL_STATIC_DRAW);
+                    animating = false;
+                    selectShape(2);
+                }
+                else if (keypress == SDLK_4)
+                {
+                    animating = true;
+                    if (!animation)
+                    {
+                        animation.reset(new MeshStream(animatedTorus, ANIMATION_MIN, ANIMATION_MAX, ANIMATION_RESOLUTION, pool));
+                        animationBuffer.reset(new StreamBuffer());
+                        std::cout << (animationBuffer->persistent
+                                ? "Streaming the animated torus through a persistently mapped buffer"
+                                : "Streaming the animated torus through unsynchronized buffer mappings") << std::endl;
+                    }
+                }
+                else if (keypress == SDLK_f)
+                {
+                    flatShading = !flatShading;
+                    selectShape(active);
                 }
             }
 		}
 
+		float t = SDL_GetTicks() / 1000.0f;
+		ShapeView &shape = shapes[flatShading][active];
+		if (!animating)
+		{
+			shape.chunks->update(viewPos(t));
+			syncChunkBuffers(shape);
+		}
+
+		if (shape.preview && shape.preview->ready())
+		{
+			uploadMesh(shape.previewBuffers, shape.preview->get());
+			shape.preview.reset();
+		}
+		if (shape.showPreview && shape.chunks->cachedChunks() > 0
+				&& shape.chunks->pendingChunks() == 0)
+		{
+			shape.showPreview = false;
+			deleteMeshBuffers(shape.previewBuffers);
+			if (shape.triangles > 0.0)
+			{
+				std::cout << "Vertex cache of the chunks in view: ACMR "
+					<< shape.unoptimizedTransforms / shape.triangles << " -> "
+					<< shape.optimizedTransforms / shape.triangles << ", ATVR "
+					<< shape.unoptimizedTransforms / shape.vertices << " -> "
+					<< shape.optimizedTransforms / shape.vertices << std::endl;
+			}
+			std::cout << shape.chunks->hiddenChunks() << " chunks in view left unmeshed behind occluders" << std::endl;
+			if (shape.preview)
+			{
+				shape.preview->cancel();
+				shape.preview.reset();
+			}
+		}
+
 		glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
 		shader.use();
 
 		GLuint viewPosLocation = glGetUniformLocation(shader.program, "viewPos");
-		glm::vec3 _viewPos = viewPos(SDL_GetTicks() / 1000.0f);
+		glm::vec3 _viewPos = viewPos(t);
 		glUniform3fv(viewPosLocation, 1, &_viewPos[0]);
 
 		GLuint mvpLocation = glGetUniformLocation(shader.program, "mvp");
-		glm::mat4 _mvp = mvp(SDL_GetTicks() / 1000.0f);
+		glm::mat4 _mvp = mvp(t);
 		glUniformMatrix4fv(mvpLocation, 1, GL_FALSE, &_mvp[0][0]);
 
-		glBindVertexArray(VAO);
-		glDrawArrays(GL_TRIANGLES, 0, vertexBufferData.size());
+		if (!animating)
+		{
+			occlusion.clear(_mvp);
+			occlusion.addOccluders(shape.chunks->occluders(), MAX_OCCLUDERS);
+			occlusion.buildHierarchy();
+			if (DEFER_HIDDEN_CHUNKS)
+			{
+				shape.chunks->deferHidden(occlusion);
+			}
+		}
+
+		GLuint flatShadingLocation = glGetUniformLocation(shader.program, "flatShading");
+		glUniform1i(flatShadingLocation, flatShading);
+
+		GLint packedNormalsLocation = glGetUniformLocation(shader.program, "packedNormals");
+
+		if (animating)
+		{
+			// Swapping before requesting the next mesh keeps one extraction
+			// running while this frame is drawn.
+			if (animation->swap())
+			{
+				animationBuffer->upload(animation->current());
+				animationMeshes++;
+			}
+			animation->request(t);
+			animationFrames++;
+			glUniform1i(packedNormalsLocation, false);
+			animationBuffer->draw();
+		}
+		else if (shape.showPreview)
+		{
+			drawMesh(shape.previewBuffers, packedNormalsLocation);
+		}
+		else
+		{
+			glUniform1i(packedNormalsLocation, shape.arena->vertexFormat() == VERTEX_PACKED);
+			shape.arena->draw(extractFrustum(_mvp), &occlusion);
+		}
 		glBindVertexArray(0);
 
 		SDL_GL_SwapWindow(window);
 	}
 
+	for (auto &mode : shapes)
+	{
+		for (ShapeView &shape : mode)
+		{
+			releaseShape(shape);
+		}
+	}
+	if (animation)
+	{
+		std::cout << "Animated torus: " << animationMeshes << " meshes in " << animationFrames
+			<< " frames, the last extracted in " << animation->extractionMilliseconds() << " ms, "
+			<< animationBuffer->waits << " waits for the GPU totalling "
+			<< animationBuffer->waitMilliseconds << " ms" << std::endl;
+		animation.reset();
+		animationBuffer.reset();
+	}
+
 	SDL_GL_DeleteContext(context);
 	SDL_DestroyWindow(window);
 	SDL_Quit();
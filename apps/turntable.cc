@@ -0,0 +1,301 @@
+/*
+	Headless turntable renderer.
+
+	Renders each asset in a list from evenly spaced angles around it into PNGs, without a window, for
+	thumbnails on servers with no GPU or display. The OpenGL context comes from EGL's surfaceless
+	platform, so Mesa's software rasterizer (llvmpipe) draws into an offscreen framebuffer. GLEW has to
+	be built with EGL support (GLEW_EGL) for glewInit() to work without an X display.
+
+	Usage: turntable [output directory] [views] [image size] [resolution]
+
+	The mesh of the next asset is extracted on the thread pool while the current one is rendered and
+	written out, so on a multi-core server extraction is mostly hidden behind rendering.
+*/
+
+#include "marching_cubes/extraction_job.h"
+#include "marching_cubes/png_writer.h"
+#include "marching_cubes/shader.h"
+#include "marching_cubes/signed_distance_functions.h"
+
+#include "glm/gtc/constants.hpp"
+#include "glm/gtc/matrix_transform.hpp"
+
+#include "GL/glew.h"
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+/*
+ * An SDF to render and the box its mesh is extracted from.
+ */
+struct Asset
+{
+	std::string name;
+	SignedDistanceFunction* sdf;
+	glm::vec3 min;
+	glm::vec3 max;
+};
+
+typedef std::chrono::steady_clock Clock;
+
+double millisecondsSince(Clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+/*
+ * Makes a core OpenGL 3.3 context current without any surface. Prefers Mesa's surfaceless platform,
+ * which needs neither a GPU nor a display, and falls back to the default display.
+ */
+bool createHeadlessContext(EGLDisplay &display, EGLContext &context)
+{
+	display = EGL_NO_DISPLAY;
+	PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+		(PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+	if (getPlatformDisplay != NULL)
+	{
+		display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+	}
+	if (display == EGL_NO_DISPLAY)
+	{
+		display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+	}
+	if (display == EGL_NO_DISPLAY || !eglInitialize(display, NULL, NULL) || !eglBindAPI(EGL_OPENGL_API))
+	{
+		return false;
+	}
+
+	const EGLint configAttributes[] = {
+		EGL_SURFACE_TYPE, 0,
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+		EGL_NONE
+	};
+	EGLConfig config;
+	EGLint configs = 0;
+	if (!eglChooseConfig(display, configAttributes, &config, 1, &configs) || configs == 0)
+	{
+		return false;
+	}
+
+	const EGLint contextAttributes[] = {
+		EGL_CONTEXT_MAJOR_VERSION, 3,
+		EGL_CONTEXT_MINOR_VERSION, 3,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+		EGL_NONE
+	};
+	context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttributes);
+	return context != EGL_NO_CONTEXT && eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context);
+}
+
+/*
+ * An offscreen framebuffer with a color and a depth renderbuffer.
+ */
+struct Framebuffer
+{
+	GLuint FBO;
+	GLuint color;
+	GLuint depth;
+};
+
+bool createFramebuffer(Framebuffer &framebuffer, int size)
+{
+	glGenFramebuffers(1, &framebuffer.FBO);
+	glGenRenderbuffers(1, &framebuffer.color);
+	glGenRenderbuffers(1, &framebuffer.depth);
+
+	glBindRenderbuffer(GL_RENDERBUFFER, framebuffer.color);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, size, size);
+	glBindRenderbuffer(GL_RENDERBUFFER, framebuffer.depth);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, size, size);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer.FBO);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, framebuffer.color);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, framebuffer.depth);
+	return glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+}
+
+/*
+ * Renders a mesh laid out like marchingCubes()'s output from views angles around the y axis, framing
+ * its bounding box, and writes <directory>/<name>_<view>.png for each. Returns the number of images
+ * written.
+ */
+int renderTurntable(const Shader &shader, GLuint VAO, GLuint VBO, const std::vector<glm::vec3> &vertexBufferData,
+		const std::string &directory, const std::string &name, int views, int size)
+{
+	glBindBuffer(GL_ARRAY_BUFFER, VBO);
+	glBufferData(GL_ARRAY_BUFFER, vertexBufferData.size() * sizeof(glm::vec3),
+			vertexBufferData.data(), GL_STATIC_DRAW);
+
+	glm::vec3 min(0.0f);
+	glm::vec3 max(0.0f);
+	for (size_t i = 0; i < vertexBufferData.size(); i += 2)
+	{
+		min = i == 0 ? vertexBufferData[i] : glm::min(min, vertexBufferData[i]);
+		max = i == 0 ? vertexBufferData[i] : glm::max(max, vertexBufferData[i]);
+	}
+	glm::vec3 center = 0.5f * (min + max);
+	float radius = glm::max(0.5f * glm::length(max - min), 1e-3f);
+
+	GLint viewPosLocation = glGetUniformLocation(shader.program, "viewPos");
+	GLint mvpLocation = glGetUniformLocation(shader.program, "mvp");
+	glm::mat4 proj = glm::perspective(glm::radians(45.0f), 1.0f, 0.5f * radius, 6.0f * radius);
+
+	std::vector<unsigned char> pixels((size_t)size * size * 4);
+	std::vector<unsigned char> image(pixels.size());
+	size_t stride = (size_t)size * 4;
+	int written = 0;
+	for (int view = 0; view < views; view++)
+	{
+		float angle = glm::two_pi<float>() * view / views;
+		glm::vec3 eye = center + 2.8f * radius * glm::normalize(glm::vec3(glm::sin(angle), 0.5f, glm::cos(angle)));
+		glm::mat4 mvp = proj * glm::lookAt(eye, center, glm::vec3(0.0f, 1.0f, 0.0f));
+		glUniform3fv(viewPosLocation, 1, &eye[0]);
+		glUniformMatrix4fv(mvpLocation, 1, GL_FALSE, &mvp[0][0]);
+
+		glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		glBindVertexArray(VAO);
+		glDrawArrays(GL_TRIANGLES, 0, vertexBufferData.size() / 2);
+
+		// OpenGL's rows run from the bottom up, PNG's from the top down.
+		glReadPixels(0, 0, size, size, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+		for (int y = 0; y < size; y++)
+		{
+			std::copy(pixels.begin() + (size - 1 - y) * stride, pixels.begin() + (size - y) * stride,
+					image.begin() + y * stride);
+		}
+
+		std::string path = directory + "/" + name + "_" + std::to_string(view) + ".png";
+		if (savePNG(path, size, size, image))
+		{
+			written++;
+		}
+		else
+		{
+			std::cout << "Failed to write " << path << std::endl;
+		}
+	}
+	return written;
+}
+
+int main(int argc, char *argv[])
+{
+	std::string directory = argc > 1 ? argv[1] : ".";
+	int views = argc > 2 ? std::max(std::atoi(argv[2]), 1) : 8;
+	int size = argc > 3 ? std::max(std::atoi(argv[3]), 1) : 256;
+	int resolution = argc > 4 ? std::max(std::atoi(argv[4]), 1) : 96;
+
+	// An existing directory is fine; any other problem shows up when the images are written.
+	mkdir(directory.c_str(), 0755);
+
+	EGLDisplay display;
+	EGLContext context;
+	if (!createHeadlessContext(display, context))
+	{
+		std::cout << "Failed to create a headless OpenGL context!" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	glewExperimental = GL_TRUE;
+	if (glewInit() != GLEW_OK)
+	{
+		std::cout << "Failed to initialize GLEW!" << std::endl;
+		return EXIT_FAILURE;
+	}
+	std::cout << "Rendering with " << glGetString(GL_RENDERER) << std::endl;
+
+	Framebuffer framebuffer;
+	if (!createFramebuffer(framebuffer, size))
+	{
+		std::cout << "Failed to create the framebuffer!" << std::endl;
+		return EXIT_FAILURE;
+	}
+	glViewport(0, 0, size, size);
+	glEnable(GL_DEPTH_TEST);
+
+	Shader shader("marching_cubes.vs", "marching_cubes.fs", "marching_cubes.shadercache");
+	shader.use();
+
+	// Meshes are drawn as float vertices with normals from the SDF.
+	glVertexAttrib3f(2, 0.0f, 0.0f, 0.0f);
+	glVertexAttrib3f(3, 1.0f, 1.0f, 1.0f);
+	glUniform1i(glGetUniformLocation(shader.program, "packedNormals"), GL_FALSE);
+	glUniform1i(glGetUniformLocation(shader.program, "flatShading"), GL_FALSE);
+
+	GLuint VAO, VBO;
+	glGenVertexArrays(1, &VAO);
+	glGenBuffers(1, &VBO);
+	glBindVertexArray(VAO);
+	glBindBuffer(GL_ARRAY_BUFFER, VBO);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (GLvoid*)0);
+	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (GLvoid*)(3 * sizeof(float)));
+	glEnableVertexAttribArray(0);
+	glEnableVertexAttribArray(1);
+
+	SphereSDF sphere(glm::vec3(0.0f, 0.0f, 0.0f), 1.0f);
+	BoxSDF box(glm::vec3(0.8f, 0.8f, 0.8f));
+	TorusSDF torus(glm::vec2(0.8f, 0.2f));
+	SphereSDF bead(glm::vec3(0.0f, 0.0f, 0.0f), 0.2f);
+	LimitedRepeatSDF beads(&bead, glm::vec3(0.5f), glm::ivec3(2), true);
+	BoxSDF slab(glm::vec3(0.15f, 0.6f, 0.3f));
+	SphereSDF spoke(glm::vec3(0.7f, 0.0f, 0.0f), 0.25f);
+	PolarRepeatSDF spokes(&spoke, 8, true);
+
+	std::vector<Asset> assets = {
+		{"sphere", &sphere, glm::vec3(-1.2f), glm::vec3(1.2f)},
+		{"box", &box, glm::vec3(-1.0f), glm::vec3(1.0f)},
+		{"torus", &torus, glm::vec3(-1.2f), glm::vec3(1.2f)},
+		{"beads", &beads, glm::vec3(-1.4f), glm::vec3(1.4f)},
+		{"slab", &slab, glm::vec3(-1.0f), glm::vec3(1.0f)},
+		{"spokes", &spokes, glm::vec3(-1.2f), glm::vec3(1.2f)}
+	};
+
+	Clock::time_point batchStart = Clock::now();
+	std::shared_ptr<AsyncMesh> next = marchingCubesAsync(assets[0].sdf, assets[0].min, assets[0].max, resolution);
+	int images = 0;
+	for (size_t i = 0; i < assets.size(); i++)
+	{
+		Clock::time_point start = Clock::now();
+		std::shared_ptr<AsyncMesh> mesh = next;
+		mesh->wait();
+		double waited = millisecondsSince(start);
+
+		// Start on the next asset before rendering this one.
+		if (i + 1 < assets.size())
+		{
+			next = marchingCubesAsync(assets[i + 1].sdf, assets[i + 1].min, assets[i + 1].max, resolution);
+		}
+
+		Clock::time_point renderStart = Clock::now();
+		const std::vector<glm::vec3> &vertexBufferData = mesh->get();
+		images += renderTurntable(shader, VAO, VBO, vertexBufferData, directory, assets[i].name, views, size);
+		double rendered = millisecondsSince(renderStart);
+
+		std::cout << assets[i].name << ": " << vertexBufferData.size() / 6 << " triangles, waited "
+			<< waited << " ms for extraction, rendered and wrote " << views << " views in " << rendered
+			<< " ms (" << 1000.0 * views / rendered << " views/s)" << std::endl;
+	}
+
+	double seconds = millisecondsSince(batchStart) / 1000.0;
+	std::cout << assets.size() << " assets, " << images << " images in " << seconds << " s: "
+		<< assets.size() / seconds << " assets/s, " << images / seconds << " images/s" << std::endl;
+
+	glDeleteVertexArrays(1, &VAO);
+	glDeleteBuffers(1, &VBO);
+	glDeleteRenderbuffers(1, &framebuffer.color);
+	glDeleteRenderbuffers(1, &framebuffer.depth);
+	glDeleteFramebuffers(1, &framebuffer.FBO);
+	eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+	eglDestroyContext(display, context);
+	eglTerminate(display);
+	return 0;
+}
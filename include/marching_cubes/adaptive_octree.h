@@ -0,0 +1,48 @@
+#ifndef ADAPTIVE_OCTREE_H
+#define ADAPTIVE_OCTREE_H
+
+#include "marching_cubes/signed_distance_functions.h"
+
+#include "glm/glm.hpp"
+
+#include <vector>
+
+/*
+ * Size figures gathered by adaptiveMarchingCubes(). samples counts the
+ * distinct points of the octree's grid the SDF was evaluated at, leaving out
+ * the evaluations at leaf vertices and for normals.
+ */
+struct AdaptiveOctreeStats
+{
+    int samples;
+    int nodes;
+    int leaves;
+    int dualCells;
+};
+
+/*
+ * Returns an indexed mesh of the zero-isosurface of an SDF, extracted from an
+ * octree that is only refined where the surface needs it, using dual
+ * marching cubes.
+ *
+ * Every node the surface may pass through is refined to at least depth 3.
+ * Below that, a node is only split while the SDF deviates from the trilinear
+ * interpolation of the node's corners by more than tolerance at any of its
+ * 27 half-size grid points, up to maxDepth, so flat regions stay coarse and
+ * curved regions and sharp features get small cells. The points are reused
+ * as the children's corners when a node is split.
+ *
+ * Each leaf gets a vertex that best fits the tangent planes of the surface
+ * crossing its edges, as in dualContouring(). The leaves around every corner
+ * of the octree form a dual cell, which is polygonized with the marching
+ * cubes tables, so neighbouring leaves of any size share their vertices and
+ * the mesh has no cracks. The octree is a cube that starts at min and covers
+ * max. The buffers are laid out like surfaceNetsLattice()'s.
+ */
+void adaptiveMarchingCubes(SignedDistanceFunction* sdf, glm::vec3 min,
+        glm::vec3 max, int maxDepth, float tolerance,
+        std::vector<glm::vec3> &vertexBufferData,
+        std::vector<unsigned int> &indexBufferData,
+        AdaptiveOctreeStats* stats = nullptr);
+
+#endif
@@ -0,0 +1,514 @@
+/*
+	Chunk Arena
+
+	Keeps the meshes of many chunks in one vertex buffer and one element buffer behind a single vertex
+	array, so a frame's chunks are drawn without rebinding anything. Each chunk gets a slot with its
+	ranges in the buffers, its bounding box and its position decoding (see vertex_format.h).
+
+	draw() culls the slots' boxes against the view frustum, then submits the visible chunks with a
+	single glMultiDrawElementsIndirect (and glMultiDrawArraysIndirect for unindexed chunks), so the
+	CPU cost of drawing stays flat as the number of chunks grows. Each command's base instance selects
+	its chunk's decoding from a per-slot instanced attribute. Without OpenGL 4.3 or the
+	ARB_multi_draw_indirect and ARB_base_instance extensions, the visible chunks are drawn one by one
+	from the same buffers instead, with the decoding set as constant vertex attributes. Given an
+	OcclusionBuffer with the view's occluders drawn, draw() also skips the chunks hidden behind them.
+*/
+
+#ifndef CHUNK_ARENA_H
+#define CHUNK_ARENA_H
+
+#include "marching_cubes/chunk_manager.h"
+#include "marching_cubes/frustum_culling.h"
+#include "marching_cubes/ivec3_hash.h"
+#include "marching_cubes/occlusion_culling.h"
+#include "marching_cubes/vertex_format.h"
+
+#include "glm/glm.hpp"
+
+#include "GL/glew.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <map>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+/*
+	Hands out ranges of a buffer, first fit, merging freed ranges with their free neighbours.
+*/
+class RangeAllocator
+{
+public:
+	RangeAllocator() : capacity(0)
+	{
+	}
+
+	size_t size() const
+	{
+		return capacity;
+	}
+
+	bool allocate(size_t size, size_t &offset)
+	{
+		for (auto it = freeRanges.begin(); it != freeRanges.end(); ++it)
+		{
+			if (it->second >= size)
+			{
+				offset = it->first;
+				size_t left = it->second - size;
+				freeRanges.erase(it);
+				if (left > 0)
+				{
+					freeRanges[offset + size] = left;
+				}
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void release(size_t offset, size_t size)
+	{
+		if (size == 0)
+		{
+			return;
+		}
+		auto next = freeRanges.lower_bound(offset);
+		if (next != freeRanges.end() && offset + size == next->first)
+		{
+			size += next->second;
+			next = freeRanges.erase(next);
+		}
+		if (next != freeRanges.begin())
+		{
+			auto previous = std::prev(next);
+			if (previous->first + previous->second == offset)
+			{
+				previous->second += size;
+				return;
+			}
+		}
+		freeRanges[offset] = size;
+	}
+
+	/*
+		Extends the buffer to a new capacity, adding the new space to the free ranges.
+	*/
+	void grow(size_t newCapacity)
+	{
+		size_t old = capacity;
+		capacity = newCapacity;
+		release(old, newCapacity - old);
+	}
+
+private:
+	size_t capacity;
+	std::map<size_t, size_t> freeRanges;
+};
+
+class ChunkArena
+{
+public:
+	// Whether draw() submits all visible chunks with one indirect multi-draw.
+	bool multiDraw;
+
+	// The chunks drawn and the draw calls issued by the last draw().
+	size_t drawnChunks;
+	size_t drawCalls;
+
+	// The chunks inside the frustum that the last draw() found occluded.
+	size_t occludedChunks;
+
+	explicit ChunkArena(VertexFormat format)
+		: multiDraw((GLEW_VERSION_4_3 || GLEW_ARB_multi_draw_indirect) && (GLEW_VERSION_4_2 || GLEW_ARB_base_instance)),
+		  drawnChunks(0), drawCalls(0), occludedChunks(0), format(format), stride(vertexSize(format)), slotCapacity(0)
+	{
+		glGenVertexArrays(1, &this->VAO);
+		glGenBuffers(1, &this->VBO);
+		glGenBuffers(1, &this->EBO);
+		glGenBuffers(1, &this->slotBuffer);
+		glGenBuffers(1, &this->commandBuffer);
+		resize(this->VBO, 0, INITIAL_VERTICES * this->stride);
+		this->vertices.grow(INITIAL_VERTICES);
+		resize(this->EBO, 0, INITIAL_INDICES * sizeof(GLuint));
+		this->indices.grow(INITIAL_INDICES);
+		setupVertexArray();
+	}
+
+	~ChunkArena()
+	{
+		glDeleteVertexArrays(1, &this->VAO);
+		glDeleteBuffers(1, &this->VBO);
+		glDeleteBuffers(1, &this->EBO);
+		glDeleteBuffers(1, &this->slotBuffer);
+		glDeleteBuffers(1, &this->commandBuffer);
+	}
+
+	/*
+		Returns whether the arena holds this version of a chunk's mesh.
+	*/
+	bool holds(const ChunkMesh &mesh) const
+	{
+		auto it = this->chunks.find(mesh.key);
+		return it != this->chunks.end() && this->slots[it->second].version == mesh.version;
+	}
+
+	/*
+		Copies a chunk's mesh into the arena, replacing the chunk's old mesh, growing the buffers when
+		there's no free range large enough. Returns false, leaving the arena as it was, if the mesh's
+		vertices have been dropped by ChunkManager::release().
+	*/
+	bool store(const ChunkMesh &mesh)
+	{
+		size_t available = mesh.format == VERTEX_PACKED ? mesh.packedVertices.size()
+				: mesh.vertexBufferData.size() * sizeof(glm::vec3) / this->stride;
+		if (available < (size_t)mesh.vertexCount || mesh.indexBufferData.size() < (size_t)mesh.indexCount)
+		{
+			return false;
+		}
+		remove(mesh.key);
+
+		Slot slot;
+		slot.key = mesh.key;
+		slot.version = mesh.version;
+		slot.used = true;
+		slot.vertexCount = mesh.vertexCount;
+		slot.indexCount = mesh.indexCount;
+		slot.vertexOffset = reserve(this->vertices, this->VBO, this->stride, mesh.vertexCount);
+		slot.indexOffset = reserve(this->indices, this->EBO, sizeof(GLuint), mesh.indexCount);
+		slot.decodeMin = glm::vec3(0.0f);
+		slot.decodeExtent = glm::vec3(1.0f);
+
+		const void *data = mesh.vertexBufferData.data();
+		if (mesh.format == VERTEX_PACKED)
+		{
+			data = mesh.packedVertices.data();
+			slot.decodeMin = mesh.min;
+			slot.decodeExtent = mesh.max - mesh.min;
+		}
+		glBindBuffer(GL_ARRAY_BUFFER, this->VBO);
+		glBufferSubData(GL_ARRAY_BUFFER, slot.vertexOffset * this->stride, mesh.vertexCount * this->stride, data);
+		if (mesh.indexCount > 0)
+		{
+			glBindBuffer(GL_COPY_WRITE_BUFFER, this->EBO);
+			glBufferSubData(GL_COPY_WRITE_BUFFER, slot.indexOffset * sizeof(GLuint), mesh.indexCount * sizeof(GLuint),
+					mesh.indexBufferData.data());
+		}
+
+		size_t index;
+		if (!this->freeSlots.empty())
+		{
+			index = this->freeSlots.back();
+			this->freeSlots.pop_back();
+			this->slots[index] = slot;
+			this->boxes.set(index, mesh.boundsMin, mesh.boundsMax);
+		}
+		else
+		{
+			index = this->slots.size();
+			this->slots.push_back(slot);
+			this->boxes.add(mesh.boundsMin, mesh.boundsMax);
+		}
+		this->chunks[mesh.key] = index;
+		writeSlot(index);
+		return true;
+	}
+
+	void remove(glm::ivec3 key)
+	{
+		auto it = this->chunks.find(key);
+		if (it == this->chunks.end())
+		{
+			return;
+		}
+		Slot &slot = this->slots[it->second];
+		this->vertices.release(slot.vertexOffset, slot.vertexCount);
+		this->indices.release(slot.indexOffset, slot.indexCount);
+		slot.used = false;
+		this->freeSlots.push_back(it->second);
+		this->chunks.erase(it);
+	}
+
+	/*
+		Removes every chunk not in keys.
+	*/
+	void keepOnly(const std::unordered_set<glm::ivec3, IVec3Hash> &keys)
+	{
+		std::vector<glm::ivec3> stale;
+		for (const auto &entry : this->chunks)
+		{
+			if (keys.count(entry.first) == 0)
+			{
+				stale.push_back(entry.first);
+			}
+		}
+		for (glm::ivec3 key : stale)
+		{
+			remove(key);
+		}
+	}
+
+	VertexFormat vertexFormat() const
+	{
+		return this->format;
+	}
+
+	size_t chunkCount() const
+	{
+		return this->chunks.size();
+	}
+
+	/*
+		Draws the chunks inside a frustum, skipping the ones an occlusion buffer finds hidden if one is
+		given. The shader must be in use, with its other uniforms set.
+	*/
+	void draw(const Frustum &frustum, const OcclusionBuffer *occlusion = NULL)
+	{
+		cullBoxes(frustum, this->boxes, this->visible);
+
+		this->elementCommands.clear();
+		this->arrayCommands.clear();
+		this->occludedChunks = 0;
+		for (size_t i = 0; i < this->slots.size(); i++)
+		{
+			const Slot &slot = this->slots[i];
+			if (!slot.used || !this->visible[i])
+			{
+				continue;
+			}
+			if (occlusion && !occlusion->boxVisible(glm::vec3(this->boxes.minX[i], this->boxes.minY[i], this->boxes.minZ[i]),
+					glm::vec3(this->boxes.maxX[i], this->boxes.maxY[i], this->boxes.maxZ[i])))
+			{
+				this->occludedChunks++;
+				continue;
+			}
+			if (slot.indexCount > 0)
+			{
+				DrawElementsCommand command = {(GLuint)slot.indexCount, 1, (GLuint)slot.indexOffset,
+					(GLint)slot.vertexOffset, (GLuint)i};
+				this->elementCommands.push_back(command);
+			}
+			else
+			{
+				DrawArraysCommand command = {(GLuint)slot.vertexCount, 1, (GLuint)slot.vertexOffset, (GLuint)i};
+				this->arrayCommands.push_back(command);
+			}
+		}
+		this->drawnChunks = this->elementCommands.size() + this->arrayCommands.size();
+		this->drawCalls = 0;
+
+		glBindVertexArray(this->VAO);
+		if (this->multiDraw)
+		{
+			size_t elementBytes = this->elementCommands.size() * sizeof(DrawElementsCommand);
+			size_t arrayBytes = this->arrayCommands.size() * sizeof(DrawArraysCommand);
+			glBindBuffer(GL_DRAW_INDIRECT_BUFFER, this->commandBuffer);
+			glBufferData(GL_DRAW_INDIRECT_BUFFER, elementBytes + arrayBytes, NULL, GL_STREAM_DRAW);
+			glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, elementBytes, this->elementCommands.data());
+			glBufferSubData(GL_DRAW_INDIRECT_BUFFER, elementBytes, arrayBytes, this->arrayCommands.data());
+			if (!this->elementCommands.empty())
+			{
+				glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (GLvoid*)0,
+						(GLsizei)this->elementCommands.size(), 0);
+				this->drawCalls++;
+			}
+			if (!this->arrayCommands.empty())
+			{
+				glMultiDrawArraysIndirect(GL_TRIANGLES, (GLvoid*)elementBytes, (GLsizei)this->arrayCommands.size(), 0);
+				this->drawCalls++;
+			}
+			glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+		}
+		else
+		{
+			for (const DrawElementsCommand &command : this->elementCommands)
+			{
+				setDecoding(this->slots[command.baseInstance]);
+				glDrawElementsBaseVertex(GL_TRIANGLES, command.count, GL_UNSIGNED_INT,
+						(GLvoid*)(command.firstIndex * sizeof(GLuint)), command.baseVertex);
+			}
+			for (const DrawArraysCommand &command : this->arrayCommands)
+			{
+				setDecoding(this->slots[command.baseInstance]);
+				glDrawArrays(GL_TRIANGLES, command.first, command.count);
+			}
+			this->drawCalls = this->drawnChunks;
+		}
+		glBindVertexArray(0);
+	}
+
+private:
+	// The arena starts with room for this many vertices and indices and doubles as needed.
+	static const size_t INITIAL_VERTICES = 1 << 16;
+	static const size_t INITIAL_INDICES = 1 << 17;
+
+	// The layouts glMultiDrawElementsIndirect and glMultiDrawArraysIndirect read.
+	struct DrawElementsCommand
+	{
+		GLuint count;
+		GLuint instanceCount;
+		GLuint firstIndex;
+		GLint baseVertex;
+		GLuint baseInstance;
+	};
+
+	struct DrawArraysCommand
+	{
+		GLuint count;
+		GLuint instanceCount;
+		GLuint first;
+		GLuint baseInstance;
+	};
+
+	struct Slot
+	{
+		glm::ivec3 key;
+		unsigned int version;
+		bool used;
+		size_t vertexOffset;
+		size_t vertexCount;
+		size_t indexOffset;
+		size_t indexCount;
+		glm::vec3 decodeMin;
+		glm::vec3 decodeExtent;
+	};
+
+	/*
+		Reallocates a buffer with a new size, keeping its first bytes.
+	*/
+	static void resize(GLuint &buffer, size_t bytes, size_t newBytes)
+	{
+		GLuint resized;
+		glGenBuffers(1, &resized);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, resized);
+		glBufferData(GL_COPY_WRITE_BUFFER, newBytes, NULL, GL_STATIC_DRAW);
+		if (bytes > 0)
+		{
+			glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+			glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, bytes);
+		}
+		glDeleteBuffers(1, &buffer);
+		buffer = resized;
+	}
+
+	/*
+		Allocates a range of count elements of a buffer, doubling the buffer until it fits.
+	*/
+	size_t reserve(RangeAllocator &allocator, GLuint &buffer, size_t elementSize, size_t count)
+	{
+		size_t offset = 0;
+		if (count == 0)
+		{
+			return offset;
+		}
+		if (!allocator.allocate(count, offset))
+		{
+			// In the worst case the range only fits in the new space.
+			size_t capacity = allocator.size();
+			size_t newCapacity = capacity * 2;
+			while (newCapacity - capacity < count)
+			{
+				newCapacity *= 2;
+			}
+			resize(buffer, capacity * elementSize, newCapacity * elementSize);
+			allocator.grow(newCapacity);
+			allocator.allocate(count, offset);
+			setupVertexArray();
+		}
+		return offset;
+	}
+
+	/*
+		Points the vertex array at the current buffers. Attributes 2 and 3 hold the position decoding,
+		read per instance from the slot buffer when multi-drawing and set as constants otherwise.
+	*/
+	void setupVertexArray()
+	{
+		glBindVertexArray(this->VAO);
+		glBindBuffer(GL_ARRAY_BUFFER, this->VBO);
+		if (this->format == VERTEX_PACKED)
+		{
+			glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(PackedVertex), (GLvoid*)offsetof(PackedVertex, position));
+			glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, sizeof(PackedVertex), (GLvoid*)offsetof(PackedVertex, normal));
+		}
+		else
+		{
+			glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, this->stride, (GLvoid*)0);
+			glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, this->stride, (GLvoid*)(3 * sizeof(float)));
+		}
+		glEnableVertexAttribArray(0);
+		if (this->format != VERTEX_POSITION)
+		{
+			glEnableVertexAttribArray(1);
+		}
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->EBO);
+
+		if (this->multiDraw)
+		{
+			glBindBuffer(GL_ARRAY_BUFFER, this->slotBuffer);
+			glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (GLvoid*)0);
+			glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (GLvoid*)(3 * sizeof(float)));
+			glVertexAttribDivisor(2, 1);
+			glVertexAttribDivisor(3, 1);
+			glEnableVertexAttribArray(2);
+			glEnableVertexAttribArray(3);
+		}
+		glBindVertexArray(0);
+	}
+
+	/*
+		Writes a slot's decoding into the slot buffer, growing it to fit.
+	*/
+	void writeSlot(size_t index)
+	{
+		if (!this->multiDraw)
+		{
+			return;
+		}
+		const size_t slotBytes = 6 * sizeof(float);
+		if (index >= this->slotCapacity)
+		{
+			size_t newCapacity = std::max<size_t>(this->slotCapacity * 2, 256);
+			while (newCapacity <= index)
+			{
+				newCapacity *= 2;
+			}
+			resize(this->slotBuffer, this->slotCapacity * slotBytes, newCapacity * slotBytes);
+			this->slotCapacity = newCapacity;
+			setupVertexArray();
+		}
+		const Slot &slot = this->slots[index];
+		float decoding[6] = {slot.decodeMin.x, slot.decodeMin.y, slot.decodeMin.z,
+			slot.decodeExtent.x, slot.decodeExtent.y, slot.decodeExtent.z};
+		glBindBuffer(GL_ARRAY_BUFFER, this->slotBuffer);
+		glBufferSubData(GL_ARRAY_BUFFER, index * slotBytes, slotBytes, decoding);
+	}
+
+	static void setDecoding(const Slot &slot)
+	{
+		glVertexAttrib3fv(2, &slot.decodeMin[0]);
+		glVertexAttrib3fv(3, &slot.decodeExtent[0]);
+	}
+
+	VertexFormat format;
+	size_t stride;
+	GLuint VAO;
+	GLuint VBO;
+	GLuint EBO;
+	GLuint slotBuffer;
+	GLuint commandBuffer;
+	size_t slotCapacity;
+	RangeAllocator vertices;
+	RangeAllocator indices;
+	std::vector<Slot> slots;
+	std::vector<size_t> freeSlots;
+	std::unordered_map<glm::ivec3, size_t, IVec3Hash> chunks;
+	BoxList boxes;
+	std::vector<unsigned char> visible;
+	std::vector<DrawElementsCommand> elementCommands;
+	std::vector<DrawArraysCommand> arrayCommands;
+};
+
+#endif
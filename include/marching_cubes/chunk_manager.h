@@ -0,0 +1,213 @@
+#ifndef CHUNK_MANAGER_H
+#define CHUNK_MANAGER_H
+
+#include "marching_cubes/frustum_culling.h"
+#include "marching_cubes/ivec3_hash.h"
+#include "marching_cubes/occlusion_culling.h"
+#include "marching_cubes/parallel.h"
+#include "marching_cubes/signed_distance_functions.h"
+#include "marching_cubes/mesh_optimizer.h"
+#include "marching_cubes/vertex_format.h"
+
+#include "glm/glm.hpp"
+
+#include <condition_variable>
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+/*
+ * The marching cubes mesh of one chunk. Depending on format, the vertices are
+ * in vertexBufferData, laid out like marchingCubes()'s or
+ * marchingCubesPositions()'s output, or in packedVertices, quantized within
+ * the chunk's box [min, max]. [boundsMin, boundsMax] is the tighter box around
+ * the vertices, for culling, and occluders are boxes inside the surface,
+ * from findOccluders() or the whole chunk if it is solid throughout, for
+ * occlusion culling. Indexed meshes also have an index buffer of
+ * triangles, and the vertex cache statistics of their triangles before and
+ * after optimizeMesh(). version tells successive meshes of a chunk apart,
+ * and vertexCount and indexCount stay valid after ChunkManager::release()
+ * has dropped the buffers.
+ */
+struct ChunkMesh
+{
+    glm::ivec3 key;
+    unsigned int version;
+    VertexFormat format;
+    glm::vec3 min;
+    glm::vec3 max;
+    glm::vec3 boundsMin;
+    glm::vec3 boundsMax;
+    int vertexCount;
+    int indexCount;
+    std::vector<glm::vec3> vertexBufferData;
+    std::vector<PackedVertex> packedVertices;
+    std::vector<unsigned int> indexBufferData;
+    BoxList occluders;
+    VertexCacheStatistics unoptimized;
+    VertexCacheStatistics optimized;
+};
+
+/*
+ * Streams the zero-isosurface of an unbounded SDF in cubic chunks around a
+ * moving viewer. Chunk (i, j, k) covers chunkSize * [(i, j, k), (i, j, k) + 1]
+ * and is polygonized from a (resolution + 1)^3 window of one lattice shared
+ * by all chunks, whose outer samples lie on the chunk's faces. Neighbours
+ * take their shared samples at the same points, so they meet exactly.
+ *
+ * update() requests the chunks within viewDistance of the viewer, and pool
+ * tasks mesh them in the background, nearest first. Finished meshes are kept
+ * in a cache ordered by when meshes() last returned them. Chunks further than
+ * twice viewDistance are dropped, and the least recently used ones are
+ * evicted while the cache is over its memory budget. No new chunks are
+ * requested while it is over budget, so a budget too small for the view
+ * shrinks the streamed area instead of re-meshing the same chunks every
+ * frame.
+ *
+ * After the SDF is edited, invalidate() re-meshes just the chunks the edit
+ * touched, so the cost of an edit follows its size rather than the view's.
+ *
+ * A chunk whose center is further from the surface than its half diagonal is
+ * cached as empty after a single SDF evaluation, so the SDF should not
+ * overestimate distances.
+ *
+ * Each chunk's occluders are kept along with its mesh, including the chunks
+ * cached as empty because they are solid, and deferHidden() can hold back
+ * the meshing of chunks the occluders of nearer ones hide.
+ *
+ * When indexed is set, chunks with normals are meshed with
+ * flyingEdgesLattice() and passed through optimizeMesh() on the pool, so the
+ * chunks are optimized in parallel. VERTEX_POSITION chunks are never
+ * indexed, since flyingEdgesLattice() would evaluate the normals they skip.
+ */
+class ChunkManager
+{
+    public:
+        ChunkManager(SignedDistanceFunction* sdf, float chunkSize,
+                int resolution, float viewDistance, size_t memoryBudget,
+                ThreadPool &pool, VertexFormat format = VERTEX_FLOAT,
+                bool indexed = false);
+
+        /*
+         * Cancels the chunks waiting to be meshed and waits for the ones
+         * being meshed. Every task the manager has submitted has to run
+         * for this to return, so the pool must outlive the manager.
+         */
+        ~ChunkManager();
+
+        /*
+         * Moves the viewer, requesting the chunks that came into view and
+         * dropping the ones left far behind. Only rescans the chunks in view
+         * when the viewer has entered another chunk.
+         */
+        void update(glm::vec3 viewer);
+
+        /*
+         * Marks the chunks whose meshes depend on the SDF within the box
+         * [min, max] as dirty, after an edit such as SculptSDF::add(). The
+         * chunks sharing border samples with the box are included, so
+         * re-meshed chunks keep matching their neighbours. Dirty chunks keep
+         * their old meshes until new ones are ready, and are re-meshed before
+         * any newly requested chunk.
+         *
+         * Chunks overlapping an invalidated box are always sampled in full
+         * from then on, since an edit confined to a box can hide surface from
+         * the empty chunk test.
+         */
+        void invalidate(glm::vec3 min, glm::vec3 max);
+
+        /*
+         * Returns the finished, non-empty meshes of the chunks in view,
+         * nearest first. A chunk that is re-meshed gets a higher version.
+         */
+        std::vector<std::shared_ptr<const ChunkMesh>> meshes();
+
+        /*
+         * Drops the vertices of a mesh returned by meshes() from the cache,
+         * once the caller holds its own copy, such as in a GPU buffer. The
+         * chunk stays cached and counts against the memory budget as
+         * before, and later calls to meshes() return it without vertices
+         * until it is re-meshed, for as long as it stays in view. The
+         * caller is expected to drop its copy of a chunk once meshes() no
+         * longer returns it, so a released chunk that leaves the view is
+         * evicted instead of kept, and is meshed again if it comes back.
+         */
+        void release(const ChunkMesh &mesh);
+
+        /*
+         * Returns the occluders of the cached chunks in view, nearest chunk
+         * first, so a caller drawing only some of them gets the ones
+         * hiding the most.
+         */
+        BoxList occluders() const;
+
+        /*
+         * Holds back the requested chunks that a buffer, with the
+         * occluders of the current view drawn, finds hidden, and requests
+         * the held back chunks it finds visible again. Held back chunks
+         * don't count as pending, so a view can finish streaming with
+         * chunks never meshed.
+         */
+        void deferHidden(const OcclusionBuffer &buffer);
+
+        size_t memoryUsed() const;
+        int cachedChunks() const;
+        int pendingChunks() const;
+        int hiddenChunks() const;
+
+    private:
+        struct CacheEntry
+        {
+            std::shared_ptr<const ChunkMesh> mesh;
+            size_t bytes;
+            std::list<glm::ivec3>::iterator use;
+            bool released;
+        };
+
+        float distanceTo(glm::ivec3 key) const;
+        void sortPending();
+        void schedule();
+        bool takeNearest(std::unordered_set<glm::ivec3, IVec3Hash> &keys,
+                glm::ivec3 &key) const;
+        bool takeNext(glm::ivec3 &key);
+        void meshNext();
+        std::shared_ptr<ChunkMesh> meshChunk(glm::ivec3 key,
+                bool full) const;
+        void store(glm::ivec3 key, std::shared_ptr<const ChunkMesh> mesh);
+        void evict(glm::ivec3 key);
+
+        SignedDistanceFunction* sdf;
+        float size;
+        int res;
+        float view;
+        size_t budget;
+        ThreadPool &pool;
+        VertexFormat format;
+        bool indexed;
+
+        mutable std::mutex mutex;
+        std::condition_variable idle;
+        glm::vec3 viewer;
+        glm::ivec3 viewerChunk;
+        bool scanned;
+        bool stopping;
+        int scheduled;
+        int running;
+        std::unordered_set<glm::ivec3, IVec3Hash> pending;
+        std::unordered_set<glm::ivec3, IVec3Hash> hidden;
+        std::vector<glm::ivec3> order;
+        std::unordered_set<glm::ivec3, IVec3Hash> meshing;
+        std::unordered_set<glm::ivec3, IVec3Hash> dirty;
+        std::unordered_set<glm::ivec3, IVec3Hash> edited;
+        std::unordered_map<glm::ivec3, CacheEntry, IVec3Hash> cache;
+        std::list<glm::ivec3> uses;
+        size_t bytes;
+        unsigned int versions;
+};
+
+#endif
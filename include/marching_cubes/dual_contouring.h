@@ -0,0 +1,70 @@
+#ifndef DUAL_CONTOURING_H
+#define DUAL_CONTOURING_H
+
+#include "marching_cubes/marching_cubes.h"
+#include "marching_cubes/signed_distance_functions.h"
+
+#include "glm/glm.hpp"
+
+#include <vector>
+
+/*
+ * A quadratic error function: the sum of squared distances from a point to a
+ * set of planes, each given by a point on the surface and its normal. The
+ * point minimising it lies on the intersection of the planes, which is a
+ * corner or crease when the normals disagree and a point on a flat patch when
+ * they don't.
+ */
+class QEF
+{
+    public:
+        QEF();
+
+        void add(glm::vec3 point, glm::vec3 normal);
+        void add(const QEF &other);
+
+        /*
+         * Returns the minimiser closest to the mean of the added points.
+         * Directions along which the planes constrain the point less than
+         * tolerance times the strongest direction are left at the mean, which
+         * keeps flat and nearly flat regions stable. The residual error of
+         * the result is stored in error if it isn't null.
+         */
+        glm::vec3 solve(float tolerance = 0.1f, float* error = nullptr) const;
+
+        float errorAt(glm::vec3 p) const;
+        glm::vec3 massPoint() const;
+        int count() const;
+
+    private:
+        // The upper triangle of A^T A, then A^T b and b^T b.
+        float ata[6];
+        glm::vec3 atb;
+        float btb;
+        glm::vec3 sum;
+        int n;
+};
+
+/*
+ * Stores an indexed mesh of the isosurface in a sampled lattice using dual
+ * contouring. Every edge crossing is paired with the SDF's normal there, and
+ * each cube the surface passes through gets the vertex that best fits the
+ * tangent planes of its crossings, so sharp edges and corners land on the
+ * vertices instead of being cut off. Vertices are kept inside their cube.
+ * The buffers are laid out like surfaceNetsLattice()'s.
+ */
+void dualContouringLattice(SignedDistanceFunction* sdf,
+        const SampleLattice &lattice, float isolevel,
+        std::vector<glm::vec3> &vertexBufferData,
+        std::vector<unsigned int> &indexBufferData);
+
+/*
+ * Returns an indexed mesh of the zero-isosurface of an SDF, sampled on the same
+ * lattice as marchingCubes(). Boxes and other shapes with sharp features keep
+ * them at resolutions several times lower than marching cubes needs.
+ */
+void dualContouring(SignedDistanceFunction* sdf, glm::vec3 min, glm::vec3 max,
+        int resolution, std::vector<glm::vec3> &vertexBufferData,
+        std::vector<unsigned int> &indexBufferData);
+
+#endif
@@ -0,0 +1,156 @@
+#ifndef EXTRACTION_JOB_H
+#define EXTRACTION_JOB_H
+
+#include "marching_cubes/marching_cubes.h"
+#include "marching_cubes/parallel.h"
+#include "marching_cubes/signed_distance_functions.h"
+
+#include "glm/glm.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/*
+ * A marchingCubes() call split into small steps, so that an interactive app
+ * can spend a few milliseconds of each frame on it instead of stalling.
+ *
+ * The lattice is walked one row at a time: the rows of a slice of samples
+ * are evaluated, then the row of cubes between it and the previous slice is
+ * polygonized, and so on. Only two slices of samples are kept. Each call to
+ * advance() does rows until its time budget runs out and picks up where the
+ * last call stopped, appending the vertices of the rows it finished, so the
+ * partial mesh can be shown straight away. Across all calls the vertices come
+ * out in the same order as marchingCubes()'s.
+ */
+class MarchingCubesJob
+{
+    public:
+        /*
+         * Extracts the slices of cubes [firstSlice, lastSlice) of the
+         * lattice, counted along z, or all of them when lastSlice is
+         * negative. Jobs over adjacent ranges can run on separate threads.
+         */
+        MarchingCubesJob(SignedDistanceFunction* sdf, glm::vec3 min,
+                glm::vec3 max, int resolution, int firstSlice = 0,
+                int lastSlice = -1);
+
+        /*
+         * Works for about budgetSeconds, but always does at least one row,
+         * and appends the new vertices and normals to a vertex buffer.
+         * Callers that upload each step separately can pass an empty buffer
+         * every time and avoid the copies of one ever-growing buffer. Returns
+         * true once the mesh is complete; does nothing after that or after
+         * cancel().
+         */
+        bool advance(double budgetSeconds,
+                std::vector<glm::vec3> &vertexBufferData);
+
+        /*
+         * Stops the job before its next row. May be called from any thread,
+         * including while another thread is in advance().
+         */
+        void cancel();
+
+        bool done() const;
+        bool cancelled() const;
+
+        /*
+         * The fraction of rows done so far, from 0 to 1.
+         */
+        float progress() const;
+
+    private:
+        void sampleRow();
+        void polygonizeRow(std::vector<glm::vec3> &vertexBufferData);
+
+        SignedDistanceFunction* sdf;
+        SampleLattice slab;
+        glm::ivec3 size;
+        std::vector<glm::vec3> points;
+        int first;
+        int z;
+        int y;
+        bool sampling;
+        std::atomic<int> rowsDone;
+        int rowsTotal;
+        std::atomic<bool> stop;
+};
+
+class AsyncMesh;
+
+typedef std::function<void(const AsyncMesh &mesh)> CompletionCallback;
+
+/*
+ * A handle to a mesh being extracted by marchingCubesAsync().
+ */
+class AsyncMesh
+{
+    public:
+        /*
+         * The fraction of the lattice's slabs done so far, from 0 to 1.
+         */
+        float progress() const;
+
+        /*
+         * Asks the extraction to stop. The threads working on it stop
+         * before their next row of the lattice, and slabs that haven't
+         * started are skipped, so the pool is free again almost at once.
+         */
+        void cancel();
+
+        /*
+         * Whether the extraction has finished or stopped after cancel().
+         */
+        bool ready() const;
+        bool cancelled() const;
+
+        void wait() const;
+
+        /*
+         * Waits for the extraction, then returns the mesh, laid out like
+         * marchingCubes()'s. The mesh is empty after cancel().
+         */
+        const std::vector<glm::vec3> &get() const;
+
+    private:
+        friend std::shared_ptr<AsyncMesh> marchingCubesAsync(
+                SignedDistanceFunction* sdf, glm::vec3 min, glm::vec3 max,
+                int resolution, CompletionCallback onComplete,
+                ThreadPool &pool);
+
+        AsyncMesh() = default;
+        void finishBlock();
+
+        std::vector<std::unique_ptr<MarchingCubesJob>> jobs;
+        std::vector<std::vector<glm::vec3>> blocks;
+        std::atomic<int> remaining;
+        std::atomic<bool> stop;
+        CompletionCallback callback;
+        std::vector<glm::vec3> vbd;
+        mutable std::mutex mutex;
+        mutable std::condition_variable finished;
+        bool done;
+};
+
+/*
+ * Starts extracting the zero-isosurface of an SDF on a pool, by default
+ * sharedThreadPool(), and returns at once. The lattice is split into a block
+ * of slabs for each thread of the pool, each meshed by a MarchingCubesJob,
+ * and the result is the same as marchingCubes()'s.
+ *
+ * onComplete, if given, is called once the mesh is ready or the extraction
+ * has stopped after a cancel(), on the pool thread that finished last. The
+ * mesh reads as ready inside the callback, but other threads only see it
+ * ready, and return from wait() and get(), once the callback has returned.
+ * The SDF must stay alive and safe to call from several threads until then.
+ */
+std::shared_ptr<AsyncMesh> marchingCubesAsync(SignedDistanceFunction* sdf,
+        glm::vec3 min, glm::vec3 max, int resolution,
+        CompletionCallback onComplete = CompletionCallback(),
+        ThreadPool &pool = sharedThreadPool());
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef FLYING_EDGES_H
+#define FLYING_EDGES_H
+
+#include "marching_cubes/marching_cubes.h"
+#include "marching_cubes/signed_distance_functions.h"
+
+#include "glm/glm.hpp"
+
+#include <vector>
+
+/*
+ * Stores an indexed marching cubes mesh of the isosurface in a sampled
+ * lattice using the Flying Edges algorithm. Rather than visiting cube by cube,
+ * it sweeps the lattice's x rows in four passes:
+ *
+ *   1. classify every x edge and note where each row's crossings begin and
+ *      end,
+ *   2. count the y and z edge crossings and triangles of each row, skipping
+ *      the stretches the first pass showed to be empty,
+ *   3. turn the counts into each row's offsets in the output,
+ *   4. interpolate each row's vertices and write its triangles at those
+ *      offsets.
+ *
+ * Every pass splits the rows among threads with no shared writes, so it needs
+ * no locks or atomics, each crossing is interpolated once, and the buffers are
+ * sized exactly before anything is written. The triangles match
+ * polygonizeLattice()'s, but share their vertices. The buffers are laid out
+ * like surfaceNetsLattice()'s.
+ */
+void flyingEdgesLattice(SignedDistanceFunction* sdf,
+        const SampleLattice &lattice, float isolevel,
+        std::vector<glm::vec3> &vertexBufferData,
+        std::vector<unsigned int> &indexBufferData);
+
+/*
+ * Returns an indexed mesh of the zero-isosurface of an SDF, sampled on the same
+ * lattice as marchingCubes().
+ */
+void flyingEdges(SignedDistanceFunction* sdf, glm::vec3 min, glm::vec3 max,
+        int resolution, std::vector<glm::vec3> &vertexBufferData,
+        std::vector<unsigned int> &indexBufferData);
+
+#endif
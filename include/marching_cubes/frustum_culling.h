@@ -0,0 +1,57 @@
+#ifndef FRUSTUM_CULLING_H
+#define FRUSTUM_CULLING_H
+
+#include "glm/glm.hpp"
+
+#include <cstddef>
+#include <vector>
+
+/*
+ * The six planes of a view frustum. Each is stored as (normal, offset) with
+ * the normal pointing inwards, so point p is on the inner side of a plane
+ * when dot(normal, p) + offset >= 0.
+ */
+struct Frustum
+{
+    glm::vec4 planes[6];
+};
+
+/*
+ * Extracts the frustum of a combined view-projection matrix with OpenGL's
+ * clip space conventions, after Gribb and Hartmann's "Fast Extraction of
+ * Viewing Frustum Planes from the World-View-Projection Matrix". The
+ * planes come out in world space.
+ */
+Frustum extractFrustum(const glm::mat4 &viewProjection);
+
+/*
+ * Axis-aligned boxes with each coordinate of their corners in its own array,
+ * so that cullBoxes() can load the same coordinate of four boxes at once.
+ */
+struct BoxList
+{
+    std::vector<float> minX;
+    std::vector<float> minY;
+    std::vector<float> minZ;
+    std::vector<float> maxX;
+    std::vector<float> maxY;
+    std::vector<float> maxZ;
+
+    void add(glm::vec3 min, glm::vec3 max);
+    void set(size_t i, glm::vec3 min, glm::vec3 max);
+    void clear();
+    size_t size() const;
+};
+
+/*
+ * Sets visible[i] to 1 for each box that isn't entirely on the outer side of
+ * one of the frustum's planes and to 0 otherwise, and returns the number of
+ * visible boxes. For each plane only the box corner furthest along its
+ * normal is tested, so a few boxes near the frustum's edges are kept
+ * although they lie outside it, but no visible box is ever culled. With SSE2
+ * four boxes are tested at a time.
+ */
+size_t cullBoxes(const Frustum &frustum, const BoxList &boxes,
+        std::vector<unsigned char> &visible);
+
+#endif
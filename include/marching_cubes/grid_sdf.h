@@ -0,0 +1,67 @@
+#ifndef GRID_SDF_H
+#define GRID_SDF_H
+
+#include "marching_cubes/signed_distance_functions.h"
+
+#include "glm/glm.hpp"
+
+#include <cstddef>
+#include <vector>
+
+/*
+ * Timing and accuracy figures gathered while baking a GridSDF. Errors are
+ * measured against the source SDF at cell centers, where interpolation is
+ * least accurate.
+ */
+struct GridSDFStats
+{
+    double bakeSeconds;
+    size_t samples;
+    int errorSamples;
+    float maxError;
+    float meanError;
+};
+
+/*
+ * A signed distance function baked onto a regular grid. The wrapped SDF is
+ * evaluated once per grid point when the GridSDF is constructed; afterwards
+ * distances are interpolated from the stored samples, so expensive SDFs can be
+ * meshed repeatedly for the cost of a few memory reads per evaluation.
+ *
+ * Points outside the baked box are clamped onto it and the distance to the box
+ * is added, which keeps the result a conservative distance bound. Axes of
+ * the box shorter than 1e-4 are widened to that, so a flat box still bakes.
+ */
+class GridSDF : public SignedDistanceFunction
+{
+    public:
+        enum Interpolation
+        {
+            TRILINEAR,
+            TRICUBIC
+        };
+
+        GridSDF(SignedDistanceFunction* sdf, glm::vec3 min, glm::vec3 max,
+                int resolution, Interpolation interpolation = TRILINEAR);
+        float distance(glm::vec3 p);
+
+        void setInterpolation(Interpolation interpolation);
+        Interpolation interpolation() const;
+
+        const GridSDFStats &stats() const;
+
+    private:
+        float sample(int x, int y, int z) const;
+        float trilinear(glm::vec3 cell) const;
+        float tricubic(glm::vec3 cell) const;
+
+        glm::vec3 lo;
+        glm::vec3 hi;
+        glm::vec3 step;
+        int n;
+        Interpolation mode;
+        std::vector<float> values;
+        GridSDFStats bakeStats;
+};
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef IVEC3_HASH_H
+#define IVEC3_HASH_H
+
+#include "glm/glm.hpp"
+
+#include <cstddef>
+
+/*
+ * Hashes integer grid coordinates so they can key unordered containers.
+ */
+struct IVec3Hash
+{
+    size_t operator()(const glm::ivec3 &v) const
+    {
+        return ((size_t)(unsigned int)v.x * 73856093u)
+            ^ ((size_t)(unsigned int)v.y * 19349663u)
+            ^ ((size_t)(unsigned int)v.z * 83492791u);
+    }
+};
+
+#endif
@@ -5,8 +5,53 @@
 
 #include "glm/glm.hpp"
 
+#include <array>
 #include <vector>
 
+/*
+ * An SDF sampled on a regular grid of points. Sample (x, y, z) lies at
+ * origin + step * (offset + (x, y, z)), and samples are stored with x varying
+ * fastest, then y, then z. Every group of 8 neighbouring samples forms one
+ * marching cube. Lattices that are windows of one larger grid, with the same
+ * origin and step but different offsets, place their shared samples at
+ * exactly the same points.
+ */
+struct SampleLattice
+{
+    SampleLattice();
+    SampleLattice(glm::vec3 origin, glm::vec3 step, glm::ivec3 size,
+            glm::ivec3 offset = glm::ivec3(0));
+
+    int index(int x, int y, int z) const;
+    glm::vec3 position(int x, int y, int z) const;
+    float value(int x, int y, int z) const;
+
+    glm::vec3 origin;
+    glm::vec3 step;
+    glm::ivec3 size;
+    glm::ivec3 offset;
+    std::vector<float> values;
+};
+
+/*
+ * The lattice offset of each corner of a cube, in the order polygonize()
+ * expects.
+ */
+extern const std::array<glm::ivec3, 8> cornerOffsets;
+
+/*
+ * The marching cubes lookup tables, indexed by a cube's case: bit n is set
+ * when corner n is below the isolevel. edgeTable holds a bit for each edge the
+ * surface crosses, and triTable lists the edges of each triangle, ended by -1.
+ */
+extern const std::array<int, 256> edgeTable;
+extern const std::array<std::array<int, 16>, 256> triTable;
+
+/*
+ * The pair of corners joined by each of the 12 edges of a cube.
+ */
+extern const std::array<std::array<int, 2>, 12> edgeCorners;
+
 /*
  * Returns the interpolated position for a vertex lying between two sample
  * points.
@@ -15,11 +60,29 @@ glm::vec3 interpolateVertex(glm::vec4 corner1, glm::vec4 corner2,
         float isolevel);
 
 /*
- * Returns a numerical approximation of a vertex's normal using the
- * tetrahedron technique described at Inigo Quilez's website.
+ * Returns a numerical approximation of a vertex's normal using the SDF's
+ * gradient.
  */
 glm::vec3 vertexNormal(SignedDistanceFunction* sdf, glm::vec3 vertex);
 
+/*
+ * Stores the vertices and normals generated by a single cube in a vertex
+ * buffer. Each corner holds a position and the SDF value there. Corners 0-3
+ * are the bottom face (min y) in the order (-x, -z), (-x, +z), (+x, +z),
+ * (+x, -z), and corners 4-7 are the top face in the same order.
+ */
+void polygonize(SignedDistanceFunction* sdf,
+        const std::array<glm::vec4, 8> &corners, float isolevel,
+        std::vector<glm::vec3> &vertexBufferData);
+
+/*
+ * Like polygonize(), but stores only the positions of the vertices, so the
+ * SDF isn't evaluated for normals. Renderers can derive flat normals from
+ * each triangle.
+ */
+void polygonizePositions(const std::array<glm::vec4, 8> &corners,
+        float isolevel, std::vector<glm::vec3> &vertexBufferData);
+
 /*
  * Stores the vertices and normals generated by a single sampling cube in a
  * vertex buffer for rendering with OpenGL.
@@ -28,10 +91,49 @@ void polygonize(SignedDistanceFunction* sdf, glm::vec3 center,
         glm::vec3 radius, float isolevel,
         std::vector<glm::vec3> &vertexBufferData);
 
+/*
+ * Evaluates an SDF at every point of a lattice. Samples are requested a row
+ * at a time through SignedDistanceFunction::distances() so vectorized SDFs
+ * can use their batch kernels, and slices are spread across threads.
+ */
+void sampleLattice(SignedDistanceFunction* sdf, SampleLattice &lattice);
+
+/*
+ * Stores the vertices and normals generated by every cube of a sampled
+ * lattice in a vertex buffer.
+ */
+void polygonizeLattice(SignedDistanceFunction* sdf,
+        const SampleLattice &lattice, float isolevel,
+        std::vector<glm::vec3> &vertexBufferData);
+
+/*
+ * Stores the positions of the vertices generated by every cube of a sampled
+ * lattice in a vertex buffer, without normals.
+ */
+void polygonizeLatticePositions(const SampleLattice &lattice, float isolevel,
+        std::vector<glm::vec3> &vertexBufferData);
+
+/*
+ * Returns the unsampled lattice that marchingCubes() polygonizes for a box and
+ * resolution. Its cubes are centered on min + (max - min) / resolution * i for
+ * every i in [0, resolution].
+ */
+SampleLattice marchingCubesLattice(glm::vec3 min, glm::vec3 max,
+        int resolution);
+
 /*
  * Returns a vertex buffer representing the zero-isosurface of an SDF.
  */
 void marchingCubes(SignedDistanceFunction* sdf, glm::vec3 min, glm::vec3 max,
         int resolution, std::vector<glm::vec3> &vertexBufferData);
 
+/*
+ * Like marchingCubes(), but stores only vertex positions, for flat shaded
+ * previews. Skipping the normals halves the buffer and saves the SDF
+ * gradient at every vertex, about a quarter of the work for a smooth surface.
+ */
+void marchingCubesPositions(SignedDistanceFunction* sdf, glm::vec3 min,
+        glm::vec3 max, int resolution,
+        std::vector<glm::vec3> &vertexBufferData);
+
 #endif
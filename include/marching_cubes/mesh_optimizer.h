@@ -0,0 +1,72 @@
+#ifndef MESH_OPTIMIZER_H
+#define MESH_OPTIMIZER_H
+
+#include "glm/glm.hpp"
+
+#include <cstddef>
+#include <vector>
+
+/*
+ * How well an index buffer uses the GPU's post-transform vertex cache, as
+ * measured by analyzeVertexCache(). acmr is the average number of vertices
+ * transformed per triangle, from 3 down to about 0.5 for a large regular
+ * mesh, and atvr the number transformed per vertex referenced, 1 at best.
+ */
+struct VertexCacheStatistics
+{
+    float acmr;
+    float atvr;
+};
+
+/*
+ * Simulates drawing the triangles of an index buffer through a FIFO vertex
+ * cache of cacheSize entries, the kind most GPUs have. vertexCount is the
+ * number of vertices the indices refer to.
+ */
+VertexCacheStatistics analyzeVertexCache(
+        const std::vector<unsigned int> &indexBufferData, size_t vertexCount,
+        int cacheSize = 16);
+
+/*
+ * Reorders the triangles of an index buffer so that they reuse the vertices
+ * of recent triangles, using Tom Forsyth's "Linear-Speed Vertex Cache
+ * Optimisation". The greedy choice of each next triangle is scored against
+ * a simulated 32-entry LRU cache, so the order suits any cache size up to
+ * that. Runs in time linear in the number of triangles.
+ */
+void optimizeVertexCache(std::vector<unsigned int> &indexBufferData,
+        size_t vertexCount);
+
+/*
+ * Reorders the triangles of an index buffer already passed through
+ * optimizeVertexCache() to reduce overdraw, after Sander et al.'s "Fast
+ * Triangle Reordering for Vertex Locality and Reduced Overdraw". The
+ * triangles are split into clusters wherever the cache order starts afresh
+ * or the ACMR of the cluster so far is within threshold times that of the
+ * whole run, and the clusters facing most outwards from the mesh's center
+ * are drawn first, so they hide the rest from the depth test. A threshold
+ * of 1.05 gives up at most 5% of the cache hits. The vertex buffer is laid
+ * out like flyingEdgesLattice()'s, and triangles are wound like
+ * marchingCubes()'s.
+ */
+void optimizeOverdraw(const std::vector<glm::vec3> &vertexBufferData,
+        std::vector<unsigned int> &indexBufferData, float threshold = 1.05f);
+
+/*
+ * Reorders the vertices of an indexed mesh into the order the index buffer
+ * first uses them, so vertex fetches walk memory forward, and rewrites the
+ * indices to match. Vertices no triangle uses are dropped. The vertex buffer
+ * is laid out like flyingEdgesLattice()'s.
+ */
+void optimizeVertexFetch(std::vector<glm::vec3> &vertexBufferData,
+        std::vector<unsigned int> &indexBufferData);
+
+/*
+ * Runs optimizeVertexCache(), optimizeOverdraw() and optimizeVertexFetch()
+ * on an indexed mesh, in that order. The triangles are the same afterwards,
+ * just drawn in another order from reordered vertices.
+ */
+void optimizeMesh(std::vector<glm::vec3> &vertexBufferData,
+        std::vector<unsigned int> &indexBufferData);
+
+#endif
@@ -0,0 +1,95 @@
+#ifndef MESH_STREAM_H
+#define MESH_STREAM_H
+
+#include "marching_cubes/extraction_job.h"
+#include "marching_cubes/parallel.h"
+#include "marching_cubes/signed_distance_functions.h"
+
+#include "glm/glm.hpp"
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <vector>
+
+/*
+ * Returns the SDF of an animated shape at a time, such as a torus whose radii
+ * follow it.
+ */
+typedef std::function<std::shared_ptr<SignedDistanceFunction>(float time)>
+    AnimatedSDF;
+
+/*
+ * Remeshes an animated SDF frame after frame, extracting the next frame with
+ * marchingCubesAsync() while the caller renders the current one.
+ *
+ * Two frames are kept: the current one, whose mesh stays valid until the
+ * next swap(), and the one being extracted. A render loop calls swap() once
+ * per frame, uploads the current mesh when it returns true, then calls
+ * request() for the next frame, so the extraction runs on the pool while the
+ * frame is rendered. When extraction is slower than rendering, frames keep
+ * showing the last mesh instead of waiting for the next one.
+ *
+ * Frames are extracted on the given pool, which must outlive the stream. An
+ * app that already meshes on a pool of its own should pass that one, so the
+ * two pools don't compete for the same cores.
+ */
+class MeshStream
+{
+    public:
+        MeshStream(AnimatedSDF sdf, glm::vec3 min, glm::vec3 max,
+                int resolution, ThreadPool &pool = sharedThreadPool());
+
+        /*
+         * Cancels the frame being extracted and waits for it to stop.
+         */
+        ~MeshStream();
+
+        /*
+         * Starts extracting the mesh at a time, unless a frame is still
+         * being extracted. Returns whether it started.
+         */
+        bool request(float time);
+
+        /*
+         * Makes the extracted frame current if it is ready. Returns whether
+         * the current frame changed.
+         */
+        bool swap();
+
+        /*
+         * The current frame's mesh, laid out like marchingCubes()'s, and the
+         * time it was requested for. The mesh is empty until the first
+         * swap().
+         */
+        const std::vector<glm::vec3> &current() const;
+        float currentTime() const;
+
+        bool extracting() const;
+
+        /*
+         * How long the current frame took from request() until its mesh was
+         * ready.
+         */
+        float extractionMilliseconds() const;
+
+    private:
+        struct Frame
+        {
+            std::shared_ptr<SignedDistanceFunction> sdf;
+            std::shared_ptr<AsyncMesh> mesh;
+            std::shared_ptr<std::atomic<float>> milliseconds;
+            float time;
+        };
+
+        AnimatedSDF animation;
+        glm::vec3 min;
+        glm::vec3 max;
+        int res;
+        ThreadPool &pool;
+        Frame front;
+        Frame back;
+        std::vector<glm::vec3> empty;
+};
+
+#endif
@@ -0,0 +1,152 @@
+#ifndef NOISE_SDF_H
+#define NOISE_SDF_H
+
+#include "marching_cubes/signed_distance_functions.h"
+
+#include "glm/glm.hpp"
+
+#include <array>
+
+/*
+ * A common base for procedural noise used as an implicit function. The field
+ * is amplitude * noise(frequency * p), and the permutation table that drives
+ * the noise is shuffled from a seed so different seeds give unrelated fields.
+ */
+class NoiseSDF : public SignedDistanceFunction
+{
+    public:
+        NoiseSDF(unsigned int seed, float frequency, float amplitude);
+        float distance(glm::vec3 p);
+        void distances(const glm::vec3* points, float* out, int count);
+        glm::vec3 gradient(glm::vec3 p);
+
+        /*
+         * Returns the unscaled noise at p, roughly in [-1, 1]. If derivative
+         * isn't null the analytic derivative is written to it.
+         */
+        virtual float noise(glm::vec3 p,
+                glm::vec3* derivative = nullptr) const = 0;
+
+    protected:
+        /*
+         * Writes noise(scale * points[i]) for count points to out. The default
+         * calls noise() once per point.
+         */
+        virtual void noiseBatch(const glm::vec3* points, float scale,
+                float* out, int count) const;
+
+        int hash(int x, int y, int z) const;
+
+        std::array<unsigned char, 512> perm;
+        float freq;
+        float amp;
+};
+
+/*
+ * Ken Perlin's improved gradient noise.
+ */
+class PerlinNoiseSDF : public NoiseSDF
+{
+    public:
+        PerlinNoiseSDF(unsigned int seed, float frequency = 1.0f,
+                float amplitude = 1.0f);
+        float noise(glm::vec3 p, glm::vec3* derivative = nullptr) const;
+
+    protected:
+        void noiseBatch(const glm::vec3* points, float scale, float* out,
+                int count) const;
+};
+
+/*
+ * Stefan Gustavson's formulation of 3D simplex noise, which has fewer
+ * directional artifacts than Perlin noise and touches 4 lattice points per
+ * sample instead of 8.
+ */
+class SimplexNoiseSDF : public NoiseSDF
+{
+    public:
+        SimplexNoiseSDF(unsigned int seed, float frequency = 1.0f,
+                float amplitude = 1.0f);
+        float noise(glm::vec3 p, glm::vec3* derivative = nullptr) const;
+};
+
+/*
+ * Value noise: smoothly interpolated random values at lattice points. Cheaper
+ * than gradient noise but blockier.
+ */
+class ValueNoiseSDF : public NoiseSDF
+{
+    public:
+        ValueNoiseSDF(unsigned int seed, float frequency = 1.0f,
+                float amplitude = 1.0f);
+        float noise(glm::vec3 p, glm::vec3* derivative = nullptr) const;
+
+    protected:
+        void noiseBatch(const glm::vec3* points, float scale, float* out,
+                int count) const;
+};
+
+/*
+ * Fractional Brownian motion: the sum of octaves of another SDF, each octave
+ * scaled up in frequency by lacunarity and down in amplitude by gain.
+ */
+class FbmSDF : public SignedDistanceFunction
+{
+    public:
+        FbmSDF(SignedDistanceFunction* base, int octaves,
+                float lacunarity = 2.0f, float gain = 0.5f);
+        float distance(glm::vec3 p);
+        void distances(const glm::vec3* points, float* out, int count);
+        glm::vec3 gradient(glm::vec3 p);
+
+    private:
+        SignedDistanceFunction* sdf;
+        int n;
+        float l;
+        float g;
+};
+
+/*
+ * Ridged multifractal noise: like FbmSDF, but each octave is folded into
+ * (offset - |base|)^2, which turns the zero crossings of the base into sharp
+ * ridges.
+ */
+class RidgedSDF : public SignedDistanceFunction
+{
+    public:
+        RidgedSDF(SignedDistanceFunction* base, int octaves,
+                float lacunarity = 2.0f, float gain = 0.5f,
+                float offset = 1.0f);
+        float distance(glm::vec3 p);
+        void distances(const glm::vec3* points, float* out, int count);
+        glm::vec3 gradient(glm::vec3 p);
+
+    private:
+        SignedDistanceFunction* sdf;
+        int n;
+        float l;
+        float g;
+        float o;
+};
+
+/*
+ * Terrain whose surface is y = height(x, 0, z). Heights only depend on x and
+ * z, so when consecutive batches on a thread repeat the same columns (as every
+ * row of a lattice slice does) the heights are reused instead of
+ * re-evaluated. The height SDF must not change while a HeightfieldSDF uses
+ * it.
+ */
+class HeightfieldSDF : public SignedDistanceFunction
+{
+    public:
+        HeightfieldSDF(SignedDistanceFunction* height);
+        float distance(glm::vec3 p);
+        void distances(const glm::vec3* points, float* out, int count);
+        glm::vec3 gradient(glm::vec3 p);
+
+    private:
+        SignedDistanceFunction* h;
+        unsigned long long id;
+};
+
+#endif
@@ -0,0 +1,105 @@
+#ifndef OCCLUSION_CULLING_H
+#define OCCLUSION_CULLING_H
+
+#include "marching_cubes/frustum_culling.h"
+#include "marching_cubes/marching_cubes.h"
+
+#include "glm/glm.hpp"
+
+#include <cstddef>
+#include <vector>
+
+/*
+ * Appends boxes lying entirely inside the surface of a sampled lattice, to be
+ * drawn as occluders. The lattice's cubes are grouped into about blocks^3
+ * blocks, the blocks whose samples are all below the isolevel are solid, and
+ * runs of solid blocks are merged into boxes along x, then y, then z. No cube
+ * of a solid block holds any surface, so the boxes are inside every mesh
+ * polygonized from the lattice.
+ */
+void findOccluders(const SampleLattice &lattice, float isolevel, int blocks,
+        BoxList &occluders);
+
+/*
+ * A low resolution depth buffer that boxes known to be solid are drawn into,
+ * for testing whether other boxes are hidden behind them before they are
+ * drawn, or even meshed.
+ *
+ * Occluders are rasterized on the CPU, four pixels at a time with SSE2. Both
+ * the rasterization and the tests are conservative: a pixel only takes an
+ * occluder's depth if the occluder covers all of it, and then takes its
+ * furthest depth within the pixel, so a box is never reported hidden unless
+ * it really is, as long as the viewer is outside every occluder. After the
+ * occluders, buildHierarchy() reduces the buffer to a pyramid of maximum
+ * depths, so each test reads at most 16 values whatever the size of the box
+ * on screen.
+ *
+ * Depths are OpenGL normalized device z, and boxes crossing the near plane
+ * are neither drawn nor hidden.
+ */
+class OcclusionBuffer
+{
+    public:
+        /*
+         * The width is rounded up to a multiple of 4.
+         */
+        OcclusionBuffer(int width, int height);
+
+        /*
+         * Empties the buffer and sets the view-projection matrix occluders
+         * and tested boxes are drawn with.
+         */
+        void clear(const glm::mat4 &viewProjection);
+
+        /*
+         * Draws a box that is solid throughout, such as one found by
+         * findOccluders().
+         */
+        void addOccluder(glm::vec3 min, glm::vec3 max);
+
+        /*
+         * Draws the first count boxes of a list, or all of them if there
+         * are fewer.
+         */
+        void addOccluders(const BoxList &boxes, size_t count);
+
+        /*
+         * Rebuilds the depth pyramid the tests read, after the occluders
+         * have been drawn.
+         */
+        void buildHierarchy();
+
+        /*
+         * Returns false if a box is behind the occluders everywhere on
+         * screen. Boxes off screen count as visible, so they are left to
+         * frustum culling.
+         */
+        bool boxVisible(glm::vec3 min, glm::vec3 max) const;
+
+        /*
+         * Clears visible[i] for each box with visible[i] set that is hidden,
+         * so it can refine the result of cullBoxes(). Returns the number of
+         * boxes still visible.
+         */
+        size_t testBoxes(const BoxList &boxes,
+                std::vector<unsigned char> &visible) const;
+
+        int width() const;
+        int height() const;
+
+        /*
+         * The depth of pixel (x, y), counted from the bottom left, as drawn.
+         */
+        float depth(int x, int y) const;
+
+    private:
+        bool project(glm::vec3 min, glm::vec3 max, glm::vec3 screen[8]) const;
+
+        int w;
+        int h;
+        glm::mat4 matrix;
+        std::vector<glm::ivec2> sizes;
+        std::vector<std::vector<float>> levels;
+};
+
+#endif
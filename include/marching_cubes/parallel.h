@@ -0,0 +1,64 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ * Returns the number of threads used by parallelFor(), which is the number of
+ * hardware threads or 1 if that can't be determined.
+ */
+int workerCount();
+
+/*
+ * Calls body(i) for every i in [begin, end), splitting the range into
+ * contiguous blocks that are processed on separate threads. Returns once every
+ * index has been processed. The body must be safe to call concurrently for
+ * different indices.
+ *
+ * On a ThreadPool worker the range is processed on the calling thread, as the
+ * pool already keeps the cores busy.
+ */
+void parallelFor(int begin, int end, const std::function<void(int)> &body);
+
+/*
+ * A fixed set of worker threads that run submitted tasks in the order they
+ * were submitted.
+ */
+class ThreadPool
+{
+    public:
+        explicit ThreadPool(int threads = workerCount());
+
+        /*
+         * Runs the tasks that haven't started, including any they submit,
+         * and waits for all of them to finish. Owners of submitted tasks,
+         * such as a ChunkManager waiting for its tasks to report back, may
+         * count on every task running.
+         */
+        ~ThreadPool();
+
+        void submit(std::function<void()> task);
+        int size() const;
+
+    private:
+        void work();
+
+        std::vector<std::thread> threads;
+        std::deque<std::function<void()>> tasks;
+        std::mutex mutex;
+        std::condition_variable wake;
+        bool stopping;
+};
+
+/*
+ * The pool the library's asynchronous functions run on, with workerCount()
+ * threads. It is created on first use and lives until the program exits.
+ */
+ThreadPool &sharedThreadPool();
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef PARTICLE_FIELD_SDF_H
+#define PARTICLE_FIELD_SDF_H
+
+#include "marching_cubes/marching_cubes.h"
+#include "marching_cubes/signed_distance_functions.h"
+
+#include "glm/glm.hpp"
+
+#include <vector>
+
+/*
+ * A metaball field over a set of particles, such as an SPH fluid snapshot.
+ * Each particle contributes the compact kernel (1 - r^2 / radius^2)^3 within
+ * radius of it, and the surface is where the summed field equals threshold.
+ * distance() returns threshold - field, so it is negative inside the fluid but
+ * isn't a true Euclidean distance.
+ *
+ * Particles are bucketed in a uniform spatial hash with one cell per radius,
+ * so a query only visits the 27 cells around it.
+ */
+class ParticleFieldSDF : public SignedDistanceFunction
+{
+    public:
+        ParticleFieldSDF(float radius, float threshold);
+
+        /*
+         * Replaces the particles and rebuilds the spatial hash in parallel.
+         * Call once per frame before meshing.
+         */
+        void setParticles(const std::vector<glm::vec3> &particles);
+
+        float distance(glm::vec3 p);
+        glm::vec3 gradient(glm::vec3 p);
+
+        /*
+         * Fills every sample of a lattice by scattering each particle's kernel
+         * onto the samples within its radius. When there are far fewer
+         * particles than samples this is much cheaper than sampleLattice(),
+         * which gathers from the neighbouring cells once per sample. The
+         * result can be passed straight to polygonizeLattice().
+         */
+        void splat(SampleLattice &lattice) const;
+
+    private:
+        glm::ivec3 cellOf(glm::vec3 p) const;
+        int bucketOf(glm::ivec3 cell) const;
+
+        float h;
+        float iso;
+        int buckets;
+        std::vector<glm::vec3> sorted;
+        std::vector<glm::ivec3> sortedCells;
+        std::vector<int> bucketStart;
+};
+
+#endif
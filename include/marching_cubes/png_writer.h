@@ -0,0 +1,17 @@
+#ifndef PNG_WRITER_H
+#define PNG_WRITER_H
+
+#include <string>
+#include <vector>
+
+/*
+ * Writes an 8-bit RGBA image, stored row by row from the top, as a PNG.
+ * Each row is Sub filtered and compressed with deflate's fixed Huffman codes
+ * and matches against the previous byte only, which is quick and shrinks the
+ * flat backgrounds of renders to almost nothing. Returns false if the file
+ * can't be written.
+ */
+bool savePNG(const std::string &path, int width, int height,
+        const std::vector<unsigned char> &rgba);
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef PROGRESSIVE_H
+#define PROGRESSIVE_H
+
+#include "marching_cubes/signed_distance_functions.h"
+
+#include "glm/glm.hpp"
+
+#include <functional>
+#include <vector>
+
+/*
+ * Receives each mesh produced by progressiveMarchingCubes(). stride is the
+ * number of full-resolution lattice steps spanned by a cube of the mesh, and
+ * is 1 for the final mesh. Returning false stops the refinement.
+ */
+typedef std::function<bool(const std::vector<glm::vec3> &vertexBufferData,
+        int stride)> RefinementCallback;
+
+/*
+ * Extracts the zero-isosurface of an SDF coarse to fine, so a preview can be
+ * shown long before the full-resolution mesh is ready.
+ *
+ * The first mesh is polygonized from every 2^levels-th sample of the lattice
+ * marchingCubes() would use, and each following mesh halves the stride until
+ * the full lattice is reached. The lattices are nested, so each level only
+ * evaluates the samples the previous one didn't have, and the SDF is
+ * evaluated hardly more often than by marchingCubes() alone; the coarse
+ * levels add about 1/7 to the polygonization. Where the full lattice doesn't
+ * divide evenly, coarse levels reach slightly past its far side. The final
+ * mesh is the same as marchingCubes()'s.
+ *
+ * The callback is called on the calling thread after each level. Returns
+ * whether the full-resolution mesh was reached.
+ */
+bool progressiveMarchingCubes(SignedDistanceFunction* sdf, glm::vec3 min,
+        glm::vec3 max, int resolution, int levels,
+        const RefinementCallback &callback);
+
+#endif
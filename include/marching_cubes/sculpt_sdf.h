@@ -0,0 +1,104 @@
+#ifndef SCULPT_SDF_H
+#define SCULPT_SDF_H
+
+#include "marching_cubes/ivec3_hash.h"
+#include "marching_cubes/signed_distance_functions.h"
+
+#include "glm/glm.hpp"
+
+#include <array>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+/*
+ * A base SDF edited by adding and subtracting primitives, for sculpting and
+ * boolean modelling.
+ *
+ * Each edit only applies inside the box passed with it and leaves the
+ * distance everywhere else untouched, so after an edit only the meshes of the
+ * chunks overlapping its box need to be rebuilt, which
+ * ChunkManager::invalidate() does. The primitive's surface should stay at
+ * least a lattice step inside its box, or the edit is visibly clipped.
+ *
+ * Edits are listed per cubic brick of brickSize they overlap, so a point
+ * only visits the edits of its own brick. Edits spanning too many bricks are
+ * kept in one list every point visits instead. A brickSize near the size of
+ * the chunks being meshed, or of a typical edit, works well.
+ *
+ * Edits may be made while other threads evaluate the SDF. Every distance()
+ * or distances() call sees the edits as they were when it started, which
+ * takes a lock; callers evaluating many points, such as ChunkManager for
+ * each chunk, should evaluate a snapshot() instead.
+ */
+class SculptSDF : public SignedDistanceFunction
+{
+    public:
+        SculptSDF(SignedDistanceFunction* base, float brickSize = 0.25f);
+
+        /*
+         * Unites a primitive with the shape within the box [min, max].
+         */
+        void add(SignedDistanceFunction* primitive, glm::vec3 min,
+                glm::vec3 max);
+
+        /*
+         * Carves a primitive out of the shape within the box [min, max].
+         */
+        void subtract(SignedDistanceFunction* primitive, glm::vec3 min,
+                glm::vec3 max);
+
+        float distance(glm::vec3 p);
+        void distances(const glm::vec3* points, float* out, int count);
+
+        /*
+         * Returns the shape with the edits made so far, unaffected by later
+         * ones. The base and the primitives must outlive it.
+         */
+        std::shared_ptr<SignedDistanceFunction> snapshot();
+
+        int editCount() const;
+
+    private:
+        struct Edit
+        {
+            SignedDistanceFunction* primitive;
+            glm::vec3 min;
+            glm::vec3 max;
+            bool subtract;
+            int order;
+        };
+
+        typedef std::vector<Edit> EditList;
+        typedef std::unordered_map<glm::ivec3,
+                std::shared_ptr<const EditList>, IVec3Hash> BrickMap;
+
+        static const int SHARDS = 64;
+
+        /*
+         * The edits as of one moment. The bricks are spread over SHARDS maps
+         * by hash. Maps and lists are shared between successive indexes and
+         * never changed once shared, so an edit only copies the maps and
+         * lists of the bricks it overlaps, however many edits came before.
+         */
+        struct EditIndex
+        {
+            std::array<std::shared_ptr<const BrickMap>, SHARDS> shards;
+            std::shared_ptr<const EditList> large;
+            int count;
+        };
+
+        class Snapshot;
+
+        static int shardOf(glm::ivec3 brick);
+        void append(Edit edit);
+        std::shared_ptr<const EditIndex> current() const;
+
+        SignedDistanceFunction* base;
+        float brick;
+        mutable std::mutex mutex;
+        std::shared_ptr<const EditIndex> edits;
+};
+
+#endif
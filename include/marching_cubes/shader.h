@@ -3,6 +3,11 @@
 
 	This is a slightly adapted version of a shader loader from a tutorial, but I've lost track of where
 	it originally came from.
+
+	Given a cache path, linked programs are also saved there with glGetProgramBinary and loaded back on
+	later runs, skipping compilation. The cache is keyed by a hash of both sources and the driver's
+	vendor, renderer and version strings, and the program is compiled from source whenever the key
+	differs or the driver rejects the binary.
 */
 
 #ifndef SHADER_H
@@ -12,6 +17,9 @@
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <chrono>
+#include <cstdint>
+#include <vector>
 
 #include "GL/glew.h"
 
@@ -20,8 +28,14 @@ class Shader
 public:
 	GLuint program;
 
-	Shader(const GLchar *vertexPath, const GLchar *fragmentPath)
+	// Whether the program came from the binary cache, and how long compiling or loading it took.
+	bool loadedFromCache;
+	double setupMilliseconds;
+
+	Shader(const GLchar *vertexPath, const GLchar *fragmentPath, const GLchar *cachePath = NULL)
 	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
 		std::string vertexCode;
 		std::string fragmentCode;
 		std::ifstream vShaderFile;
@@ -48,6 +62,128 @@ public:
 		{
 			std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
 		}
+
+		// Drivers without a binary format can't retrieve or load programs.
+		GLint binaryFormats = 0;
+		if (cachePath != NULL && (GLEW_VERSION_4_1 || GLEW_ARB_get_program_binary))
+		{
+			glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &binaryFormats);
+		}
+		bool useCache = binaryFormats > 0;
+
+		uint64_t key = 0;
+		if (useCache)
+		{
+			key = cacheKey(vertexCode, fragmentCode);
+		}
+		this->loadedFromCache = useCache && load(cachePath, key);
+		if (!this->loadedFromCache)
+		{
+			compile(vertexCode, fragmentCode, useCache);
+			if (useCache)
+			{
+				save(cachePath, key);
+			}
+		}
+
+		this->setupMilliseconds = std::chrono::duration<double, std::milli>(
+				std::chrono::steady_clock::now() - start).count();
+		std::cout << "Shader program " << (this->loadedFromCache ? "loaded from cache" : "compiled")
+			<< " in " << this->setupMilliseconds << " ms" << std::endl;
+	}
+
+	void use()
+	{
+		glUseProgram(this->program);
+	}
+
+private:
+	/*
+		Returns the FNV-1a hash of the sources and the driver's strings, which change whenever a cached
+		binary could stop being valid.
+	*/
+	static uint64_t cacheKey(const std::string &vertexCode, const std::string &fragmentCode)
+	{
+		std::string text = vertexCode + '\0' + fragmentCode;
+		const GLenum names[] = {GL_VENDOR, GL_RENDERER, GL_VERSION};
+		for (GLenum name : names)
+		{
+			const GLubyte *value = glGetString(name);
+			text += '\0';
+			text += value != NULL ? (const char*)value : "";
+		}
+
+		uint64_t hash = 14695981039346656037ull;
+		for (unsigned char c : text)
+		{
+			hash = (hash ^ c) * 1099511628211ull;
+		}
+		return hash;
+	}
+
+	/*
+		Reads a cache file written by save(), which holds the key, the binary's format and length, and the
+		binary. Returns whether it matched the key and the driver accepted the binary.
+	*/
+	bool load(const GLchar *cachePath, uint64_t key)
+	{
+		std::ifstream file(cachePath, std::ios::binary);
+		uint64_t storedKey = 0;
+		GLenum format = 0;
+		GLint length = 0;
+		file.read((char*)&storedKey, sizeof(storedKey));
+		file.read((char*)&format, sizeof(format));
+		file.read((char*)&length, sizeof(length));
+		if (!file || storedKey != key || length <= 0)
+		{
+			return false;
+		}
+		std::vector<char> binary(length);
+		if (!file.read(binary.data(), length))
+		{
+			return false;
+		}
+
+		this->program = glCreateProgram();
+		glProgramBinary(this->program, format, binary.data(), length);
+		GLint success;
+		glGetProgramiv(this->program, GL_LINK_STATUS, &success);
+		if (!success)
+		{
+			glDeleteProgram(this->program);
+			this->program = 0;
+			return false;
+		}
+		return true;
+	}
+
+	void save(const GLchar *cachePath, uint64_t key)
+	{
+		GLint success;
+		GLint length = 0;
+		glGetProgramiv(this->program, GL_LINK_STATUS, &success);
+		glGetProgramiv(this->program, GL_PROGRAM_BINARY_LENGTH, &length);
+		if (!success || length <= 0)
+		{
+			return;
+		}
+		std::vector<char> binary(length);
+		GLenum format = 0;
+		glGetProgramBinary(this->program, length, &length, &format, binary.data());
+
+		std::ofstream file(cachePath, std::ios::binary | std::ios::trunc);
+		file.write((const char*)&key, sizeof(key));
+		file.write((const char*)&format, sizeof(format));
+		file.write((const char*)&length, sizeof(length));
+		file.write(binary.data(), length);
+		if (!file)
+		{
+			std::cout << "WARNING::SHADER::CACHE_NOT_WRITTEN " << cachePath << std::endl;
+		}
+	}
+
+	void compile(const std::string &vertexCode, const std::string &fragmentCode, bool retrievable)
+	{
 		const GLchar *vShaderCode = vertexCode.c_str();
 		const GLchar *fShaderCode = fragmentCode.c_str();
 
@@ -78,6 +214,10 @@ public:
 		this->program = glCreateProgram();
 		glAttachShader(this->program, vertex);
 		glAttachShader(this->program, fragment);
+		if (retrievable)
+		{
+			glProgramParameteri(this->program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+		}
 		glLinkProgram(this->program);
 		glGetProgramiv(this->program, GL_LINK_STATUS, &success);
 		if (!success)
@@ -89,11 +229,6 @@ public:
 		glDeleteShader(vertex);
 		glDeleteShader(fragment);
 	}
-
-	void use()
-	{
-		glUseProgram(this->program);
-	}
 };
 
 #endif
@@ -3,6 +3,8 @@
 
 #include "glm/glm.hpp"
 
+#include <memory>
+
 /*
  * A common interface for signed distance functions to make them
  * interchangeable.
@@ -11,6 +13,30 @@ class SignedDistanceFunction
 {
     public:
         virtual float distance(glm::vec3 p) = 0;
+
+        /*
+         * Writes the distance at each of count points to out. SDFs with a
+         * vectorized kernel override this; the default calls distance() once
+         * per point.
+         */
+        virtual void distances(const glm::vec3* points, float* out,
+                int count);
+
+        /*
+         * Returns the gradient of the SDF. SDFs with analytic derivatives
+         * override this; the default is a numerical approximation using the
+         * tetrahedron technique described at Inigo Quilez's website.
+         */
+        virtual glm::vec3 gradient(glm::vec3 p);
+
+        /*
+         * Returns an SDF that keeps evaluating this one as it is now, for a
+         * caller about to evaluate it many times, such as to mesh a chunk.
+         * SDFs edited while they are evaluated, such as SculptSDF, return a
+         * frozen copy that needs no locking; the default returns this SDF
+         * itself, which must then outlive the result.
+         */
+        virtual std::shared_ptr<SignedDistanceFunction> snapshot();
 };
 
 /*
@@ -53,4 +79,79 @@ class TorusSDF : public SignedDistanceFunction
         glm::vec2 r;
 };
 
+/*
+ * Repeats another SDF on an infinite grid with the given period. Each query is
+ * folded into a single cell, so the cost doesn't depend on the number of
+ * copies. Axes with a period of 0 aren't repeated.
+ *
+ * Folding is exact when the child fits inside half a period of its cell's
+ * center. Otherwise neighbours should be true, which also evaluates the
+ * adjacent cells on the side of the query (8 evaluations at most).
+ */
+class RepeatSDF : public SignedDistanceFunction
+{
+    public:
+        RepeatSDF(SignedDistanceFunction* sdf, glm::vec3 period,
+                bool neighbours = false);
+        float distance(glm::vec3 p);
+
+    private:
+        SignedDistanceFunction* child;
+        glm::vec3 s;
+        bool n;
+};
+
+/*
+ * Like RepeatSDF, but only the copies with cell indices in [-limits, limits]
+ * exist, giving an array of 2 * limits + 1 copies along each axis.
+ */
+class LimitedRepeatSDF : public SignedDistanceFunction
+{
+    public:
+        LimitedRepeatSDF(SignedDistanceFunction* sdf, glm::vec3 period,
+                glm::ivec3 limits, bool neighbours = false);
+        float distance(glm::vec3 p);
+
+    private:
+        SignedDistanceFunction* child;
+        glm::vec3 s;
+        glm::vec3 l;
+        bool n;
+};
+
+/*
+ * Repeats another SDF count times around the y axis. The copy in sector 0 is
+ * the child as given, centered on the +x axis. With neighbours, the adjacent
+ * sector on the side of the query is evaluated as well. A count below 1 is
+ * taken as 1.
+ */
+class PolarRepeatSDF : public SignedDistanceFunction
+{
+    public:
+        PolarRepeatSDF(SignedDistanceFunction* sdf, int count,
+                bool neighbours = false);
+        float distance(glm::vec3 p);
+
+    private:
+        SignedDistanceFunction* child;
+        int c;
+        bool n;
+};
+
+/*
+ * Mirrors another SDF across the planes through the origin normal to the
+ * selected axes, so the child only needs to describe the positive side. The
+ * result is exact as long as the child doesn't cross a mirror plane.
+ */
+class MirrorSDF : public SignedDistanceFunction
+{
+    public:
+        MirrorSDF(SignedDistanceFunction* sdf, glm::bvec3 axes);
+        float distance(glm::vec3 p);
+
+    private:
+        SignedDistanceFunction* child;
+        glm::bvec3 a;
+};
+
 #endif
@@ -0,0 +1,219 @@
+/*
+	Stream Buffer
+
+	A vertex buffer for a mesh that is replaced every frame, such as MeshStream's. The buffer is split
+	into REGIONS regions written in turn, so a new mesh goes into one region while the GPU may still be
+	drawing older ones from the others. Each region is guarded by a fence placed after the last draw
+	that read it, and is only overwritten once that fence has signalled. The buffer is only
+	reallocated when a mesh outgrows its regions, and then to twice the size.
+
+	With OpenGL 4.4 or ARB_buffer_storage, the buffer is allocated with glBufferStorage and mapped once,
+	persistently and coherently, so an upload is a memcpy into the mapping. Otherwise each upload maps
+	its region with GL_MAP_UNSYNCHRONIZED_BIT, which the fences make safe, so the driver neither waits
+	for the GPU nor copies the buffer aside as glBufferData or a synchronized map may.
+*/
+
+#ifndef STREAM_BUFFER_H
+#define STREAM_BUFFER_H
+
+#include "glm/glm.hpp"
+
+#include "GL/glew.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+class StreamBuffer
+{
+public:
+	// Whether the buffer is mapped persistently rather than once per upload.
+	bool persistent;
+
+	// How often and for how long upload() has waited for the GPU to finish with a region.
+	size_t waits;
+	double waitMilliseconds;
+
+	StreamBuffer()
+		: persistent(GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage), waits(0), waitMilliseconds(0.0),
+		  VBO(0), regionBytes(0), mapped(NULL), region(-1), first(0), count(0)
+	{
+		glGenVertexArrays(1, &this->VAO);
+		for (GLsync &fence : this->fences)
+		{
+			fence = 0;
+		}
+		allocate(INITIAL_REGION_BYTES);
+	}
+
+	~StreamBuffer()
+	{
+		release();
+		glDeleteVertexArrays(1, &this->VAO);
+	}
+
+	/*
+		Copies a mesh laid out like marchingCubes()'s into the next region, waiting first if the GPU may
+		still be reading it.
+	*/
+	void upload(const std::vector<glm::vec3> &vertexBufferData)
+	{
+		size_t bytes = vertexBufferData.size() * sizeof(glm::vec3);
+		if (bytes > this->regionBytes)
+		{
+			allocate(std::max(bytes, 2 * this->regionBytes));
+		}
+
+		int next = (this->region + 1) % REGIONS;
+		wait(next);
+		size_t offset = next * this->regionBytes;
+		if (bytes > 0)
+		{
+			if (this->persistent)
+			{
+				memcpy((char*)this->mapped + offset, vertexBufferData.data(), bytes);
+			}
+			else
+			{
+				glBindBuffer(GL_ARRAY_BUFFER, this->VBO);
+				void *data = glMapBufferRange(GL_ARRAY_BUFFER, offset, bytes,
+						GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+				memcpy(data, vertexBufferData.data(), bytes);
+				glUnmapBuffer(GL_ARRAY_BUFFER);
+				glBindBuffer(GL_ARRAY_BUFFER, 0);
+			}
+		}
+		this->region = next;
+		this->first = (GLint)(offset / VERTEX_BYTES);
+		this->count = (GLsizei)(bytes / VERTEX_BYTES);
+	}
+
+	/*
+		Draws the last mesh uploaded, then fences its region. The shader must be in use, with its
+		uniforms set for float vertices.
+	*/
+	void draw()
+	{
+		if (this->region < 0)
+		{
+			return;
+		}
+		glVertexAttrib3f(2, 0.0f, 0.0f, 0.0f);
+		glVertexAttrib3f(3, 1.0f, 1.0f, 1.0f);
+		glBindVertexArray(this->VAO);
+		glDrawArrays(GL_TRIANGLES, this->first, this->count);
+		glBindVertexArray(0);
+
+		// A region drawn again in a later frame needs a fence after its latest draw.
+		if (this->fences[this->region])
+		{
+			glDeleteSync(this->fences[this->region]);
+		}
+		this->fences[this->region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+
+private:
+	// Three regions let the CPU write one while the GPU may still be drawing the previous two frames.
+	static const int REGIONS = 3;
+	static const size_t VERTEX_BYTES = 2 * sizeof(glm::vec3);
+	static const size_t INITIAL_REGION_BYTES = VERTEX_BYTES << 16;
+
+	/*
+		Blocks until the GPU has finished the draws that read a region.
+	*/
+	void wait(int index)
+	{
+		GLsync &fence = this->fences[index];
+		if (!fence)
+		{
+			return;
+		}
+		if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+		{
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED)
+			{
+			}
+			this->waits++;
+			this->waitMilliseconds += std::chrono::duration<double, std::milli>(
+					std::chrono::steady_clock::now() - start).count();
+		}
+		glDeleteSync(fence);
+		fence = 0;
+	}
+
+	/*
+		Replaces the buffer with one of REGIONS regions of at least regionBytes each. The old buffer's
+		contents are dropped, so the next upload starts again at region 0.
+	*/
+	void allocate(size_t regionBytes)
+	{
+		release();
+		this->regionBytes = (regionBytes + VERTEX_BYTES - 1) / VERTEX_BYTES * VERTEX_BYTES;
+		size_t bytes = REGIONS * this->regionBytes;
+
+		glGenBuffers(1, &this->VBO);
+		glBindBuffer(GL_ARRAY_BUFFER, this->VBO);
+		if (this->persistent)
+		{
+			GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+			glBufferStorage(GL_ARRAY_BUFFER, bytes, NULL, flags);
+			this->mapped = glMapBufferRange(GL_ARRAY_BUFFER, 0, bytes, flags);
+		}
+		else
+		{
+			glBufferData(GL_ARRAY_BUFFER, bytes, NULL, GL_STREAM_DRAW);
+		}
+
+		glBindVertexArray(this->VAO);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, VERTEX_BYTES, (GLvoid*)0);
+		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, VERTEX_BYTES, (GLvoid*)sizeof(glm::vec3));
+		glEnableVertexAttribArray(0);
+		glEnableVertexAttribArray(1);
+		glBindVertexArray(0);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		this->region = -1;
+	}
+
+	/*
+		Deletes the buffer. Draws already submitted keep it alive until they finish, so there's no need
+		to wait for them.
+	*/
+	void release()
+	{
+		for (GLsync &fence : this->fences)
+		{
+			if (fence)
+			{
+				glDeleteSync(fence);
+				fence = 0;
+			}
+		}
+		if (this->VBO == 0)
+		{
+			return;
+		}
+		if (this->mapped)
+		{
+			glBindBuffer(GL_ARRAY_BUFFER, this->VBO);
+			glUnmapBuffer(GL_ARRAY_BUFFER);
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
+			this->mapped = NULL;
+		}
+		glDeleteBuffers(1, &this->VBO);
+		this->VBO = 0;
+	}
+
+	GLuint VAO;
+	GLuint VBO;
+	size_t regionBytes;
+	void *mapped;
+	GLsync fences[REGIONS];
+	int region;
+	GLint first;
+	GLsizei count;
+};
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef SURFACE_NETS_H
+#define SURFACE_NETS_H
+
+#include "marching_cubes/marching_cubes.h"
+#include "marching_cubes/signed_distance_functions.h"
+
+#include "glm/glm.hpp"
+
+#include <vector>
+
+/*
+ * Stores the triangles of a dual mesh: for every lattice edge whose samples
+ * straddle the isolevel, a quad joining the vertices of the 4 cubes around
+ * it, wound the same way as marchingCubes()'s triangles. cubeVertices holds
+ * the vertex index of each cube (x fastest, then y, then z), or -1 for cubes
+ * without one.
+ */
+void dualQuads(const SampleLattice &lattice, float isolevel,
+        const std::vector<int> &cubeVertices,
+        std::vector<unsigned int> &indexBufferData);
+
+/*
+ * Appends the vertices of a dual mesh built one slice of cubes at a time,
+ * each slice holding interleaved positions and normals numbered from 0, and
+ * offsets cubeVertices (laid out as for dualQuads()) to match.
+ */
+void mergeSlices(const std::vector<std::vector<glm::vec3>> &slices,
+        glm::ivec3 cubes, std::vector<int> &cubeVertices,
+        std::vector<glm::vec3> &vertexBufferData);
+
+/*
+ * Stores an indexed mesh of the isosurface in a sampled lattice using naive
+ * surface nets. Every cube the surface passes through gets one vertex, at the
+ * average of the crossings on its edges, and every lattice edge with a sign
+ * change gets a quad joining the vertices of the 4 cubes around it. The
+ * vertex buffer holds interleaved positions and normals like marchingCubes()'s
+ * output, and the index buffer holds triangles.
+ */
+void surfaceNetsLattice(SignedDistanceFunction* sdf,
+        const SampleLattice &lattice, float isolevel,
+        std::vector<glm::vec3> &vertexBufferData,
+        std::vector<unsigned int> &indexBufferData);
+
+/*
+ * Returns an indexed mesh of the zero-isosurface of an SDF, sampled on the same
+ * lattice as marchingCubes(). It has about as many triangles, but they share
+ * their vertices, so the vertex buffer is around a sixth of the size and is
+ * better suited to smoothing and simplification. Sharp features come out
+ * slightly rounded.
+ */
+void surfaceNets(SignedDistanceFunction* sdf, glm::vec3 min, glm::vec3 max,
+        int resolution, std::vector<glm::vec3> &vertexBufferData,
+        std::vector<unsigned int> &indexBufferData);
+
+#endif
@@ -0,0 +1,93 @@
+#ifndef TRANSVOXEL_H
+#define TRANSVOXEL_H
+
+#include "marching_cubes/signed_distance_functions.h"
+
+#include "glm/glm.hpp"
+
+#include <vector>
+
+/*
+ * The faces of a chunk, as bits of a transition mask.
+ */
+enum ChunkFace
+{
+    FACE_NEGATIVE_X = 1,
+    FACE_POSITIVE_X = 2,
+    FACE_NEGATIVE_Y = 4,
+    FACE_POSITIVE_Y = 8,
+    FACE_NEGATIVE_Z = 16,
+    FACE_POSITIVE_Z = 32
+};
+
+/*
+ * A chunk of a terrain meshed at several levels of detail. A chunk at level L
+ * has cells 2^L voxels wide, so it covers the same space as 8 chunks at level
+ * L - 1. position counts chunks of its own level from the terrain's origin,
+ * and transitions has a bit from ChunkFace set for each face whose neighbours
+ * are one level finer.
+ */
+struct LODChunk
+{
+    glm::ivec3 position;
+    int level;
+    int transitions;
+};
+
+/*
+ * Meshes LODChunks of an SDF with Lengyel's Transvoxel scheme, so chunks of
+ * neighbouring levels meet without cracks.
+ *
+ * Inside a chunk, cells are polygonized with the marching cubes tables. On a
+ * face marked as a transition, the layer of cells along the face is squeezed
+ * away from it by a fraction of a cell, and the gap is filled with transition
+ * cells. Each transition cell has the finer neighbour's 3x3 samples on its
+ * outer face and the chunk's own 2x2 samples on its inner face, so its
+ * surface joins up with both. Rather than Lengyel's 512-case tables, the
+ * surface of a transition cell is found by tracing where the isosurface
+ * crosses the cell's faces and filling each closed loop of crossings.
+ *
+ * Sample positions are computed from integer voxel coordinates, so chunks
+ * that share samples agree on them to the bit. Neighbouring chunks must differ
+ * by at most one level, which selectChunks() guarantees.
+ */
+class TransvoxelMesher
+{
+    public:
+        TransvoxelMesher(SignedDistanceFunction* sdf, glm::vec3 origin,
+                float voxelSize, int chunkCells = 16,
+                float transitionWidth = 0.5f);
+
+        glm::vec3 chunkMin(const LODChunk &chunk) const;
+        float chunkSize(int level) const;
+
+        /*
+         * Appends an indexed mesh of a chunk to the buffers, laid out like
+         * surfaceNetsLattice()'s. Chunks are independent of each other, so
+         * several can be meshed in parallel. Transitions are ignored at level
+         * 0, which has no finer level.
+         */
+        void mesh(const LODChunk &chunk,
+                std::vector<glm::vec3> &vertexBufferData,
+                std::vector<unsigned int> &indexBufferData) const;
+
+        /*
+         * Returns the chunks covering the level maxLevel chunks between
+         * minRoot and maxRoot inclusive. A chunk is split while the viewer is
+         * closer to it than detail times its size, then chunks are split
+         * further until neighbours differ by at most one level, and the
+         * transitions of the result are filled in.
+         */
+        std::vector<LODChunk> selectChunks(glm::vec3 viewer,
+                glm::ivec3 minRoot, glm::ivec3 maxRoot, int maxLevel,
+                float detail = 2.0f) const;
+
+    private:
+        SignedDistanceFunction* sdf;
+        glm::vec3 o;
+        float size;
+        int n;
+        float w;
+};
+
+#endif
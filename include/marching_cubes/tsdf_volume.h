@@ -0,0 +1,117 @@
+#ifndef TSDF_VOLUME_H
+#define TSDF_VOLUME_H
+
+#include "marching_cubes/ivec3_hash.h"
+#include "marching_cubes/signed_distance_functions.h"
+
+#include "glm/glm.hpp"
+
+#include <array>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+/*
+ * A depth image in metres, stored row by row. Pixels without a measurement
+ * hold 0.
+ */
+struct DepthImage
+{
+    int width;
+    int height;
+    std::vector<float> depth;
+};
+
+/*
+ * Pinhole camera intrinsics, in pixels.
+ */
+struct CameraIntrinsics
+{
+    float fx;
+    float fy;
+    float cx;
+    float cy;
+};
+
+/*
+ * Reads a binary PGM (P5) depth image, the format most depth-sensor recorders
+ * write, multiplying the raw 8- or 16-bit values by scale to get metres.
+ * Returns false if the file can't be read.
+ */
+bool loadDepthImage(const std::string &path, float scale, DepthImage &image);
+
+/*
+ * A truncated signed distance volume fused from depth frames. Voxels are
+ * allocated in 8x8x8 bricks held in a hash map, so memory only grows with the
+ * observed surface. Each call to integrate() records the bricks it touched,
+ * and updateMeshes() re-polygonizes only those bricks (and the neighbours that
+ * share their border samples), so the cost of a frame follows the newly
+ * observed area rather than the size of the scene.
+ *
+ * Camera space follows the usual depth-sensor convention: x right, y down and
+ * z forward.
+ */
+class TSDFVolume : public SignedDistanceFunction
+{
+    public:
+        static const int BRICK_SIZE = 8;
+
+        TSDFVolume(float voxelSize, float truncation);
+
+        /*
+         * Fuses a depth frame taken by a camera with the given intrinsics and
+         * camera-to-world pose. Returns the number of bricks the frame
+         * touched.
+         */
+        int integrate(const DepthImage &image,
+                const CameraIntrinsics &intrinsics,
+                const glm::mat4 &cameraToWorld);
+
+        /*
+         * Returns the fused distance, or the truncation distance where
+         * nothing has been observed.
+         */
+        float distance(glm::vec3 p);
+
+        /*
+         * Re-polygonizes every brick touched since the last call and returns
+         * how many bricks were re-meshed.
+         */
+        int updateMeshes();
+
+        /*
+         * Appends the vertices and normals of every brick's mesh to a vertex
+         * buffer.
+         */
+        void mesh(std::vector<glm::vec3> &vertexBufferData) const;
+
+        /*
+         * The current mesh of each brick, keyed by brick coordinates.
+         */
+        const std::unordered_map<glm::ivec3, std::vector<glm::vec3>,
+                IVec3Hash> &brickMeshes() const;
+
+        size_t brickCount() const;
+
+    private:
+        struct Voxel
+        {
+            float distance;
+            float weight;
+        };
+
+        typedef std::array<Voxel, BRICK_SIZE * BRICK_SIZE * BRICK_SIZE> Brick;
+
+        const Voxel* voxel(glm::ivec3 v) const;
+        void meshBrick(glm::ivec3 key, std::vector<glm::vec3> &vertexBufferData);
+
+        float size;
+        float trunc;
+        std::unordered_map<glm::ivec3, Brick, IVec3Hash> bricks;
+        std::unordered_map<glm::ivec3, std::vector<glm::vec3>, IVec3Hash>
+            meshes;
+        std::unordered_set<glm::ivec3, IVec3Hash> dirty;
+};
+
+#endif
@@ -0,0 +1,91 @@
+#ifndef VERTEX_FORMAT_H
+#define VERTEX_FORMAT_H
+
+#include "marching_cubes/signed_distance_functions.h"
+
+#include "glm/glm.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/*
+ * The layouts a mesh's vertices can be stored in.
+ *
+ * VERTEX_FLOAT interleaves a float position and normal per vertex, like
+ * marchingCubes()'s output (24 bytes). VERTEX_PACKED stores a PackedVertex
+ * (12 bytes). VERTEX_POSITION stores only a float position, like
+ * marchingCubesPositions()'s output (12 bytes), for renderers that shade
+ * each triangle with its face normal.
+ */
+enum VertexFormat
+{
+    VERTEX_FLOAT,
+    VERTEX_PACKED,
+    VERTEX_POSITION
+};
+
+/*
+ * The number of bytes a vertex takes in a format.
+ */
+size_t vertexSize(VertexFormat format);
+
+/*
+ * A vertex with its position quantized to 16 bits per axis within a box
+ * known to the renderer, and its normal octahedrally encoded in two 16-bit
+ * signed components. The fourth position component only pads the normal to
+ * a 4-byte offset.
+ *
+ * With OpenGL, the position is read as 3 normalized GL_UNSIGNED_SHORTs at
+ * offset 0 and decoded as min + (max - min) * position, and the normal as 2
+ * normalized GL_SHORTs at offset 8 and decoded with octahedralDecode(). On a
+ * box 2 units wide, positions come back within 3e-5 units and normals within
+ * 0.05 degrees.
+ */
+struct PackedVertex
+{
+    uint16_t position[4];
+    int16_t normal[2];
+};
+
+/*
+ * Maps a unit vector onto the [-1, 1] square by projecting it onto an
+ * octahedron and unfolding the lower half, as described by Cigolle et al. in
+ * "A Survey of Efficient Representations for Independent Unit Vectors".
+ */
+glm::vec2 octahedralEncode(glm::vec3 normal);
+glm::vec3 octahedralDecode(glm::vec2 encoded);
+
+PackedVertex packVertex(glm::vec3 position, glm::vec3 normal, glm::vec3 min,
+        glm::vec3 max);
+glm::vec3 unpackPosition(const PackedVertex &vertex, glm::vec3 min,
+        glm::vec3 max);
+glm::vec3 unpackNormal(const PackedVertex &vertex);
+
+/*
+ * Appends the vertices of a buffer laid out like marchingCubes()'s output,
+ * packed within the box [min, max], which must contain every position.
+ */
+void packVertices(const std::vector<glm::vec3> &vertexBufferData,
+        glm::vec3 min, glm::vec3 max, std::vector<PackedVertex> &vertices);
+
+/*
+ * A mesh of PackedVertex triangles, with the box their positions are
+ * quantized in.
+ */
+struct PackedMesh
+{
+    glm::vec3 min;
+    glm::vec3 max;
+    std::vector<PackedVertex> vertices;
+};
+
+/*
+ * Like marchingCubes(), but packs each slice of cubes as soon as it has been
+ * polygonized, so the float vertices of the whole mesh never exist at once.
+ * The box is the lattice's, half a step beyond min and max on each side.
+ */
+void marchingCubesPacked(SignedDistanceFunction* sdf, glm::vec3 min,
+        glm::vec3 max, int resolution, PackedMesh &mesh);
+
+#endif
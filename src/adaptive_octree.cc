@@ -0,0 +1,458 @@
+#include "marching_cubes/adaptive_octree.h"
+#include "marching_cubes/dual_contouring.h"
+#include "marching_cubes/ivec3_hash.h"
+#include "marching_cubes/marching_cubes.h"
+#include "marching_cubes/parallel.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <numeric>
+#include <unordered_map>
+
+// Nodes the surface may pass through are always split down to this depth, so
+// small features aren't missed by the error test on a few coarse samples.
+const int ADAPTIVE_MIN_DEPTH = 3;
+
+/*
+ * A node of the octree. Positions are in units of the smallest possible cell.
+ * Children are stored together, in the order of the bits of
+ * (x, y, z) = (i & 1, (i >> 1) & 1, i >> 2), and so are the corner samples.
+ */
+struct OctreeNode
+{
+    glm::ivec3 min;
+    int size;
+    int children;
+    std::array<float, 8> corners;
+};
+
+static glm::ivec3 octant(int i)
+{
+    return glm::ivec3(i & 1, (i >> 1) & 1, i >> 2);
+}
+
+/*
+ * Builds one subtree of the octree, caching samples by grid position so the
+ * points sampled to test a node are reused by its children.
+ */
+class OctreeBuilder
+{
+    public:
+        OctreeBuilder(SignedDistanceFunction* sdf, glm::vec3 origin,
+                float unit, float tolerance)
+            : sdf(sdf), origin(origin), unit(unit), tolerance(tolerance) {}
+
+        /*
+         * Fills nodes[index] with the node at min, splitting it as far as
+         * needed.
+         */
+        void build(int index, glm::ivec3 min, int size, int depth)
+        {
+            OctreeNode node;
+            node.min = min;
+            node.size = size;
+            node.children = -1;
+            for (int i = 0; i < 8; i++)
+            {
+                node.corners[i] = sample(min + octant(i) * size);
+            }
+
+            if (size > 1 && split(node, depth))
+            {
+                node.children = (int)nodes.size();
+                nodes.resize(nodes.size() + 8);
+                nodes[index] = node;
+                for (int i = 0; i < 8; i++)
+                {
+                    build(node.children + i, min + octant(i) * (size / 2),
+                            size / 2, depth + 1);
+                }
+            }
+            else
+            {
+                nodes[index] = node;
+            }
+        }
+
+        std::vector<OctreeNode> nodes;
+        std::unordered_map<glm::ivec3, float, IVec3Hash> samples;
+
+    private:
+        float sample(glm::ivec3 p)
+        {
+            auto cached = samples.find(p);
+            if (cached != samples.end())
+            {
+                return cached->second;
+            }
+            float value = sdf->distance(origin + unit * glm::vec3(p));
+            samples[p] = value;
+            return value;
+        }
+
+        bool split(const OctreeNode &node, int depth)
+        {
+            // A node can only hold the surface if its center is within half
+            // a diagonal of it.
+            int half = node.size / 2;
+            float center = sample(node.min + glm::ivec3(half));
+            if (std::abs(center) > 0.8660254f * node.size * unit)
+            {
+                return false;
+            }
+            if (depth < ADAPTIVE_MIN_DEPTH)
+            {
+                return true;
+            }
+
+            for (int z = 0; z <= 2; z++)
+            {
+                for (int y = 0; y <= 2; y++)
+                {
+                    for (int x = 0; x <= 2; x++)
+                    {
+                        glm::vec3 f = glm::vec3(x, y, z) * 0.5f;
+                        float trilinear = glm::mix(
+                                glm::mix(glm::mix(node.corners[0],
+                                        node.corners[1], f.x),
+                                    glm::mix(node.corners[2], node.corners[3],
+                                        f.x), f.y),
+                                glm::mix(glm::mix(node.corners[4],
+                                        node.corners[5], f.x),
+                                    glm::mix(node.corners[6], node.corners[7],
+                                        f.x), f.y), f.z);
+                        float value = sample(node.min
+                                + glm::ivec3(x, y, z) * half);
+                        if (std::abs(value - trilinear) > tolerance)
+                        {
+                            return true;
+                        }
+                    }
+                }
+            }
+            return false;
+        }
+
+        SignedDistanceFunction* sdf;
+        glm::vec3 origin;
+        float unit;
+        float tolerance;
+};
+
+/*
+ * Walks the dual grid of an octree and polygonizes each dual cell.
+ */
+class DualMesher
+{
+    public:
+        DualMesher(const std::vector<OctreeNode> &nodes,
+                const std::vector<int> &leafOf,
+                const std::vector<glm::vec4> &leafPoints,
+                std::vector<glm::vec3> &positions,
+                std::vector<unsigned int> &indexBufferData, int base)
+            : nodes(nodes), leafOf(leafOf), leafPoints(leafPoints),
+              positions(positions), indices(indexBufferData), base(base),
+              cells(0) {}
+
+        /*
+         * Visits every dual cell within a group of nodes. The group is held
+         * as 8 slots in octant order, and the bits of mask mark the axes
+         * along which its slots hold different nodes: none for a single
+         * node, one for 2 nodes sharing a face, two for 4 sharing an edge and
+         * all three for 8 sharing a corner. Only groups around a corner
+         * whose nodes are all leaves form dual cells.
+         */
+        void visit(const std::array<int, 8> &slots, int mask)
+        {
+            bool leaves = true;
+            for (int slot : slots)
+            {
+                leaves = leaves && nodes[slot].children < 0;
+            }
+            if (leaves)
+            {
+                if (mask == 7)
+                {
+                    polygonize(slots);
+                }
+                return;
+            }
+
+            // Splitting the nodes divides the group along each axis it
+            // doesn't straddle into a lower half, an upper half and the
+            // plane between them, each of which is visited as a group.
+            int free[3];
+            int freeCount = 0;
+            for (int axis = 0; axis < 3; axis++)
+            {
+                if ((mask & (1 << axis)) == 0)
+                {
+                    free[freeCount++] = axis;
+                }
+            }
+
+            int groups = freeCount == 0 ? 1 : (freeCount == 1 ? 3
+                        : (freeCount == 2 ? 9 : 27));
+            for (int g = 0; g < groups; g++)
+            {
+                // part[axis] is 0 for the lower half, 1 for the upper half
+                // and 2 for the plane between them.
+                int part[3] = {0, 0, 0};
+                int groupMask = mask;
+                for (int k = 0, rest = g; k < freeCount; k++, rest /= 3)
+                {
+                    part[free[k]] = rest % 3;
+                    if (rest % 3 == 2)
+                    {
+                        groupMask |= 1 << free[k];
+                    }
+                }
+
+                std::array<int, 8> group;
+                for (int q = 0; q < 8; q++)
+                {
+                    const OctreeNode &node = nodes[slots[q]];
+                    if (node.children < 0)
+                    {
+                        group[q] = slots[q];
+                        continue;
+                    }
+
+                    // Along straddled axes and the new plane, each slot
+                    // takes the child next to the shared boundary.
+                    int child = 0;
+                    for (int axis = 0; axis < 3; axis++)
+                    {
+                        int side = (q >> axis) & 1;
+                        int bit;
+                        if ((mask & (1 << axis)) != 0)
+                        {
+                            bit = 1 - side;
+                        }
+                        else
+                        {
+                            bit = part[axis] == 2 ? side : part[axis];
+                        }
+                        child |= bit << axis;
+                    }
+                    group[q] = node.children + child;
+                }
+                visit(group, groupMask);
+            }
+        }
+
+        int dualCells() const
+        {
+            return cells;
+        }
+
+    private:
+        void polygonize(const std::array<int, 8> &slots)
+        {
+            cells++;
+            int cubeIndex = 0;
+            std::array<int, 8> corners;
+            for (int n = 0; n < 8; n++)
+            {
+                glm::ivec3 offset = cornerOffsets[n];
+                corners[n] = leafOf[slots[offset.x | offset.y << 1
+                    | offset.z << 2]];
+                if (leafPoints[corners[n]].w < 0.0f)
+                {
+                    cubeIndex |= 1 << n;
+                }
+            }
+            if (edgeTable[cubeIndex] == 0)
+            {
+                return;
+            }
+
+            for (int i = 0; triTable[cubeIndex][i] != -1; i += 3)
+            {
+                int triangle[3];
+                for (int k = 0; k < 3; k++)
+                {
+                    const std::array<int, 2> &edge =
+                        edgeCorners[triTable[cubeIndex][i + k]];
+                    triangle[k] = vertex(corners[edge[0]], corners[edge[1]]);
+                }
+
+                // Cells around corners where leaves of different sizes meet
+                // repeat leaves, and some of their triangles collapse.
+                if (triangle[0] != triangle[1] && triangle[1] != triangle[2]
+                        && triangle[0] != triangle[2])
+                {
+                    indices.push_back(triangle[0]);
+                    indices.push_back(triangle[1]);
+                    indices.push_back(triangle[2]);
+                }
+            }
+        }
+
+        int vertex(int a, int b)
+        {
+            int lo = std::min(a, b);
+            int hi = std::max(a, b);
+            unsigned long long key = (unsigned long long)lo << 32
+                | (unsigned int)hi;
+            auto found = vertices.find(key);
+            if (found != vertices.end())
+            {
+                return found->second;
+            }
+            int index = base + (int)positions.size();
+            positions.push_back(interpolateVertex(leafPoints[lo],
+                        leafPoints[hi], 0.0f));
+            vertices[key] = index;
+            return index;
+        }
+
+        const std::vector<OctreeNode> &nodes;
+        const std::vector<int> &leafOf;
+        const std::vector<glm::vec4> &leafPoints;
+        std::vector<glm::vec3> &positions;
+        std::vector<unsigned int> &indices;
+        int base;
+        int cells;
+        std::unordered_map<unsigned long long, int> vertices;
+};
+
+void adaptiveMarchingCubes(SignedDistanceFunction* sdf, glm::vec3 min,
+        glm::vec3 max, int maxDepth, float tolerance,
+        std::vector<glm::vec3> &vertexBufferData,
+        std::vector<unsigned int> &indexBufferData,
+        AdaptiveOctreeStats* stats)
+{
+    maxDepth = std::max(maxDepth, 1);
+    glm::vec3 extent = max - min;
+    float side = std::max(extent.x, std::max(extent.y, extent.z));
+    int rootSize = 1 << maxDepth;
+    float unit = side / rootSize;
+
+    // The root is always split, and its 8 subtrees are built in parallel.
+    std::vector<OctreeBuilder> builders(8,
+            OctreeBuilder(sdf, min, unit, tolerance));
+    parallelFor(0, 8, [&](int i)
+    {
+        builders[i].nodes.resize(1);
+        builders[i].build(0, octant(i) * (rootSize / 2), rootSize / 2, 1);
+    });
+
+    // Splice the subtrees together behind the root, keeping their roots
+    // together as the root's children.
+    std::vector<OctreeNode> nodes(9);
+    nodes[0].min = glm::ivec3(0);
+    nodes[0].size = rootSize;
+    nodes[0].children = 1;
+    int samples = 0;
+    for (int i = 0; i < 8; i++)
+    {
+        const std::vector<OctreeNode> &subtree = builders[i].nodes;
+        int base = (int)nodes.size() - 1;
+        nodes[0].corners[i] = subtree[0].corners[i];
+        for (size_t k = 0; k < subtree.size(); k++)
+        {
+            OctreeNode node = subtree[k];
+            if (node.children >= 0)
+            {
+                node.children += base;
+            }
+            if (k == 0)
+            {
+                nodes[1 + i] = node;
+            }
+            else
+            {
+                nodes.push_back(node);
+            }
+        }
+
+        // Samples on the planes between subtrees may have been taken by
+        // several of them, and are only counted for the first.
+        for (const auto &sample : builders[i].samples)
+        {
+            glm::ivec3 p = sample.first;
+            bool shared = false;
+            for (int j = 0; j < i && !shared; j++)
+            {
+                glm::ivec3 other = octant(j) * (rootSize / 2);
+                shared = glm::all(glm::greaterThanEqual(p, other))
+                    && glm::all(glm::lessThanEqual(p,
+                                other + glm::ivec3(rootSize / 2)))
+                    && builders[j].samples.count(p) != 0;
+            }
+            samples += shared ? 0 : 1;
+        }
+    }
+
+    // Place each leaf's vertex where the tangent planes of the crossings on
+    // its edges meet, or at its center if the surface doesn't cross it.
+    std::vector<int> leafOf(nodes.size(), -1);
+    std::vector<int> leafNodes;
+    for (size_t i = 0; i < nodes.size(); i++)
+    {
+        if (nodes[i].children < 0)
+        {
+            leafOf[i] = (int)leafNodes.size();
+            leafNodes.push_back((int)i);
+        }
+    }
+    std::vector<glm::vec4> leafPoints(leafNodes.size());
+    parallelFor(0, (int)leafNodes.size(), [&](int leaf)
+    {
+        const OctreeNode &node = nodes[leafNodes[leaf]];
+        glm::vec3 lo = min + unit * glm::vec3(node.min);
+        float size = unit * node.size;
+        auto corner = [&](int n)
+        {
+            glm::ivec3 offset = cornerOffsets[n];
+            return glm::vec4(lo + size * glm::vec3(offset),
+                    node.corners[offset.x | offset.y << 1 | offset.z << 2]);
+        };
+
+        QEF qef;
+        for (const std::array<int, 2> &edge : edgeCorners)
+        {
+            glm::vec4 a = corner(edge[0]);
+            glm::vec4 b = corner(edge[1]);
+            if ((a.w < 0.0f) != (b.w < 0.0f))
+            {
+                glm::vec3 p = interpolateVertex(a, b, 0.0f);
+                qef.add(p, vertexNormal(sdf, p));
+            }
+        }
+
+        glm::vec3 point = qef.count() > 0
+            ? glm::clamp(qef.solve(), lo, lo + size)
+            : lo + size * 0.5f;
+        float value = qef.count() > 0 ? sdf->distance(point)
+            : std::accumulate(node.corners.begin(), node.corners.end(), 0.0f)
+                / 8.0f;
+        leafPoints[leaf] = glm::vec4(point, value);
+    });
+
+    std::vector<glm::vec3> positions;
+    int base = (int)vertexBufferData.size() / 2;
+    DualMesher mesher(nodes, leafOf, leafPoints, positions, indexBufferData,
+            base);
+    std::array<int, 8> root;
+    root.fill(0);
+    mesher.visit(root, 0);
+
+    vertexBufferData.resize(vertexBufferData.size() + 2 * positions.size());
+    parallelFor(0, (int)positions.size(), [&](int i)
+    {
+        vertexBufferData[2 * (size_t)(base + i)] = positions[i];
+        vertexBufferData[2 * (size_t)(base + i) + 1] =
+            vertexNormal(sdf, positions[i]);
+    });
+
+    if (stats != nullptr)
+    {
+        stats->samples = samples;
+        stats->nodes = (int)nodes.size();
+        stats->leaves = (int)leafNodes.size();
+        stats->dualCells = mesher.dualCells();
+    }
+}
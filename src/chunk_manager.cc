@@ -0,0 +1,586 @@
+#include "marching_cubes/chunk_manager.h"
+#include "marching_cubes/flying_edges.h"
+#include "marching_cubes/marching_cubes.h"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+// Chunks look for occluders in about this many blocks per side.
+const int OCCLUDER_BLOCKS = 4;
+
+// Rough cost of a cache entry besides its vertices: the mesh object, its
+// hash map node and its place in the use list.
+const size_t ENTRY_OVERHEAD = 128;
+
+ChunkManager::ChunkManager(SignedDistanceFunction* sdf, float chunkSize,
+        int resolution, float viewDistance, size_t memoryBudget,
+        ThreadPool &pool, VertexFormat format, bool indexed)
+    : sdf(sdf), size(chunkSize), res(std::max(resolution, 1)),
+      view(viewDistance), budget(memoryBudget), pool(pool), format(format),
+      indexed(indexed && format != VERTEX_POSITION), viewer(0.0f),
+      viewerChunk(0), scanned(false), stopping(false), scheduled(0),
+      running(0), bytes(0), versions(0)
+{
+}
+
+ChunkManager::~ChunkManager()
+{
+    // Tasks already handed to the pool still refer to this manager, so wait
+    // for them to find the queue empty.
+    std::unique_lock<std::mutex> lock(mutex);
+    stopping = true;
+    pending.clear();
+    order.clear();
+    idle.wait(lock, [this]() { return scheduled == 0 && running == 0; });
+}
+
+void ChunkManager::update(glm::vec3 viewer)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    this->viewer = viewer;
+    glm::ivec3 chunk = glm::ivec3(glm::floor(viewer / size));
+    if (scanned && chunk == viewerChunk)
+    {
+        return;
+    }
+    scanned = true;
+    viewerChunk = chunk;
+
+    for (auto it = pending.begin(); it != pending.end();)
+    {
+        it = distanceTo(*it) > view ? pending.erase(it) : std::next(it);
+    }
+    for (auto it = hidden.begin(); it != hidden.end();)
+    {
+        it = distanceTo(*it) > view ? hidden.erase(it) : std::next(it);
+    }
+
+    std::vector<glm::ivec3> far;
+    for (const auto &entry : cache)
+    {
+        if (distanceTo(entry.first) > 2.0f * view)
+        {
+            far.push_back(entry.first);
+        }
+    }
+    for (glm::ivec3 key : far)
+    {
+        evict(key);
+    }
+
+    if (bytes <= budget)
+    {
+        int r = (int)std::ceil(view / size);
+        for (int z = chunk.z - r; z <= chunk.z + r; z++)
+        {
+            for (int y = chunk.y - r; y <= chunk.y + r; y++)
+            {
+                for (int x = chunk.x - r; x <= chunk.x + r; x++)
+                {
+                    glm::ivec3 key(x, y, z);
+                    if (distanceTo(key) <= view && !cache.count(key)
+                            && !meshing.count(key) && !hidden.count(key))
+                    {
+                        pending.insert(key);
+                    }
+                }
+            }
+        }
+    }
+
+    sortPending();
+    schedule();
+}
+
+void ChunkManager::invalidate(glm::vec3 min, glm::vec3 max)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    // A lattice step of margin takes in the chunks whose border samples or
+    // normals could see the edit.
+    float step = size / res;
+    min -= step;
+    max += step;
+
+    glm::ivec3 first = glm::ivec3(glm::floor(min / size));
+    glm::ivec3 last = glm::ivec3(glm::floor(max / size));
+    for (int z = first.z; z <= last.z; z++)
+    {
+        for (int y = first.y; y <= last.y; y++)
+        {
+            for (int x = first.x; x <= last.x; x++)
+            {
+                glm::ivec3 key(x, y, z);
+                edited.insert(key);
+                if (cache.count(key) || meshing.count(key))
+                {
+                    dirty.insert(key);
+                }
+            }
+        }
+    }
+    schedule();
+}
+
+std::vector<std::shared_ptr<const ChunkMesh>> ChunkManager::meshes()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<std::pair<float, const CacheEntry*>> visible;
+    std::vector<glm::ivec3> left;
+    for (const auto &entry : cache)
+    {
+        float distance = distanceTo(entry.first);
+        if (distance <= view)
+        {
+            visible.push_back(std::make_pair(distance, &entry.second));
+        }
+        else if (entry.second.released)
+        {
+            left.push_back(entry.first);
+        }
+    }
+
+    // The caller drops its copies of the chunks that left the view, so
+    // released ones have nothing left to show if they come back. They are
+    // evicted, and the next update() rescans the view to request them again.
+    for (glm::ivec3 key : left)
+    {
+        evict(key);
+        scanned = false;
+    }
+
+    std::sort(visible.begin(), visible.end(),
+            [](const std::pair<float, const CacheEntry*> &a,
+                const std::pair<float, const CacheEntry*> &b)
+            {
+                return a.first < b.first;
+            });
+
+    // Touch the furthest first so that the nearest chunks end up the most
+    // recently used and are evicted last.
+    for (auto it = visible.rbegin(); it != visible.rend(); it++)
+    {
+        uses.splice(uses.begin(), uses, it->second->use);
+    }
+
+    std::vector<std::shared_ptr<const ChunkMesh>> result;
+    for (const auto &entry : visible)
+    {
+        if (entry.second->mesh->vertexCount > 0)
+        {
+            result.push_back(entry.second->mesh);
+        }
+    }
+    return result;
+}
+
+void ChunkManager::release(const ChunkMesh &mesh)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = cache.find(mesh.key);
+    if (it == cache.end() || it->second.mesh->version != mesh.version)
+    {
+        return;
+    }
+
+    // Meshes are shared with callers, so the cache gets a copy without
+    // vertices rather than clearing the original.
+    std::shared_ptr<ChunkMesh> stub = std::make_shared<ChunkMesh>();
+    stub->key = mesh.key;
+    stub->version = mesh.version;
+    stub->format = mesh.format;
+    stub->min = mesh.min;
+    stub->max = mesh.max;
+    stub->boundsMin = mesh.boundsMin;
+    stub->boundsMax = mesh.boundsMax;
+    stub->occluders = mesh.occluders;
+    stub->vertexCount = mesh.vertexCount;
+    stub->indexCount = mesh.indexCount;
+    stub->unoptimized = mesh.unoptimized;
+    stub->optimized = mesh.optimized;
+    it->second.mesh = stub;
+    it->second.released = true;
+}
+
+BoxList ChunkManager::occluders() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<std::pair<float, const ChunkMesh*>> visible;
+    for (const auto &entry : cache)
+    {
+        float distance = distanceTo(entry.first);
+        if (distance <= view && entry.second.mesh->occluders.size() > 0)
+        {
+            visible.push_back(
+                    std::make_pair(distance, entry.second.mesh.get()));
+        }
+    }
+    std::sort(visible.begin(), visible.end(),
+            [](const std::pair<float, const ChunkMesh*> &a,
+                const std::pair<float, const ChunkMesh*> &b)
+            {
+                return a.first < b.first;
+            });
+
+    BoxList boxes;
+    for (const auto &entry : visible)
+    {
+        const BoxList &occluders = entry.second->occluders;
+        for (size_t i = 0; i < occluders.size(); i++)
+        {
+            boxes.add(glm::vec3(occluders.minX[i], occluders.minY[i],
+                        occluders.minZ[i]),
+                    glm::vec3(occluders.maxX[i], occluders.maxY[i],
+                        occluders.maxZ[i]));
+        }
+    }
+    return boxes;
+}
+
+void ChunkManager::deferHidden(const OcclusionBuffer &buffer)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto visible = [&](glm::ivec3 key)
+    {
+        glm::vec3 min = glm::vec3(key) * size;
+        return buffer.boxVisible(min, min + size);
+    };
+
+    std::vector<glm::ivec3> revealed;
+    for (auto it = hidden.begin(); it != hidden.end();)
+    {
+        if (visible(*it))
+        {
+            revealed.push_back(*it);
+            it = hidden.erase(it);
+        }
+        else
+        {
+            it++;
+        }
+    }
+
+    // Hidden chunks stay in order and are skipped by takeNext().
+    for (auto it = pending.begin(); it != pending.end();)
+    {
+        if (visible(*it))
+        {
+            it++;
+        }
+        else
+        {
+            hidden.insert(*it);
+            it = pending.erase(it);
+        }
+    }
+
+    if (!revealed.empty())
+    {
+        pending.insert(revealed.begin(), revealed.end());
+        sortPending();
+        schedule();
+    }
+}
+
+size_t ChunkManager::memoryUsed() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return bytes;
+}
+
+int ChunkManager::cachedChunks() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return (int)cache.size();
+}
+
+int ChunkManager::pendingChunks() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return (int)(pending.size() + meshing.size() + dirty.size());
+}
+
+int ChunkManager::hiddenChunks() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return (int)hidden.size();
+}
+
+/*
+ * Returns the distance from the viewer to the closest point of a chunk.
+ */
+float ChunkManager::distanceTo(glm::ivec3 key) const
+{
+    glm::vec3 min = glm::vec3(key) * size;
+    glm::vec3 closest = glm::clamp(viewer, min, min + size);
+    return glm::length(viewer - closest);
+}
+
+/*
+ * Orders the requested chunks for takeNext().
+ */
+void ChunkManager::sortPending()
+{
+    // Sorted furthest first so that the nearest chunk can be popped off the
+    // back.
+    order.assign(pending.begin(), pending.end());
+    std::vector<float> distances(order.size());
+    std::vector<int> ranks(order.size());
+    for (size_t i = 0; i < order.size(); i++)
+    {
+        distances[i] = distanceTo(order[i]);
+        ranks[i] = (int)i;
+    }
+    std::sort(ranks.begin(), ranks.end(), [&](int a, int b)
+    {
+        return distances[a] > distances[b];
+    });
+    std::vector<glm::ivec3> sorted(order.size());
+    for (size_t i = 0; i < order.size(); i++)
+    {
+        sorted[i] = order[ranks[i]];
+    }
+    order.swap(sorted);
+}
+
+/*
+ * Submits a task for every chunk waiting to be meshed. Each task meshes
+ * whichever chunk is most urgent when it starts, so tasks are
+ * interchangeable and only their number needs to follow the queues.
+ */
+void ChunkManager::schedule()
+{
+    while (scheduled < (int)(pending.size() + dirty.size()))
+    {
+        scheduled++;
+        pool.submit([this]() { meshNext(); });
+    }
+}
+
+/*
+ * Removes the key nearest to the viewer from a set, skipping chunks that are
+ * being meshed already. Returns false if there is no such key. A linear scan
+ * is fine for the dirty set, which only holds the chunks of recent edits.
+ */
+bool ChunkManager::takeNearest(
+        std::unordered_set<glm::ivec3, IVec3Hash> &keys, glm::ivec3 &key) const
+{
+    auto nearest = keys.end();
+    float nearestDistance = 0.0f;
+    for (auto it = keys.begin(); it != keys.end(); it++)
+    {
+        if (meshing.count(*it))
+        {
+            continue;
+        }
+        float distance = distanceTo(*it);
+        if (nearest == keys.end() || distance < nearestDistance)
+        {
+            nearest = it;
+            nearestDistance = distance;
+        }
+    }
+    if (nearest == keys.end())
+    {
+        return false;
+    }
+    key = *nearest;
+    keys.erase(nearest);
+    return true;
+}
+
+/*
+ * Removes the nearest of the requested chunks, as of the last scan. Chunks
+ * dropped from pending since are skipped.
+ */
+bool ChunkManager::takeNext(glm::ivec3 &key)
+{
+    while (!order.empty())
+    {
+        key = order.back();
+        order.pop_back();
+        if (pending.erase(key))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void ChunkManager::meshNext()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    scheduled--;
+    glm::ivec3 key;
+    if (stopping
+            || !(takeNearest(dirty, key) || takeNext(key)))
+    {
+        idle.notify_all();
+        return;
+    }
+    meshing.insert(key);
+    running++;
+    bool full = edited.count(key) != 0;
+
+    lock.unlock();
+    std::shared_ptr<ChunkMesh> mesh = meshChunk(key, full);
+    lock.lock();
+    mesh->version = ++versions;
+
+    meshing.erase(key);
+    running--;
+    if (!stopping)
+    {
+        if (cache.count(key) || distanceTo(key) <= 2.0f * view)
+        {
+            store(key, mesh);
+        }
+
+        // The chunk may have been invalidated again while it was meshed.
+        schedule();
+    }
+    idle.notify_all();
+}
+
+/*
+ * Sets a mesh's bounds to the box around the positions in its vertex buffer,
+ * which holds stride vectors per vertex.
+ */
+static void findBounds(ChunkMesh &mesh, int stride)
+{
+    const std::vector<glm::vec3> &vbd = mesh.vertexBufferData;
+    if (vbd.empty())
+    {
+        return;
+    }
+    mesh.boundsMin = vbd[0];
+    mesh.boundsMax = vbd[0];
+    for (size_t i = stride; i < vbd.size(); i += stride)
+    {
+        mesh.boundsMin = glm::min(mesh.boundsMin, vbd[i]);
+        mesh.boundsMax = glm::max(mesh.boundsMax, vbd[i]);
+    }
+}
+
+std::shared_ptr<ChunkMesh> ChunkManager::meshChunk(glm::ivec3 key,
+        bool full) const
+{
+    // Evaluating a snapshot spares an SDF edited meanwhile, such as a
+    // SculptSDF, from locking at every sample and normal.
+    std::shared_ptr<SignedDistanceFunction> frozen = sdf->snapshot();
+
+    // The chunk's lattice is a window of one lattice shared by all chunks,
+    // so neighbours place their shared border samples at the same points.
+    float step = size / res;
+    SampleLattice lattice(glm::vec3(0.0f), glm::vec3(step),
+            glm::ivec3(res + 1), key * res);
+
+    std::shared_ptr<ChunkMesh> mesh = std::make_shared<ChunkMesh>();
+    glm::vec3 min = lattice.position(0, 0, 0);
+    mesh->key = key;
+    mesh->version = 0;
+    mesh->format = format;
+    mesh->min = min;
+    mesh->max = lattice.position(res, res, res);
+    mesh->boundsMin = mesh->min;
+    mesh->boundsMax = mesh->max;
+    mesh->vertexCount = 0;
+    mesh->indexCount = 0;
+    mesh->unoptimized = {0.0f, 0.0f};
+    mesh->optimized = {0.0f, 0.0f};
+
+    float halfDiagonal = 0.5f * std::sqrt(3.0f) * size;
+    float centerDistance = frozen->distance(min + 0.5f * size);
+    if (!full && std::fabs(centerDistance) > halfDiagonal + step)
+    {
+        if (centerDistance < 0.0f)
+        {
+            mesh->occluders.add(mesh->min, mesh->max);
+        }
+        return mesh;
+    }
+
+    sampleLattice(frozen.get(), lattice);
+    findOccluders(lattice, 0.0f, OCCLUDER_BLOCKS, mesh->occluders);
+    if (format == VERTEX_POSITION)
+    {
+        polygonizeLatticePositions(lattice, 0.0f, mesh->vertexBufferData);
+        mesh->vertexCount = (int)mesh->vertexBufferData.size();
+        findBounds(*mesh, 1);
+        mesh->vertexBufferData.shrink_to_fit();
+        return mesh;
+    }
+    if (indexed)
+    {
+        flyingEdgesLattice(frozen.get(), lattice, 0.0f,
+                mesh->vertexBufferData, mesh->indexBufferData);
+        mesh->unoptimized = analyzeVertexCache(mesh->indexBufferData,
+                mesh->vertexBufferData.size() / 2);
+        optimizeMesh(mesh->vertexBufferData, mesh->indexBufferData);
+        mesh->optimized = analyzeVertexCache(mesh->indexBufferData,
+                mesh->vertexBufferData.size() / 2);
+        mesh->indexCount = (int)mesh->indexBufferData.size();
+    }
+    else
+    {
+        polygonizeLattice(frozen.get(), lattice, 0.0f,
+                mesh->vertexBufferData);
+    }
+    mesh->vertexCount = (int)mesh->vertexBufferData.size() / 2;
+    findBounds(*mesh, 2);
+    if (format == VERTEX_PACKED)
+    {
+        packVertices(mesh->vertexBufferData, mesh->min, mesh->max,
+                mesh->packedVertices);
+        std::vector<glm::vec3>().swap(mesh->vertexBufferData);
+    }
+    mesh->vertexBufferData.shrink_to_fit();
+    return mesh;
+}
+
+/*
+ * Puts a mesh in the cache as the most recently used, replacing the chunk's
+ * old mesh if it has one, and evicts chunks while over budget.
+ */
+void ChunkManager::store(glm::ivec3 key, std::shared_ptr<const ChunkMesh> mesh)
+{
+    auto it = cache.find(key);
+    if (it == cache.end())
+    {
+        uses.push_front(key);
+        it = cache.insert(std::make_pair(key, CacheEntry())).first;
+        it->second.use = uses.begin();
+        it->second.bytes = 0;
+    }
+    else
+    {
+        uses.splice(uses.begin(), uses, it->second.use);
+    }
+
+    bytes -= it->second.bytes;
+    it->second.mesh = mesh;
+    it->second.released = false;
+    it->second.bytes = ENTRY_OVERHEAD
+        + (size_t)mesh->vertexCount * vertexSize(mesh->format)
+        + (size_t)mesh->indexCount * sizeof(unsigned int)
+        + mesh->occluders.size() * 6 * sizeof(float);
+    bytes += it->second.bytes;
+
+    while (bytes > budget && !uses.empty())
+    {
+        evict(uses.back());
+    }
+}
+
+void ChunkManager::evict(glm::ivec3 key)
+{
+    auto it = cache.find(key);
+    bytes -= it->second.bytes;
+    uses.erase(it->second.use);
+    cache.erase(it);
+    if (!meshing.count(key))
+    {
+        dirty.erase(key);
+    }
+}
@@ -0,0 +1,302 @@
+#include "marching_cubes/dual_contouring.h"
+#include "marching_cubes/parallel.h"
+#include "marching_cubes/surface_nets.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <utility>
+
+QEF::QEF() : ata(), atb(0.0f), btb(0.0f), sum(0.0f), n(0) {}
+
+void QEF::add(glm::vec3 point, glm::vec3 normal)
+{
+    ata[0] += normal.x * normal.x;
+    ata[1] += normal.x * normal.y;
+    ata[2] += normal.x * normal.z;
+    ata[3] += normal.y * normal.y;
+    ata[4] += normal.y * normal.z;
+    ata[5] += normal.z * normal.z;
+    float d = glm::dot(normal, point);
+    atb += normal * d;
+    btb += d * d;
+    sum += point;
+    n++;
+}
+
+void QEF::add(const QEF &other)
+{
+    for (int i = 0; i < 6; i++)
+    {
+        ata[i] += other.ata[i];
+    }
+    atb += other.atb;
+    btb += other.btb;
+    sum += other.sum;
+    n += other.n;
+}
+
+/*
+ * Diagonalizes a symmetric 3x3 matrix with Jacobi rotations, leaving the
+ * eigenvalues on the diagonal of a and the eigenvectors in the columns of v.
+ */
+static void symmetricEigen(float a[3][3], float v[3][3])
+{
+    for (int i = 0; i < 3; i++)
+    {
+        for (int j = 0; j < 3; j++)
+        {
+            v[i][j] = i == j ? 1.0f : 0.0f;
+        }
+    }
+
+    for (int sweep = 0; sweep < 8; sweep++)
+    {
+        float off = a[0][1] * a[0][1] + a[0][2] * a[0][2]
+            + a[1][2] * a[1][2];
+        if (off < 1e-12f)
+        {
+            break;
+        }
+
+        for (int p = 0; p < 2; p++)
+        {
+            for (int q = p + 1; q < 3; q++)
+            {
+                if (std::abs(a[p][q]) < 1e-12f)
+                {
+                    continue;
+                }
+
+                // The rotation that zeroes a[p][q].
+                float theta = (a[q][q] - a[p][p]) / (2.0f * a[p][q]);
+                float t = (theta >= 0.0f ? 1.0f : -1.0f)
+                    / (std::abs(theta) + std::sqrt(theta * theta + 1.0f));
+                float c = 1.0f / std::sqrt(t * t + 1.0f);
+                float s = t * c;
+
+                for (int k = 0; k < 3; k++)
+                {
+                    float akp = a[k][p];
+                    float akq = a[k][q];
+                    a[k][p] = c * akp - s * akq;
+                    a[k][q] = s * akp + c * akq;
+                }
+                for (int k = 0; k < 3; k++)
+                {
+                    float apk = a[p][k];
+                    float aqk = a[q][k];
+                    a[p][k] = c * apk - s * aqk;
+                    a[q][k] = s * apk + c * aqk;
+                }
+                for (int k = 0; k < 3; k++)
+                {
+                    float vkp = v[k][p];
+                    float vkq = v[k][q];
+                    v[k][p] = c * vkp - s * vkq;
+                    v[k][q] = s * vkp + c * vkq;
+                }
+            }
+        }
+    }
+}
+
+glm::vec3 QEF::solve(float tolerance, float* error) const
+{
+    glm::vec3 mass = massPoint();
+    float a[3][3] = {
+        {ata[0], ata[1], ata[2]},
+        {ata[1], ata[3], ata[4]},
+        {ata[2], ata[4], ata[5]}};
+
+    // Solve A^T A x = A^T b around the mass point with the pseudo-inverse, so
+    // that unconstrained directions stay at the mass point.
+    glm::vec3 r = atb - glm::vec3(
+            a[0][0] * mass.x + a[0][1] * mass.y + a[0][2] * mass.z,
+            a[1][0] * mass.x + a[1][1] * mass.y + a[1][2] * mass.z,
+            a[2][0] * mass.x + a[2][1] * mass.y + a[2][2] * mass.z);
+
+    float v[3][3];
+    symmetricEigen(a, v);
+    float largest = std::max(a[0][0], std::max(a[1][1], a[2][2]));
+
+    // The eigenvalues of A^T A are the squared singular values of A.
+    glm::vec3 x = mass;
+    for (int i = 0; i < 3 && largest > 0.0f; i++)
+    {
+        if (a[i][i] > tolerance * tolerance * largest)
+        {
+            glm::vec3 axis(v[0][i], v[1][i], v[2][i]);
+            x += axis * (glm::dot(axis, r) / a[i][i]);
+        }
+    }
+
+    if (error != nullptr)
+    {
+        *error = errorAt(x);
+    }
+    return x;
+}
+
+float QEF::errorAt(glm::vec3 p) const
+{
+    glm::vec3 ap(ata[0] * p.x + ata[1] * p.y + ata[2] * p.z,
+            ata[1] * p.x + ata[3] * p.y + ata[4] * p.z,
+            ata[2] * p.x + ata[4] * p.y + ata[5] * p.z);
+    return std::max(glm::dot(p, ap) - 2.0f * glm::dot(p, atb) + btb, 0.0f);
+}
+
+glm::vec3 QEF::massPoint() const
+{
+    return n > 0 ? sum / (float)n : glm::vec3(0.0f);
+}
+
+int QEF::count() const
+{
+    return n;
+}
+
+/*
+ * Returns where the isosurface crosses the edge between two samples. Linear
+ * interpolation is only exact for planar fields, and the error next to a
+ * corner tilts the planes the QEF is built from, so the estimate is refined
+ * with a few steps of false position on the SDF itself.
+ */
+static glm::vec3 crossing(SignedDistanceFunction* sdf, glm::vec4 lower,
+        glm::vec4 upper, float isolevel)
+{
+    glm::vec4 a = lower;
+    glm::vec4 b = upper;
+    glm::vec3 point = interpolateVertex(a, b, isolevel);
+    for (int i = 0; i < 4; i++)
+    {
+        float value = sdf->distance(point);
+        if (std::abs(value - isolevel) < 1e-6f)
+        {
+            break;
+        }
+        if ((value < isolevel) == (a.w < isolevel))
+        {
+            a = glm::vec4(point, value);
+        }
+        else
+        {
+            b = glm::vec4(point, value);
+        }
+        point = interpolateVertex(a, b, isolevel);
+    }
+    return point;
+}
+
+void dualContouringLattice(SignedDistanceFunction* sdf,
+        const SampleLattice &lattice, float isolevel,
+        std::vector<glm::vec3> &vertexBufferData,
+        std::vector<unsigned int> &indexBufferData)
+{
+    glm::ivec3 cubes = lattice.size - 1;
+    if (cubes.x <= 0 || cubes.y <= 0 || cubes.z <= 0)
+    {
+        return;
+    }
+
+    // Find the Hermite data of every lattice edge with a sign change once, as
+    // up to 4 cubes share each edge. Edges are numbered by their lower sample
+    // and axis, and stored with the slice of their lower sample.
+    std::vector<int> edgeHermite((size_t)lattice.values.size() * 3, -1);
+    std::vector<std::vector<std::pair<glm::vec3, glm::vec3>>> hermite(
+            lattice.size.z);
+    parallelFor(0, lattice.size.z, [&](int z)
+    {
+        for (int y = 0; y < lattice.size.y; y++)
+        {
+            for (int x = 0; x < lattice.size.x; x++)
+            {
+                glm::vec4 lower(lattice.position(x, y, z),
+                        lattice.value(x, y, z));
+                for (int axis = 0; axis < 3; axis++)
+                {
+                    glm::ivec3 next(x, y, z);
+                    next[axis]++;
+                    if (next[axis] >= lattice.size[axis])
+                    {
+                        continue;
+                    }
+                    glm::vec4 upper(lattice.position(next.x, next.y, next.z),
+                            lattice.value(next.x, next.y, next.z));
+                    if ((lower.w < isolevel) == (upper.w < isolevel))
+                    {
+                        continue;
+                    }
+
+                    glm::vec3 point = crossing(sdf, lower, upper, isolevel);
+                    edgeHermite[(size_t)lattice.index(x, y, z) * 3 + axis] =
+                        (int)hermite[z].size();
+                    hermite[z].push_back(std::make_pair(point,
+                                vertexNormal(sdf, point)));
+                }
+            }
+        }
+    });
+
+    // Place one vertex in every cube the surface passes through, numbered
+    // per slice and offset afterwards as in surfaceNetsLattice().
+    std::vector<int> cubeVertices((size_t)cubes.x * cubes.y * cubes.z, -1);
+    std::vector<std::vector<glm::vec3>> slices(cubes.z);
+    parallelFor(0, cubes.z, [&](int z)
+    {
+        for (int y = 0; y < cubes.y; y++)
+        {
+            for (int x = 0; x < cubes.x; x++)
+            {
+                QEF qef;
+                for (int n = 0; n < 8; n++)
+                {
+                    glm::ivec3 c = glm::ivec3(x, y, z) + cornerOffsets[n];
+                    for (int axis = 0; axis < 3; axis++)
+                    {
+                        // Each edge of the cube is visited once, from its
+                        // lower corner.
+                        glm::ivec3 offset = cornerOffsets[n];
+                        if (offset[axis] == 1)
+                        {
+                            continue;
+                        }
+                        int e = edgeHermite[(size_t)lattice.index(c.x, c.y,
+                                c.z) * 3 + axis];
+                        if (e >= 0)
+                        {
+                            const std::pair<glm::vec3, glm::vec3> &h =
+                                hermite[c.z][e];
+                            qef.add(h.first, h.second);
+                        }
+                    }
+                }
+                if (qef.count() == 0)
+                {
+                    continue;
+                }
+
+                glm::vec3 lo = lattice.position(x, y, z);
+                glm::vec3 hi = lattice.position(x + 1, y + 1, z + 1);
+                glm::vec3 vertex = glm::clamp(qef.solve(), lo, hi);
+                cubeVertices[(z * cubes.y + y) * cubes.x + x] =
+                    (int)slices[z].size() / 2;
+                slices[z].push_back(vertex);
+                slices[z].push_back(vertexNormal(sdf, vertex));
+            }
+        }
+    });
+
+    mergeSlices(slices, cubes, cubeVertices, vertexBufferData);
+    dualQuads(lattice, isolevel, cubeVertices, indexBufferData);
+}
+
+void dualContouring(SignedDistanceFunction* sdf, glm::vec3 min, glm::vec3 max,
+        int resolution, std::vector<glm::vec3> &vertexBufferData,
+        std::vector<unsigned int> &indexBufferData)
+{
+    SampleLattice lattice = marchingCubesLattice(min, max, resolution);
+    sampleLattice(sdf, lattice);
+    dualContouringLattice(sdf, lattice, 0.0f, vertexBufferData,
+            indexBufferData);
+}
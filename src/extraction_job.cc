@@ -0,0 +1,251 @@
+#include "marching_cubes/extraction_job.h"
+#include "marching_cubes/parallel.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <limits>
+
+// The mesh whose completion callback is running on this thread. It reads as
+// ready to the callback, while other threads wait for the callback to return.
+static thread_local const AsyncMesh* completing = nullptr;
+
+MarchingCubesJob::MarchingCubesJob(SignedDistanceFunction* sdf,
+        glm::vec3 min, glm::vec3 max, int resolution, int firstSlice,
+        int lastSlice)
+    : sdf(sdf), y(0), sampling(true), rowsDone(0), stop(false)
+{
+    // The lattice of marchingCubesLattice(), but with room for two slices of
+    // samples, which take turns holding the even and odd slices.
+    glm::vec3 step = (max - min) / (float)resolution;
+    size = glm::ivec3(resolution + 2);
+    slab = SampleLattice(min - step * 0.5f, step,
+            glm::ivec3(size.x, size.y, 2));
+    points.resize(size.x);
+
+    first = glm::clamp(firstSlice, 0, size.z - 1);
+    int last = lastSlice < 0 ? size.z - 1 : glm::clamp(lastSlice, first,
+            size.z - 1);
+    z = first;
+    rowsTotal = last > first
+        ? (last - first + 1) * size.y + (last - first) * (size.y - 1)
+        : 0;
+}
+
+bool MarchingCubesJob::advance(double budgetSeconds,
+        std::vector<glm::vec3> &vertexBufferData)
+{
+    if (stop || done())
+    {
+        return done();
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    do
+    {
+        if (sampling)
+        {
+            sampleRow();
+            if (++y == size.y)
+            {
+                // The first slice has no cubes below it to polygonize.
+                y = 0;
+                sampling = z == first;
+                z += sampling ? 1 : 0;
+            }
+        }
+        else
+        {
+            polygonizeRow(vertexBufferData);
+            if (++y == size.y - 1)
+            {
+                y = 0;
+                sampling = true;
+                z++;
+            }
+        }
+        rowsDone++;
+    } while (!stop && !done() && std::chrono::duration<double>(
+                std::chrono::steady_clock::now() - start).count()
+            < budgetSeconds);
+    return done();
+}
+
+void MarchingCubesJob::cancel()
+{
+    stop = true;
+}
+
+bool MarchingCubesJob::done() const
+{
+    return rowsDone == rowsTotal;
+}
+
+bool MarchingCubesJob::cancelled() const
+{
+    return stop && !done();
+}
+
+float MarchingCubesJob::progress() const
+{
+    return rowsTotal > 0 ? (float)rowsDone / rowsTotal : 1.0f;
+}
+
+void MarchingCubesJob::sampleRow()
+{
+    for (int x = 0; x < size.x; x++)
+    {
+        points[x] = slab.position(x, y, z);
+    }
+    sdf->distances(points.data(), &slab.values[slab.index(0, y, z % 2)],
+            size.x);
+}
+
+/*
+ * Polygonizes the row of cubes between sample slices z - 1 and z.
+ */
+void MarchingCubesJob::polygonizeRow(
+        std::vector<glm::vec3> &vertexBufferData)
+{
+    std::array<glm::vec4, 8> corners;
+    for (int x = 0; x < size.x - 1; x++)
+    {
+        for (int n = 0; n < 8; n++)
+        {
+            glm::ivec3 c = glm::ivec3(x, y, z - 1) + cornerOffsets[n];
+            corners[n] = glm::vec4(slab.position(c.x, c.y, c.z),
+                    slab.values[slab.index(c.x, c.y, c.z % 2)]);
+        }
+        polygonize(sdf, corners, 0.0f, vertexBufferData);
+    }
+}
+
+float AsyncMesh::progress() const
+{
+    // Every job but the last has the same number of slabs, give or take one.
+    float sum = 0.0f;
+    for (const std::unique_ptr<MarchingCubesJob> &job : jobs)
+    {
+        sum += job->progress();
+    }
+    return jobs.empty() ? 1.0f : sum / jobs.size();
+}
+
+void AsyncMesh::cancel()
+{
+    stop = true;
+    for (const std::unique_ptr<MarchingCubesJob> &job : jobs)
+    {
+        job->cancel();
+    }
+}
+
+bool AsyncMesh::ready() const
+{
+    if (completing == this)
+    {
+        return true;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    return done;
+}
+
+bool AsyncMesh::cancelled() const
+{
+    return ready() && stop;
+}
+
+void AsyncMesh::wait() const
+{
+    if (completing == this)
+    {
+        return;
+    }
+    std::unique_lock<std::mutex> lock(mutex);
+    finished.wait(lock, [this]() { return done; });
+}
+
+const std::vector<glm::vec3> &AsyncMesh::get() const
+{
+    wait();
+    return vbd;
+}
+
+/*
+ * Called as each block stops. The last one joins the blocks in order and
+ * completes the mesh.
+ */
+void AsyncMesh::finishBlock()
+{
+    if (--remaining > 0)
+    {
+        return;
+    }
+
+    if (!stop)
+    {
+        size_t total = 0;
+        for (const std::vector<glm::vec3> &block : blocks)
+        {
+            total += block.size();
+        }
+        vbd.reserve(total);
+        for (std::vector<glm::vec3> &block : blocks)
+        {
+            vbd.insert(vbd.end(), block.begin(), block.end());
+            std::vector<glm::vec3>().swap(block);
+        }
+    }
+    blocks.clear();
+
+    // The callback runs first, so whatever it records is in place by the
+    // time anyone else sees the mesh ready.
+    if (callback)
+    {
+        completing = this;
+        callback(*this);
+        completing = nullptr;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        done = true;
+    }
+    finished.notify_all();
+}
+
+std::shared_ptr<AsyncMesh> marchingCubesAsync(SignedDistanceFunction* sdf,
+        glm::vec3 min, glm::vec3 max, int resolution,
+        CompletionCallback onComplete, ThreadPool &pool)
+{
+    std::shared_ptr<AsyncMesh> mesh(new AsyncMesh());
+    mesh->stop = false;
+    mesh->done = false;
+    mesh->callback = onComplete;
+
+    int slabs = resolution + 1;
+    int count = std::max(1, std::min(pool.size(), slabs));
+    for (int b = 0; b < count; b++)
+    {
+        int first = (int)((long long)slabs * b / count);
+        int last = (int)((long long)slabs * (b + 1) / count);
+        mesh->jobs.push_back(std::unique_ptr<MarchingCubesJob>(
+                new MarchingCubesJob(sdf, min, max, resolution, first, last)));
+    }
+    mesh->blocks.resize(count);
+    mesh->remaining = count;
+
+    // The tasks hold on to the handle, so the caller may drop it.
+    for (int b = 0; b < count; b++)
+    {
+        pool.submit([mesh, b]()
+        {
+            if (!mesh->stop)
+            {
+                mesh->jobs[b]->advance(std::numeric_limits<double>::max(),
+                        mesh->blocks[b]);
+            }
+            mesh->finishBlock();
+        });
+    }
+    return mesh;
+}
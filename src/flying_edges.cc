@@ -0,0 +1,328 @@
+#include "marching_cubes/flying_edges.h"
+#include "marching_cubes/parallel.h"
+
+#include <algorithm>
+#include <array>
+
+/*
+ * What the passes learn about one x row of the lattice. Its x edges only
+ * cross the surface in [first, last), and triangles counts the triangles of
+ * the cube row between it and its +y and +z neighbours.
+ */
+struct Row
+{
+    int first;
+    int last;
+    int xCrossings;
+    int yCrossings;
+    int zCrossings;
+    int triangles;
+    int xOffset;
+    int yOffset;
+    int zOffset;
+    int triangleOffset;
+};
+
+/*
+ * Each x edge's case: bit 0 is set when its lower sample is below the
+ * isolevel and bit 1 when its upper sample is.
+ */
+typedef unsigned char EdgeCase;
+
+static bool crosses(EdgeCase c)
+{
+    return c == 1 || c == 2;
+}
+
+/*
+ * Returns whether sample x of a row is below the isolevel.
+ */
+static bool below(const EdgeCase* cases, int x, int edges)
+{
+    return x < edges ? (cases[x] & 1) != 0 : (cases[edges - 1] & 2) != 0;
+}
+
+void flyingEdgesLattice(SignedDistanceFunction* sdf,
+        const SampleLattice &lattice, float isolevel,
+        std::vector<glm::vec3> &vertexBufferData,
+        std::vector<unsigned int> &indexBufferData)
+{
+    int nx = lattice.size.x;
+    int ny = lattice.size.y;
+    int nz = lattice.size.z;
+    if (nx < 2 || ny < 2 || nz < 2)
+    {
+        return;
+    }
+
+    int edges = nx - 1;
+    std::vector<Row> rows((size_t)ny * nz);
+    std::vector<EdgeCase> cases(rows.size() * edges);
+    auto row = [&](int y, int z) { return z * ny + y; };
+    auto rowCases = [&](int r) { return &cases[(size_t)r * edges]; };
+
+    // The samples of the given rows can only differ in [lo, hi]. Outside the
+    // rows' crossings each row keeps the sign of its first or last sample,
+    // so the range only reaches an end if the rows disagree there.
+    auto trim = [&](const int* rs, int count, int &lo, int &hi)
+    {
+        lo = edges;
+        hi = 0;
+        bool startBelow = below(rowCases(rs[0]), 0, edges);
+        bool endBelow = below(rowCases(rs[0]), edges, edges);
+        for (int i = 0; i < count; i++)
+        {
+            lo = std::min(lo, rows[rs[i]].first);
+            hi = std::max(hi, rows[rs[i]].last);
+            if (below(rowCases(rs[i]), 0, edges) != startBelow)
+            {
+                lo = 0;
+            }
+            if (below(rowCases(rs[i]), edges, edges) != endBelow)
+            {
+                hi = edges;
+            }
+        }
+    };
+
+    // Pass 1: classify the x edges of every row.
+    parallelFor(0, nz, [&](int z)
+    {
+        for (int y = 0; y < ny; y++)
+        {
+            Row &r = rows[row(y, z)];
+            EdgeCase* c = rowCases(row(y, z));
+            const float* values = &lattice.values[lattice.index(0, y, z)];
+            r.first = edges;
+            r.last = 0;
+            r.xCrossings = 0;
+            bool lower = values[0] < isolevel;
+            for (int x = 0; x < edges; x++)
+            {
+                bool upper = values[x + 1] < isolevel;
+                c[x] = (EdgeCase)((lower ? 1 : 0) | (upper ? 2 : 0));
+                if (lower != upper)
+                {
+                    r.xCrossings++;
+                    r.first = std::min(r.first, x);
+                    r.last = x + 1;
+                }
+                lower = upper;
+            }
+        }
+    });
+
+    std::array<int, 256> triangleCounts;
+    for (int i = 0; i < 256; i++)
+    {
+        triangleCounts[i] = 0;
+        while (triTable[i][3 * triangleCounts[i]] != -1)
+        {
+            triangleCounts[i]++;
+        }
+    }
+
+    // The case of cube x of a cube row, given the edge cases of its 4 x rows
+    // in the order (y, z), (y, z + 1), (y + 1, z), (y + 1, z + 1).
+    auto cubeCase = [&](const EdgeCase* const* c, int x)
+    {
+        return (c[0][x] & 1) | (c[1][x] & 1) << 1 | (c[1][x] & 2) << 1
+            | (c[0][x] & 2) << 2 | (c[2][x] & 1) << 4 | (c[3][x] & 1) << 5
+            | (c[3][x] & 2) << 5 | (c[2][x] & 2) << 6;
+    };
+
+    // Pass 2: count the y and z edge crossings of every row, and the
+    // triangles of the cubes between it and its +y and +z neighbours.
+    parallelFor(0, nz, [&](int z)
+    {
+        for (int y = 0; y < ny; y++)
+        {
+            Row &r = rows[row(y, z)];
+            r.yCrossings = 0;
+            r.zCrossings = 0;
+            r.triangles = 0;
+            const EdgeCase* c = rowCases(row(y, z));
+            int lo;
+            int hi;
+            if (y + 1 < ny)
+            {
+                int pair[2] = {row(y, z), row(y + 1, z)};
+                trim(pair, 2, lo, hi);
+                const EdgeCase* n = rowCases(pair[1]);
+                for (int x = lo; x <= hi; x++)
+                {
+                    r.yCrossings += below(c, x, edges) != below(n, x, edges);
+                }
+            }
+            if (z + 1 < nz)
+            {
+                int pair[2] = {row(y, z), row(y, z + 1)};
+                trim(pair, 2, lo, hi);
+                const EdgeCase* n = rowCases(pair[1]);
+                for (int x = lo; x <= hi; x++)
+                {
+                    r.zCrossings += below(c, x, edges) != below(n, x, edges);
+                }
+            }
+            if (y + 1 < ny && z + 1 < nz)
+            {
+                int quad[4] = {row(y, z), row(y, z + 1), row(y + 1, z),
+                    row(y + 1, z + 1)};
+                const EdgeCase* q[4] = {rowCases(quad[0]), rowCases(quad[1]),
+                    rowCases(quad[2]), rowCases(quad[3])};
+                trim(quad, 4, lo, hi);
+                for (int x = lo; x < hi; x++)
+                {
+                    r.triangles += triangleCounts[cubeCase(q, x)];
+                }
+            }
+        }
+    });
+
+    // Pass 3: lay the rows out one after another in the output, each with its
+    // x, then y, then z edge vertices.
+    size_t vertices = vertexBufferData.size() / 2;
+    size_t triangles = indexBufferData.size() / 3;
+    for (Row &r : rows)
+    {
+        r.xOffset = (int)vertices;
+        r.yOffset = r.xOffset + r.xCrossings;
+        r.zOffset = r.yOffset + r.yCrossings;
+        vertices = r.zOffset + r.zCrossings;
+        r.triangleOffset = (int)triangles;
+        triangles += r.triangles;
+    }
+    vertexBufferData.resize(vertices * 2);
+    indexBufferData.resize(triangles * 3);
+
+    auto store = [&](int index, glm::vec3 vertex)
+    {
+        vertexBufferData[2 * (size_t)index] = vertex;
+        vertexBufferData[2 * (size_t)index + 1] = vertexNormal(sdf, vertex);
+    };
+    auto corner = [&](int x, int y, int z)
+    {
+        return glm::vec4(lattice.position(x, y, z), lattice.value(x, y, z));
+    };
+
+    // Pass 4: interpolate the crossings of every row and write the triangles
+    // of every cube row. Walking a cube row, the next crossing on each of the
+    // rows around it is always the one it reached last, so a counter per row
+    // finds every edge's vertex.
+    parallelFor(0, nz, [&](int z)
+    {
+        for (int y = 0; y < ny; y++)
+        {
+            const Row &r = rows[row(y, z)];
+            const EdgeCase* c = rowCases(row(y, z));
+            int lo;
+            int hi;
+
+            int index = r.xOffset;
+            for (int x = r.first; x < r.last; x++)
+            {
+                if (crosses(c[x]))
+                {
+                    store(index++, interpolateVertex(corner(x, y, z),
+                                corner(x + 1, y, z), isolevel));
+                }
+            }
+            if (y + 1 < ny)
+            {
+                int pair[2] = {row(y, z), row(y + 1, z)};
+                trim(pair, 2, lo, hi);
+                const EdgeCase* n = rowCases(pair[1]);
+                for (int x = lo; x <= hi; x++)
+                {
+                    if (below(c, x, edges) != below(n, x, edges))
+                    {
+                        store(index++, interpolateVertex(corner(x, y, z),
+                                    corner(x, y + 1, z), isolevel));
+                    }
+                }
+            }
+            if (z + 1 < nz)
+            {
+                int pair[2] = {row(y, z), row(y, z + 1)};
+                trim(pair, 2, lo, hi);
+                const EdgeCase* n = rowCases(pair[1]);
+                for (int x = lo; x <= hi; x++)
+                {
+                    if (below(c, x, edges) != below(n, x, edges))
+                    {
+                        store(index++, interpolateVertex(corner(x, y, z),
+                                    corner(x, y, z + 1), isolevel));
+                    }
+                }
+            }
+
+            if (y + 1 == ny || z + 1 == nz || r.triangles == 0)
+            {
+                continue;
+            }
+
+            int quad[4] = {row(y, z), row(y, z + 1), row(y + 1, z),
+                row(y + 1, z + 1)};
+            const EdgeCase* q[4] = {rowCases(quad[0]), rowCases(quad[1]),
+                rowCases(quad[2]), rowCases(quad[3])};
+            trim(quad, 4, lo, hi);
+
+            // The next x crossing on each of the 4 rows, the next y crossing
+            // between rows (y, z) and (y, z + 1) and their +y neighbours, and
+            // the next z crossing between rows (y, z) and (y + 1, z) and their
+            // +z neighbours.
+            int xNext[4] = {rows[quad[0]].xOffset, rows[quad[1]].xOffset,
+                rows[quad[2]].xOffset, rows[quad[3]].xOffset};
+            int yNext[2] = {rows[quad[0]].yOffset, rows[quad[1]].yOffset};
+            int zNext[2] = {rows[quad[0]].zOffset, rows[quad[2]].zOffset};
+
+            unsigned int* out = &indexBufferData[3 * (size_t)r.triangleOffset];
+            for (int x = lo; x < hi; x++)
+            {
+                int cube = cubeCase(q, x);
+                int crossed = edgeTable[cube];
+
+                // The vertex of each of the cube's edges, following
+                // edgeCorners. Edges on the +x face are the crossing after
+                // the one on the -x face, if that one is crossed.
+                int edgeVertices[12];
+                edgeVertices[0] = zNext[0];
+                edgeVertices[1] = xNext[1];
+                edgeVertices[2] = zNext[0] + (crossed & 1);
+                edgeVertices[3] = xNext[0];
+                edgeVertices[4] = zNext[1];
+                edgeVertices[5] = xNext[3];
+                edgeVertices[6] = zNext[1] + (crossed >> 4 & 1);
+                edgeVertices[7] = xNext[2];
+                edgeVertices[8] = yNext[0];
+                edgeVertices[9] = yNext[1];
+                edgeVertices[10] = yNext[1] + (crossed >> 9 & 1);
+                edgeVertices[11] = yNext[0] + (crossed >> 8 & 1);
+
+                for (int i = 0; triTable[cube][i] != -1; i++)
+                {
+                    *out++ = edgeVertices[triTable[cube][i]];
+                }
+
+                xNext[0] += crossed >> 3 & 1;
+                xNext[1] += crossed >> 1 & 1;
+                xNext[2] += crossed >> 7 & 1;
+                xNext[3] += crossed >> 5 & 1;
+                yNext[0] += crossed >> 8 & 1;
+                yNext[1] += crossed >> 9 & 1;
+                zNext[0] += crossed & 1;
+                zNext[1] += crossed >> 4 & 1;
+            }
+        }
+    });
+}
+
+void flyingEdges(SignedDistanceFunction* sdf, glm::vec3 min, glm::vec3 max,
+        int resolution, std::vector<glm::vec3> &vertexBufferData,
+        std::vector<unsigned int> &indexBufferData)
+{
+    SampleLattice lattice = marchingCubesLattice(min, max, resolution);
+    sampleLattice(sdf, lattice);
+    flyingEdgesLattice(sdf, lattice, 0.0f, vertexBufferData,
+            indexBufferData);
+}
@@ -0,0 +1,134 @@
+#include "marching_cubes/frustum_culling.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+Frustum extractFrustum(const glm::mat4 &viewProjection)
+{
+    // GLM matrices are column-major, so row i is m[0][i], m[1][i], ...
+    glm::mat4 m = glm::transpose(viewProjection);
+    Frustum frustum;
+    frustum.planes[0] = m[3] + m[0];
+    frustum.planes[1] = m[3] - m[0];
+    frustum.planes[2] = m[3] + m[1];
+    frustum.planes[3] = m[3] - m[1];
+    frustum.planes[4] = m[3] + m[2];
+    frustum.planes[5] = m[3] - m[2];
+    for (glm::vec4 &plane : frustum.planes)
+    {
+        plane /= glm::length(glm::vec3(plane));
+    }
+    return frustum;
+}
+
+void BoxList::add(glm::vec3 min, glm::vec3 max)
+{
+    minX.push_back(min.x);
+    minY.push_back(min.y);
+    minZ.push_back(min.z);
+    maxX.push_back(max.x);
+    maxY.push_back(max.y);
+    maxZ.push_back(max.z);
+}
+
+void BoxList::set(size_t i, glm::vec3 min, glm::vec3 max)
+{
+    minX[i] = min.x;
+    minY[i] = min.y;
+    minZ[i] = min.z;
+    maxX[i] = max.x;
+    maxY[i] = max.y;
+    maxZ[i] = max.z;
+}
+
+void BoxList::clear()
+{
+    minX.clear();
+    minY.clear();
+    minZ.clear();
+    maxX.clear();
+    maxY.clear();
+    maxZ.clear();
+}
+
+size_t BoxList::size() const
+{
+    return minX.size();
+}
+
+size_t cullBoxes(const Frustum &frustum, const BoxList &boxes,
+        std::vector<unsigned char> &visible)
+{
+    size_t count = boxes.size();
+    visible.resize(count);
+
+    // The corner furthest along each plane's normal takes the maximum on the
+    // axes where the normal is positive. Picking the arrays once per plane
+    // leaves a single multiply-add per axis in the loops.
+    const float* x[6];
+    const float* y[6];
+    const float* z[6];
+    for (int p = 0; p < 6; p++)
+    {
+        const glm::vec4 &plane = frustum.planes[p];
+        x[p] = plane.x > 0.0f ? boxes.maxX.data() : boxes.minX.data();
+        y[p] = plane.y > 0.0f ? boxes.maxY.data() : boxes.minY.data();
+        z[p] = plane.z > 0.0f ? boxes.maxZ.data() : boxes.minZ.data();
+    }
+
+    size_t i = 0;
+    size_t visibleCount = 0;
+
+#if defined(__SSE2__)
+    __m128 a[6];
+    __m128 b[6];
+    __m128 c[6];
+    __m128 d[6];
+    for (int p = 0; p < 6; p++)
+    {
+        a[p] = _mm_set1_ps(frustum.planes[p].x);
+        b[p] = _mm_set1_ps(frustum.planes[p].y);
+        c[p] = _mm_set1_ps(frustum.planes[p].z);
+        d[p] = _mm_set1_ps(frustum.planes[p].w);
+    }
+    const __m128 zero = _mm_setzero_ps();
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 outside = zero;
+        for (int p = 0; p < 6; p++)
+        {
+            __m128 distance = _mm_add_ps(_mm_add_ps(
+                    _mm_mul_ps(a[p], _mm_loadu_ps(x[p] + i)),
+                    _mm_mul_ps(b[p], _mm_loadu_ps(y[p] + i))),
+                    _mm_add_ps(_mm_mul_ps(c[p], _mm_loadu_ps(z[p] + i)),
+                    d[p]));
+            outside = _mm_or_ps(outside, _mm_cmplt_ps(distance, zero));
+        }
+        int mask = _mm_movemask_ps(outside);
+        for (int lane = 0; lane < 4; lane++)
+        {
+            unsigned char inside = (mask & (1 << lane)) == 0;
+            visible[i + lane] = inside;
+            visibleCount += inside;
+        }
+    }
+#endif
+
+    for (; i < count; i++)
+    {
+        unsigned char inside = 1;
+        for (int p = 0; p < 6 && inside; p++)
+        {
+            const glm::vec4 &plane = frustum.planes[p];
+            if (plane.x * x[p][i] + plane.y * y[p][i] + plane.z * z[p][i]
+                    + plane.w < 0.0f)
+            {
+                inside = 0;
+            }
+        }
+        visible[i] = inside;
+        visibleCount += inside;
+    }
+    return visibleCount;
+}
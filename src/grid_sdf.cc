@@ -0,0 +1,169 @@
+#include "marching_cubes/grid_sdf.h"
+#include "marching_cubes/parallel.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+// The error statistics are gathered on a sub-grid of at most this many cells
+// per axis so that measuring them never costs more than a small bake.
+const int ERROR_GRID_SIZE = 16;
+
+// Each axis of the baked box is at least this long, so a flat or inverted
+// box still has a nonzero step to divide by.
+const float MIN_EXTENT = 1e-4f;
+
+GridSDF::GridSDF(SignedDistanceFunction* sdf, glm::vec3 min, glm::vec3 max,
+        int resolution, Interpolation interpolation)
+    : lo(min), hi(glm::max(max, min + MIN_EXTENT)),
+      n(std::max(resolution, 1)), mode(interpolation)
+{
+    step = (hi - lo) / (float)n;
+    int size = n + 1;
+    values.resize((size_t)size * size * size);
+
+    auto start = std::chrono::steady_clock::now();
+
+    // Each z-slice is written by exactly one thread, a row at a time so SDFs
+    // with a vectorized distances() kernel get to use it.
+    parallelFor(0, size, [&](int z)
+    {
+        std::vector<glm::vec3> points(size);
+        for (int y = 0; y < size; y++)
+        {
+            for (int x = 0; x < size; x++)
+            {
+                points[x] = lo + step * glm::vec3(x, y, z);
+            }
+            sdf->distances(points.data(),
+                    &values[((size_t)z * size + y) * size], size);
+        }
+    });
+
+    auto end = std::chrono::steady_clock::now();
+    bakeStats.bakeSeconds = std::chrono::duration<double>(end - start).count();
+    bakeStats.samples = (size_t)size * size * size;
+
+    // Compare against the source SDF at the centers of a regular subset of
+    // cells.
+    int stride = std::max(1, n / ERROR_GRID_SIZE);
+    int count = (n + stride - 1) / stride;
+    std::vector<float> sliceMax(count, 0.0f);
+    std::vector<double> sliceSum(count, 0.0);
+    parallelFor(0, count, [&](int k)
+    {
+        for (int j = 0; j < count; j++)
+        {
+            for (int i = 0; i < count; i++)
+            {
+                glm::vec3 p = lo + step * (glm::vec3(i, j, k) * (float)stride
+                        + 0.5f);
+                float error = std::abs(distance(p) - sdf->distance(p));
+                sliceMax[k] = std::max(sliceMax[k], error);
+                sliceSum[k] += error;
+            }
+        }
+    });
+
+    bakeStats.errorSamples = count * count * count;
+    bakeStats.maxError = *std::max_element(sliceMax.begin(), sliceMax.end());
+    double sum = 0.0;
+    for (double s : sliceSum)
+    {
+        sum += s;
+    }
+    bakeStats.meanError = (float)(sum / bakeStats.errorSamples);
+}
+
+float GridSDF::distance(glm::vec3 p)
+{
+    glm::vec3 q = glm::clamp(p, lo, hi);
+    glm::vec3 cell = (q - lo) / step;
+
+    float d = mode == TRICUBIC ? tricubic(cell) : trilinear(cell);
+    if (q != p)
+    {
+        d += glm::length(p - q);
+    }
+    return d;
+}
+
+void GridSDF::setInterpolation(Interpolation interpolation)
+{
+    mode = interpolation;
+}
+
+GridSDF::Interpolation GridSDF::interpolation() const
+{
+    return mode;
+}
+
+const GridSDFStats &GridSDF::stats() const
+{
+    return bakeStats;
+}
+
+float GridSDF::sample(int x, int y, int z) const
+{
+    int size = n + 1;
+    x = std::min(std::max(x, 0), n);
+    y = std::min(std::max(y, 0), n);
+    z = std::min(std::max(z, 0), n);
+    return values[((size_t)z * size + y) * size + x];
+}
+
+float GridSDF::trilinear(glm::vec3 cell) const
+{
+    glm::ivec3 i = glm::min(glm::ivec3(glm::floor(cell)), glm::ivec3(n - 1));
+    glm::vec3 f = cell - glm::vec3(i);
+
+    // The two samples along x are adjacent in memory.
+    float c00 = glm::mix(sample(i.x, i.y, i.z), sample(i.x + 1, i.y, i.z), f.x);
+    float c10 = glm::mix(sample(i.x, i.y + 1, i.z),
+            sample(i.x + 1, i.y + 1, i.z), f.x);
+    float c01 = glm::mix(sample(i.x, i.y, i.z + 1),
+            sample(i.x + 1, i.y, i.z + 1), f.x);
+    float c11 = glm::mix(sample(i.x, i.y + 1, i.z + 1),
+            sample(i.x + 1, i.y + 1, i.z + 1), f.x);
+    return glm::mix(glm::mix(c00, c10, f.y), glm::mix(c01, c11, f.y), f.z);
+}
+
+/*
+ * Returns the Catmull-Rom weights for the four samples surrounding t.
+ */
+static glm::vec4 catmullRomWeights(float t)
+{
+    float t2 = t * t;
+    float t3 = t2 * t;
+    return 0.5f * glm::vec4(
+            -t + 2.0f * t2 - t3,
+            2.0f - 5.0f * t2 + 3.0f * t3,
+            t + 4.0f * t2 - 3.0f * t3,
+            -t2 + t3);
+}
+
+float GridSDF::tricubic(glm::vec3 cell) const
+{
+    glm::ivec3 i = glm::min(glm::ivec3(glm::floor(cell)), glm::ivec3(n - 1));
+    glm::vec3 f = cell - glm::vec3(i);
+    glm::vec4 wx = catmullRomWeights(f.x);
+    glm::vec4 wy = catmullRomWeights(f.y);
+    glm::vec4 wz = catmullRomWeights(f.z);
+
+    float result = 0.0f;
+    for (int z = 0; z < 4; z++)
+    {
+        float plane = 0.0f;
+        for (int y = 0; y < 4; y++)
+        {
+            float row = 0.0f;
+            for (int x = 0; x < 4; x++)
+            {
+                row += wx[x] * sample(i.x + x - 1, i.y + y - 1, i.z + z - 1);
+            }
+            plane += wy[y] * row;
+        }
+        result += wz[z] * plane;
+    }
+    return result;
+}
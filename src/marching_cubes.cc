@@ -1,6 +1,7 @@
 #include "marching_cubes/marching_cubes.h"
+#include "marching_cubes/parallel.h"
 
-#include <array>
+#include <utility>
 
 // Lookup tables taken from http://paulbourke.net/geometry/polygonise/.
 const std::array<int, 256> edgeTable = {
@@ -295,6 +296,41 @@ const std::array<std::array<int, 16>, 256> triTable = {{
 	{ 0,  3,  8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
 	{-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1}}};
 
+// The pair of corners joined by each of the 12 edges of a cube.
+const std::array<std::array<int, 2>, 12> edgeCorners = {{
+	{0, 1}, {1, 2}, {2, 3}, {3, 0},
+	{4, 5}, {5, 6}, {6, 7}, {7, 4},
+	{0, 4}, {1, 5}, {2, 6}, {3, 7}}};
+
+const std::array<glm::ivec3, 8> cornerOffsets = {{
+	glm::ivec3(0, 0, 0), glm::ivec3(0, 0, 1),
+	glm::ivec3(1, 0, 1), glm::ivec3(1, 0, 0),
+	glm::ivec3(0, 1, 0), glm::ivec3(0, 1, 1),
+	glm::ivec3(1, 1, 1), glm::ivec3(1, 1, 0)}};
+
+SampleLattice::SampleLattice()
+    : origin(0.0f), step(1.0f), size(0), offset(0) {}
+
+SampleLattice::SampleLattice(glm::vec3 origin, glm::vec3 step,
+        glm::ivec3 size, glm::ivec3 offset)
+    : origin(origin), step(step), size(size), offset(offset),
+      values((size_t)size.x * size.y * size.z, 0.0f) {}
+
+int SampleLattice::index(int x, int y, int z) const
+{
+    return (z * size.y + y) * size.x + x;
+}
+
+glm::vec3 SampleLattice::position(int x, int y, int z) const
+{
+    return origin + step * glm::vec3(offset + glm::ivec3(x, y, z));
+}
+
+float SampleLattice::value(int x, int y, int z) const
+{
+    return values[index(x, y, z)];
+}
+
 glm::vec3 interpolateVertex(glm::vec4 corner1, glm::vec4 corner2,
         float isolevel)
 {
@@ -320,17 +356,75 @@ glm::vec3 interpolateVertex(glm::vec4 corner1, glm::vec4 corner2,
 
 glm::vec3 vertexNormal(SignedDistanceFunction* sdf, glm::vec3 vertex)
 {
-	const float h = 0.0001;
-	return glm::normalize(
-		glm::vec3(1.0f, -1.0f, -1.0f)
-            * sdf->distance(vertex + glm::vec3( 1.0f, -1.0f, -1.0f) * h) +
-        glm::vec3(-1.0f, -1.0f, 1.0f)
-            * sdf->distance(vertex + glm::vec3(-1.0f, -1.0f,  1.0f) * h) +
-		glm::vec3(-1.0f, 1.0f, -1.0f)
-            * sdf->distance(vertex + glm::vec3(-1.0f,  1.0f, -1.0f) * h) +
-		glm::vec3(1.0f, 1.0f, 1.0f)
-            * sdf->distance(vertex + glm::vec3( 1.0f,  1.0f,  1.0f) * h)
-	);
+	return glm::normalize(sdf->gradient(vertex));
+}
+
+/*
+ * Finds the case of a cube and the vertex on each edge the surface crosses.
+ * Returns the case, which has no triangles when it is 0 or 255.
+ */
+static int cubeVertices(const std::array<glm::vec4, 8> &corners,
+        float isolevel, std::array<glm::vec3, 12> &vertices)
+{
+	// Calculates the index into the edgeTable and triTable based on which
+    // corners are below our isolevel.
+	int cubeIndex = 0;
+	for (int i = 0; i < 8; i++)
+	{
+		if (corners[i].w < isolevel)
+		{
+			cubeIndex |= 1 << i;
+		}
+	}
+
+	// Generate the vertices for this cube from its index. Each edge is
+    // interpolated from its corner nearest the lattice origin, so that the
+    // cubes sharing an edge place its vertex at exactly the same point.
+	for (int i = 0; i < 12; i++)
+	{
+		if ((edgeTable[cubeIndex] & (1 << i)) != 0)
+		{
+			int a = edgeCorners[i][0];
+			int b = edgeCorners[i][1];
+			if (glm::any(glm::lessThan(cornerOffsets[b], cornerOffsets[a])))
+			{
+				std::swap(a, b);
+			}
+			vertices[i] = interpolateVertex(corners[a], corners[b],
+                    isolevel);
+		}
+	}
+	return cubeIndex;
+}
+
+void polygonize(SignedDistanceFunction* sdf,
+        const std::array<glm::vec4, 8> &corners, float isolevel,
+        std::vector<glm::vec3> &vertexBufferData)
+{
+	std::array<glm::vec3, 12> vertices;
+	int cubeIndex = cubeVertices(corners, isolevel, vertices);
+
+	// Store the vertices and their normals for rendering with OpenGL.
+	for (int i = 0; triTable[cubeIndex][i] != -1; i += 3)
+	{
+		vertexBufferData.push_back(vertices[triTable[cubeIndex][i]]);
+		vertexBufferData.push_back(vertexNormal(sdf, vertexBufferData.back()));
+		vertexBufferData.push_back(vertices[triTable[cubeIndex][i + 1]]);
+		vertexBufferData.push_back(vertexNormal(sdf, vertexBufferData.back()));
+		vertexBufferData.push_back(vertices[triTable[cubeIndex][i + 2]]);
+		vertexBufferData.push_back(vertexNormal(sdf, vertexBufferData.back()));
+	}
+}
+
+void polygonizePositions(const std::array<glm::vec4, 8> &corners,
+        float isolevel, std::vector<glm::vec3> &vertexBufferData)
+{
+	std::array<glm::vec3, 12> vertices;
+	int cubeIndex = cubeVertices(corners, isolevel, vertices);
+	for (int i = 0; triTable[cubeIndex][i] != -1; i++)
+	{
+		vertexBufferData.push_back(vertices[triTable[cubeIndex][i]]);
+	}
 }
 
 void polygonize(SignedDistanceFunction* sdf, glm::vec3 center,
@@ -356,98 +450,117 @@ void polygonize(SignedDistanceFunction* sdf, glm::vec3 center,
 		}
 	}
 
-	// Calculates the index into the edgeTable and triTable based on which
-    // corners are below our isolevel.
-	int cubeIndex = 0;
-	for (int i = 0; i < 8; i++)
+	polygonize(sdf, corners, isolevel, vertexBufferData);
+}
+
+void sampleLattice(SignedDistanceFunction* sdf, SampleLattice &lattice)
+{
+	parallelFor(0, lattice.size.z, [&](int z)
 	{
-		if (corners[i].w < isolevel)
+		std::vector<glm::vec3> points(lattice.size.x);
+		for (int y = 0; y < lattice.size.y; y++)
 		{
-			cubeIndex |= 1 << i;
+			for (int x = 0; x < lattice.size.x; x++)
+			{
+				points[x] = lattice.position(x, y, z);
+			}
+			sdf->distances(points.data(),
+                    &lattice.values[lattice.index(0, y, z)], lattice.size.x);
 		}
-	}
+	});
+}
 
-	// Generate the vertices for this cube from its index.
-	std::array<glm::vec3, 12> vertices;
-	if ((edgeTable[cubeIndex] & (1 << 0)) != 0)
-	{
-		vertices[0] = interpolateVertex(corners[0], corners[1], isolevel);
-	}
-	if ((edgeTable[cubeIndex] && (bool)(1 << 1)) != 0)
-	{
-		vertices[1] = interpolateVertex(corners[1], corners[2], isolevel);
-	}
-	if ((edgeTable[cubeIndex] && (bool)(1 << 2)) != 0)
-	{
-		vertices[2] = interpolateVertex(corners[2], corners[3], isolevel);
-	}
-	if ((edgeTable[cubeIndex] && (bool)(1 << 3)) != 0)
-	{
-		vertices[3] = interpolateVertex(corners[3], corners[0], isolevel);
-	}
-	if ((edgeTable[cubeIndex] && (bool)(1 << 4)) != 0)
-	{
-		vertices[4] = interpolateVertex(corners[4], corners[5], isolevel);
-	}
-	if ((edgeTable[cubeIndex] && (bool)(1 << 5)) != 0)
-	{
-		vertices[5] = interpolateVertex(corners[5], corners[6], isolevel);
-	}
-	if ((edgeTable[cubeIndex] && (bool)(1 << 6)) != 0)
-	{
-		vertices[6] = interpolateVertex(corners[6], corners[7], isolevel);
-	}
-	if ((edgeTable[cubeIndex] && (bool)(1 << 7)) != 0)
-	{
-		vertices[7] = interpolateVertex(corners[7], corners[4], isolevel);
-	}
-	if ((edgeTable[cubeIndex] && (bool)(1 << 8)) != 0)
+/*
+ * Polygonizes every cube of a lattice, with normals from the SDF unless sdf
+ * is null.
+ */
+static void polygonizeCubes(SignedDistanceFunction* sdf,
+        const SampleLattice &lattice, float isolevel,
+        std::vector<glm::vec3> &vertexBufferData)
+{
+	glm::ivec3 cells = lattice.size - 1;
+	if (cells.x <= 0 || cells.y <= 0 || cells.z <= 0)
 	{
-		vertices[8] = interpolateVertex(corners[0], corners[4], isolevel);
+		return;
 	}
-	if ((edgeTable[cubeIndex] && (bool)(1 << 9)) != 0)
+
+	// Each slice of cubes fills its own buffer so the slices can be
+    // polygonized in parallel and still be stored in a deterministic order.
+	std::vector<std::vector<glm::vec3>> slices(cells.z);
+	parallelFor(0, cells.z, [&](int z)
 	{
-		vertices[9] = interpolateVertex(corners[1], corners[5], isolevel);
-	}
-	if ((edgeTable[cubeIndex] && (bool)(1 << 10)) != 0)
+		std::array<glm::vec4, 8> corners;
+		for (int y = 0; y < cells.y; y++)
+		{
+			for (int x = 0; x < cells.x; x++)
+			{
+				for (int n = 0; n < 8; n++)
+				{
+					glm::ivec3 c = glm::ivec3(x, y, z) + cornerOffsets[n];
+					corners[n] = glm::vec4(lattice.position(c.x, c.y, c.z),
+                            lattice.value(c.x, c.y, c.z));
+				}
+				if (sdf)
+				{
+					polygonize(sdf, corners, isolevel, slices[z]);
+				}
+				else
+				{
+					polygonizePositions(corners, isolevel, slices[z]);
+				}
+			}
+		}
+	});
+
+	size_t total = vertexBufferData.size();
+	for (const std::vector<glm::vec3> &slice : slices)
 	{
-		vertices[10] = interpolateVertex(corners[2], corners[6], isolevel);
+		total += slice.size();
 	}
-	if ((edgeTable[cubeIndex] && (bool)(1 << 11)) != 0)
+	vertexBufferData.reserve(total);
+	for (const std::vector<glm::vec3> &slice : slices)
 	{
-		vertices[11] = interpolateVertex(corners[3], corners[7], isolevel);
+		vertexBufferData.insert(vertexBufferData.end(), slice.begin(),
+                slice.end());
 	}
+}
 
-	// Store the vertices and their normals for rendering with OpenGL.
-	for (int i = 0; triTable[cubeIndex][i] != -1; i += 3)
-	{
-		vertexBufferData.push_back(vertices[triTable[cubeIndex][i]]);
-		vertexBufferData.push_back(vertexNormal(sdf, vertexBufferData.back()));
-		vertexBufferData.push_back(vertices[triTable[cubeIndex][i + 1]]);
-		vertexBufferData.push_back(vertexNormal(sdf, vertexBufferData.back()));
-		vertexBufferData.push_back(vertices[triTable[cubeIndex][i + 2]]);
-		vertexBufferData.push_back(vertexNormal(sdf, vertexBufferData.back()));
-	}
+void polygonizeLattice(SignedDistanceFunction* sdf,
+        const SampleLattice &lattice, float isolevel,
+        std::vector<glm::vec3> &vertexBufferData)
+{
+	polygonizeCubes(sdf, lattice, isolevel, vertexBufferData);
 }
 
-void marchingCubes(SignedDistanceFunction* sdf, glm::vec3 min, glm::vec3 max,
-        int resolution, std::vector<glm::vec3> &vertexBufferData)
+void polygonizeLatticePositions(const SampleLattice &lattice, float isolevel,
+        std::vector<glm::vec3> &vertexBufferData)
+{
+	polygonizeCubes(nullptr, lattice, isolevel, vertexBufferData);
+}
+
+SampleLattice marchingCubesLattice(glm::vec3 min, glm::vec3 max,
+        int resolution)
 {
 	glm::vec3 step = (max - min) / (float)resolution;
-	glm::vec3 radius = step * 0.5f;
 
-	for (int i = 0; i <= resolution; i++)
-	{
-		for (int j = 0; j <= resolution; j++)
-		{
-			for (int k = 0; k <= resolution; k++)
-			{
-				glm::vec3 center = glm::vec3(min.x + step.x * i,
-                                             min.y + step.y * j,
-                                             min.z + step.z * k);
-				polygonize(sdf, center, radius, 0.0f, vertexBufferData);
-			}
-		}
-	}
+	// Cubes are centered on the points min + step * (i, j, k) for i, j and k
+    // in [0, resolution], so their corners are offset by half a step.
+	return SampleLattice(min - step * 0.5f, step, glm::ivec3(resolution + 2));
 }
 
+void marchingCubes(SignedDistanceFunction* sdf, glm::vec3 min, glm::vec3 max,
+        int resolution, std::vector<glm::vec3> &vertexBufferData)
+{
+	SampleLattice lattice = marchingCubesLattice(min, max, resolution);
+	sampleLattice(sdf, lattice);
+	polygonizeLattice(sdf, lattice, 0.0f, vertexBufferData);
+}
+
+void marchingCubesPositions(SignedDistanceFunction* sdf, glm::vec3 min,
+        glm::vec3 max, int resolution,
+        std::vector<glm::vec3> &vertexBufferData)
+{
+	SampleLattice lattice = marchingCubesLattice(min, max, resolution);
+	sampleLattice(sdf, lattice);
+	polygonizeLatticePositions(lattice, 0.0f, vertexBufferData);
+}
@@ -1,6 +1,9 @@
 #version 330 core
 
 // Calculates Phong lighting based on passed-in vertex and normal data.
+// With flatShading on, the normal data is ignored and each triangle is lit
+// with its face normal, found from the screen-space derivatives of position,
+// so meshes can be drawn without normals.
 
 in vec3 position;
 in vec3 normal;
@@ -8,9 +11,15 @@ in vec3 normal;
 out vec4 color;
 
 uniform vec3 viewPos;
+uniform bool flatShading;
 
 void main()
 {
+	// The derivatives point along the screen's x and y axes, so their cross
+	// product faces the viewer.
+	vec3 n = flatShading
+		? normalize(cross(dFdx(position), dFdy(position))) : normal;
+
 	vec3 viewDir = normalize(viewPos - position);
 
 	vec3 lightPos = vec3(15.0, 10.0, 10.0);
@@ -20,14 +29,14 @@ void main()
 	float ambientStrength = 0.1;
 	vec3 ambient = ambientStrength * lightCol;
 
-	float diffuseStrength = max(dot(normal, lightDir), 0.0);
+	float diffuseStrength = max(dot(n, lightDir), 0.0);
 	vec3 diffuse = diffuseStrength * lightCol;
 
 	float specularStrength = 0.5;
-	vec3 reflectDir = reflect(-lightDir, normal);
+	vec3 reflectDir = reflect(-lightDir, n);
 	float spec = pow(max(dot(viewDir, reflectDir), 0.0), 32);
 	vec3 specular = specularStrength * spec * lightCol;
 
-	vec3 result = (ambient + diffuse + specular) * normal;
+	vec3 result = (ambient + diffuse + specular) * n;
 	color = vec4(result, 1.0);
 }
\ No newline at end of file
@@ -1,20 +1,41 @@
 #version 330 core
 
 //	A simple (mostly) pass-through vertex shader.
-//	Applies a model-view-projection matrix to each vertex.
+//	Applies a model-view-projection matrix to each vertex, after decoding
+//	packed vertices (see vertex_format.h). Float vertices are drawn with a
+//	positionMin of 0, a positionExtent of 1 and packedNormals off. Meshes
+//	without normals leave _normal at its default, for flat shading.
+//
+//	positionMin and positionExtent are attributes rather than uniforms so
+//	that a multi-draw can read each chunk's from an instanced array (see
+//	chunk_arena.h). Single meshes set them with glVertexAttrib3f.
 
 layout (location = 0) in vec3 _position;
 layout (location = 1) in vec3 _normal;
+layout (location = 2) in vec3 positionMin;
+layout (location = 3) in vec3 positionExtent;
 
 out vec3 position;
 out vec3 normal;
 
 uniform mat4 mvp;
+uniform bool packedNormals;
+
+vec3 octahedralDecode(vec2 e)
+{
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	if (n.z < 0.0)
+	{
+		vec2 signs = vec2(e.x >= 0.0 ? 1.0 : -1.0, e.y >= 0.0 ? 1.0 : -1.0);
+		n.xy = (1.0 - abs(e.yx)) * signs;
+	}
+	return normalize(n);
+}
 
 void main()
 {
-	gl_Position =  mvp * vec4(_position, 1.0);
+	position = positionMin + positionExtent * _position;
+	gl_Position =  mvp * vec4(position, 1.0);
 
-	position = _position;
-	normal = _normal;
+	normal = packedNormals ? octahedralDecode(_normal.xy) : _normal;
 };
\ No newline at end of file
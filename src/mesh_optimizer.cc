@@ -0,0 +1,434 @@
+#include "marching_cubes/mesh_optimizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+// The LRU cache optimizeVertexCache() simulates. The scores of the first
+// entries are flat, since the last triangle's vertices are reused anyway.
+const int SCORED_CACHE_SIZE = 32;
+const float CACHE_DECAY_POWER = 1.5f;
+const float LAST_TRIANGLE_SCORE = 0.75f;
+const float VALENCE_BOOST_SCALE = 2.0f;
+const float VALENCE_BOOST_POWER = 0.5f;
+
+// Above this many remaining triangles a vertex's valence boost is taken
+// from the last entry of the table.
+const int MAX_SCORED_VALENCE = 32;
+
+/*
+ * Per-vertex lists of the triangles using each vertex, stored back to back:
+ * the triangles of vertex v are triangles[offsets[v]] onwards, counts[v] of
+ * them.
+ */
+struct Adjacency
+{
+    std::vector<unsigned int> counts;
+    std::vector<unsigned int> offsets;
+    std::vector<unsigned int> triangles;
+};
+
+static void buildAdjacency(const std::vector<unsigned int> &indexBufferData,
+        size_t vertexCount, Adjacency &adjacency)
+{
+    adjacency.counts.assign(vertexCount, 0);
+    adjacency.offsets.assign(vertexCount, 0);
+    adjacency.triangles.resize(indexBufferData.size());
+    for (unsigned int index : indexBufferData)
+    {
+        adjacency.counts[index]++;
+    }
+
+    unsigned int offset = 0;
+    for (size_t v = 0; v < vertexCount; v++)
+    {
+        adjacency.offsets[v] = offset;
+        offset += adjacency.counts[v];
+    }
+
+    // Fill each list using its offset as a cursor, then rewind.
+    for (size_t i = 0; i < indexBufferData.size(); i++)
+    {
+        unsigned int v = indexBufferData[i];
+        adjacency.triangles[adjacency.offsets[v]++] = (unsigned int)(i / 3);
+    }
+    for (size_t v = 0; v < vertexCount; v++)
+    {
+        adjacency.offsets[v] -= adjacency.counts[v];
+    }
+}
+
+/*
+ * Forsyth's vertex score: high for vertices near the front of the cache,
+ * whose triangles are cheap to draw next, and for vertices with few
+ * triangles left, so none are left stranded. position is -1 for vertices
+ * outside the cache.
+ */
+static float vertexScore(int position, unsigned int remaining,
+        const float* cacheScores, const float* valenceScores)
+{
+    if (remaining == 0)
+    {
+        return -1.0f;
+    }
+    float score = position < 0 ? 0.0f : cacheScores[position];
+    return score + valenceScores[std::min(remaining,
+            (unsigned int)MAX_SCORED_VALENCE)];
+}
+
+VertexCacheStatistics analyzeVertexCache(
+        const std::vector<unsigned int> &indexBufferData, size_t vertexCount,
+        int cacheSize)
+{
+    VertexCacheStatistics statistics = {0.0f, 0.0f};
+    size_t triangles = indexBufferData.size() / 3;
+    if (triangles == 0)
+    {
+        return statistics;
+    }
+
+    // A vertex is in the FIFO cache if it was last loaded less than
+    // cacheSize loads ago.
+    std::vector<size_t> loadedAt(vertexCount, 0);
+    std::vector<bool> used(vertexCount, false);
+    size_t loads = 0;
+    size_t referenced = 0;
+    for (size_t i = 0; i < triangles * 3; i++)
+    {
+        unsigned int v = indexBufferData[i];
+        if (!used[v])
+        {
+            used[v] = true;
+            referenced++;
+        }
+        else if (loads - loadedAt[v] < (size_t)cacheSize)
+        {
+            continue;
+        }
+        loads++;
+        loadedAt[v] = loads;
+    }
+
+    statistics.acmr = (float)loads / triangles;
+    statistics.atvr = (float)loads / referenced;
+    return statistics;
+}
+
+void optimizeVertexCache(std::vector<unsigned int> &indexBufferData,
+        size_t vertexCount)
+{
+    size_t triangleCount = indexBufferData.size() / 3;
+    if (triangleCount == 0)
+    {
+        return;
+    }
+
+    float cacheScores[SCORED_CACHE_SIZE];
+    for (int i = 0; i < SCORED_CACHE_SIZE; i++)
+    {
+        cacheScores[i] = i < 3 ? LAST_TRIANGLE_SCORE
+            : std::pow(1.0f - (float)(i - 3) / (SCORED_CACHE_SIZE - 3),
+                    CACHE_DECAY_POWER);
+    }
+    float valenceScores[MAX_SCORED_VALENCE + 1];
+    valenceScores[0] = 0.0f;
+    for (int i = 1; i <= MAX_SCORED_VALENCE; i++)
+    {
+        valenceScores[i] = VALENCE_BOOST_SCALE
+            * std::pow((float)i, -VALENCE_BOOST_POWER);
+    }
+
+    Adjacency adjacency;
+    buildAdjacency(indexBufferData, vertexCount, adjacency);
+    std::vector<unsigned int> &remaining = adjacency.counts;
+
+    std::vector<float> scores(vertexCount);
+    for (size_t v = 0; v < vertexCount; v++)
+    {
+        scores[v] = vertexScore(-1, remaining[v], cacheScores,
+                valenceScores);
+    }
+
+    std::vector<bool> emitted(triangleCount, false);
+    std::vector<unsigned int> result;
+    result.reserve(triangleCount * 3);
+
+    // The cache holds up to 3 extra entries while a triangle is added.
+    std::vector<unsigned int> cache;
+    std::vector<unsigned int> newCache;
+    cache.reserve(SCORED_CACHE_SIZE + 3);
+    newCache.reserve(SCORED_CACHE_SIZE + 3);
+
+    // When no triangle in the cache is left, the next one is taken in input
+    // order rather than by searching every triangle, which keeps the whole
+    // pass linear; the input order of a sweep is coherent anyway.
+    size_t cursor = 0;
+    size_t best = 0;
+    while (true)
+    {
+        const unsigned int* tri = &indexBufferData[best * 3];
+        emitted[best] = true;
+        result.insert(result.end(), tri, tri + 3);
+
+        // Take the triangle off its vertices' lists, keeping the remaining
+        // triangles at the front of each list.
+        for (int k = 0; k < 3; k++)
+        {
+            unsigned int v = tri[k];
+            unsigned int* list = &adjacency.triangles[adjacency.offsets[v]];
+            for (unsigned int i = 0; i < remaining[v]; i++)
+            {
+                if (list[i] == best)
+                {
+                    std::swap(list[i], list[remaining[v] - 1]);
+                    break;
+                }
+            }
+            remaining[v]--;
+        }
+
+        newCache.clear();
+        for (int k = 0; k < 3; k++)
+        {
+            if (std::find(newCache.begin(), newCache.end(), tri[k])
+                    == newCache.end())
+            {
+                newCache.push_back(tri[k]);
+            }
+        }
+        for (unsigned int v : cache)
+        {
+            if (v != tri[0] && v != tri[1] && v != tri[2])
+            {
+                newCache.push_back(v);
+            }
+        }
+        for (size_t i = SCORED_CACHE_SIZE; i < newCache.size(); i++)
+        {
+            scores[newCache[i]] = vertexScore(-1, remaining[newCache[i]],
+                    cacheScores, valenceScores);
+        }
+        newCache.resize(std::min(newCache.size(),
+                    (size_t)SCORED_CACHE_SIZE));
+        cache.swap(newCache);
+
+        // Only the triangles of vertices in the cache changed score, and
+        // the best of them is the next triangle.
+        for (size_t i = 0; i < cache.size(); i++)
+        {
+            scores[cache[i]] = vertexScore((int)i, remaining[cache[i]],
+                    cacheScores, valenceScores);
+        }
+        float bestScore = -1.0f;
+        for (unsigned int v : cache)
+        {
+            const unsigned int* list
+                = &adjacency.triangles[adjacency.offsets[v]];
+            for (unsigned int i = 0; i < remaining[v]; i++)
+            {
+                const unsigned int* t = &indexBufferData[list[i] * 3];
+                float score = scores[t[0]] + scores[t[1]] + scores[t[2]];
+                if (score > bestScore)
+                {
+                    bestScore = score;
+                    best = list[i];
+                }
+            }
+        }
+
+        if (bestScore < 0.0f)
+        {
+            while (cursor < triangleCount && emitted[cursor])
+            {
+                cursor++;
+            }
+            if (cursor == triangleCount)
+            {
+                break;
+            }
+            best = cursor;
+        }
+    }
+
+    indexBufferData.swap(result);
+}
+
+/*
+ * Splits a run of triangles into clusters, returning the index of each
+ * cluster's first triangle. Hard boundaries are where the cache order
+ * restarts, all three vertices of a triangle missing a simulated FIFO cache;
+ * each hard cluster is then cut wherever its ACMR so far is within threshold
+ * of its overall ACMR.
+ */
+static std::vector<size_t> clusterBoundaries(
+        const std::vector<unsigned int> &indexBufferData, size_t vertexCount,
+        float threshold)
+{
+    const int cacheSize = 16;
+    size_t triangleCount = indexBufferData.size() / 3;
+    std::vector<size_t> loadedAt(vertexCount, 0);
+    size_t loads = 0;
+
+    // Returns the cache misses of triangle t; starting a new cluster flushes
+    // the cache by skipping ahead in time.
+    auto misses = [&](size_t t)
+    {
+        int count = 0;
+        for (int k = 0; k < 3; k++)
+        {
+            unsigned int v = indexBufferData[t * 3 + k];
+            if (loadedAt[v] == 0 || loads - loadedAt[v] >= (size_t)cacheSize)
+            {
+                loads++;
+                loadedAt[v] = loads;
+                count++;
+            }
+        }
+        return count;
+    };
+
+    std::vector<size_t> hard;
+    std::vector<int> triangleMisses(triangleCount);
+    for (size_t t = 0; t < triangleCount; t++)
+    {
+        triangleMisses[t] = misses(t);
+        if (t == 0 || triangleMisses[t] == 3)
+        {
+            hard.push_back(t);
+        }
+    }
+    hard.push_back(triangleCount);
+
+    std::vector<size_t> boundaries;
+    for (size_t c = 0; c + 1 < hard.size(); c++)
+    {
+        size_t begin = hard[c];
+        size_t end = hard[c + 1];
+        int clusterMisses = 0;
+        for (size_t t = begin; t < end; t++)
+        {
+            clusterMisses += triangleMisses[t];
+        }
+        float limit = threshold * clusterMisses / (float)(end - begin);
+
+        size_t start = begin;
+        int startMisses = 0;
+        loads += cacheSize + 1;
+        boundaries.push_back(begin);
+        for (size_t t = begin; t < end; t++)
+        {
+            startMisses += misses(t);
+            if (t + 1 < end
+                    && (float)startMisses / (t + 1 - start) <= limit)
+            {
+                boundaries.push_back(t + 1);
+                start = t + 1;
+                startMisses = 0;
+                loads += cacheSize + 1;
+            }
+        }
+    }
+    return boundaries;
+}
+
+void optimizeOverdraw(const std::vector<glm::vec3> &vertexBufferData,
+        std::vector<unsigned int> &indexBufferData, float threshold)
+{
+    size_t vertexCount = vertexBufferData.size() / 2;
+    size_t triangleCount = indexBufferData.size() / 3;
+    if (triangleCount == 0)
+    {
+        return;
+    }
+
+    std::vector<size_t> boundaries = clusterBoundaries(indexBufferData,
+            vertexCount, threshold);
+    size_t clusterCount = boundaries.size();
+    boundaries.push_back(triangleCount);
+
+    // The area-weighted centroid and normal of each cluster, and of the
+    // whole mesh.
+    std::vector<glm::vec3> centroids(clusterCount, glm::vec3(0.0f));
+    std::vector<glm::vec3> normals(clusterCount, glm::vec3(0.0f));
+    std::vector<float> areas(clusterCount, 0.0f);
+    glm::vec3 meshCentroid(0.0f);
+    float meshArea = 0.0f;
+    for (size_t c = 0; c < clusterCount; c++)
+    {
+        for (size_t t = boundaries[c]; t < boundaries[c + 1]; t++)
+        {
+            glm::vec3 a = vertexBufferData[2 * indexBufferData[t * 3]];
+            glm::vec3 b = vertexBufferData[2 * indexBufferData[t * 3 + 1]];
+            glm::vec3 d = vertexBufferData[2 * indexBufferData[t * 3 + 2]];
+
+            // Triangles are wound clockwise seen from outside.
+            glm::vec3 n = glm::cross(d - a, b - a);
+            float area = glm::length(n);
+            centroids[c] += (a + b + d) * (area / 3.0f);
+            normals[c] += n;
+            areas[c] += area;
+        }
+        meshCentroid += centroids[c];
+        meshArea += areas[c];
+    }
+    if (meshArea > 0.0f)
+    {
+        meshCentroid /= meshArea;
+    }
+
+    // Clusters that face away from the center the most are likely to be in
+    // front of the others from any direction.
+    std::vector<float> keys(clusterCount);
+    std::vector<size_t> order(clusterCount);
+    for (size_t c = 0; c < clusterCount; c++)
+    {
+        glm::vec3 centroid = areas[c] > 0.0f
+            ? centroids[c] / areas[c] : centroids[c];
+        float length = glm::length(normals[c]);
+        glm::vec3 normal = length > 0.0f ? normals[c] / length : normals[c];
+        keys[c] = glm::dot(centroid - meshCentroid, normal);
+        order[c] = c;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b)
+    {
+        return keys[a] > keys[b];
+    });
+
+    std::vector<unsigned int> result;
+    result.reserve(triangleCount * 3);
+    for (size_t c : order)
+    {
+        result.insert(result.end(),
+                indexBufferData.begin() + boundaries[c] * 3,
+                indexBufferData.begin() + boundaries[c + 1] * 3);
+    }
+    indexBufferData.swap(result);
+}
+
+void optimizeVertexFetch(std::vector<glm::vec3> &vertexBufferData,
+        std::vector<unsigned int> &indexBufferData)
+{
+    const unsigned int unused = std::numeric_limits<unsigned int>::max();
+    std::vector<unsigned int> remap(vertexBufferData.size() / 2, unused);
+    std::vector<glm::vec3> result;
+    result.reserve(vertexBufferData.size());
+    for (unsigned int &index : indexBufferData)
+    {
+        if (remap[index] == unused)
+        {
+            remap[index] = (unsigned int)(result.size() / 2);
+            result.push_back(vertexBufferData[2 * index]);
+            result.push_back(vertexBufferData[2 * index + 1]);
+        }
+        index = remap[index];
+    }
+    vertexBufferData.swap(result);
+}
+
+void optimizeMesh(std::vector<glm::vec3> &vertexBufferData,
+        std::vector<unsigned int> &indexBufferData)
+{
+    optimizeVertexCache(indexBufferData, vertexBufferData.size() / 2);
+    optimizeOverdraw(vertexBufferData, indexBufferData);
+    optimizeVertexFetch(vertexBufferData, indexBufferData);
+}
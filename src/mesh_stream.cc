@@ -0,0 +1,78 @@
+#include "marching_cubes/mesh_stream.h"
+
+#include <chrono>
+
+MeshStream::MeshStream(AnimatedSDF sdf, glm::vec3 min, glm::vec3 max,
+        int resolution, ThreadPool &pool)
+    : animation(sdf), min(min), max(max), res(resolution), pool(pool)
+{
+    front.time = 0.0f;
+    back.time = 0.0f;
+}
+
+MeshStream::~MeshStream()
+{
+    // The pool still refers to the back frame's SDF.
+    if (back.mesh)
+    {
+        back.mesh->cancel();
+        back.mesh->wait();
+    }
+}
+
+bool MeshStream::request(float time)
+{
+    if (back.mesh)
+    {
+        return false;
+    }
+
+    // The callback runs on the pool, so it gets its own copy of the start
+    // time and somewhere to leave the duration that outlives the frame.
+    std::shared_ptr<std::atomic<float>> milliseconds =
+        std::make_shared<std::atomic<float>>(0.0f);
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    back.sdf = animation(time);
+    back.milliseconds = milliseconds;
+    back.time = time;
+    back.mesh = marchingCubesAsync(back.sdf.get(), min, max, res,
+            [milliseconds, start](const AsyncMesh &)
+            {
+                *milliseconds = std::chrono::duration<float, std::milli>(
+                        std::chrono::steady_clock::now() - start).count();
+            }, pool);
+    return true;
+}
+
+bool MeshStream::swap()
+{
+    if (!back.mesh || !back.mesh->ready())
+    {
+        return false;
+    }
+    front = back;
+    back = Frame();
+    back.time = 0.0f;
+    return true;
+}
+
+const std::vector<glm::vec3> &MeshStream::current() const
+{
+    return front.mesh ? front.mesh->get() : empty;
+}
+
+float MeshStream::currentTime() const
+{
+    return front.time;
+}
+
+bool MeshStream::extracting() const
+{
+    return back.mesh != nullptr;
+}
+
+float MeshStream::extractionMilliseconds() const
+{
+    return front.milliseconds ? front.milliseconds->load() : 0.0f;
+}
@@ -0,0 +1,591 @@
+#include "marching_cubes/noise_sdf.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <random>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Gradients for Perlin and simplex noise: the 12 edge midpoints of a cube,
+// padded to 16 entries so a hash can be masked instead of reduced modulo 12.
+const float gradX[16] = {1, -1, 1, -1, 1, -1, 1, -1, 0, 0, 0, 0, 1, 0, -1, 0};
+const float gradY[16] = {1, 1, -1, -1, 0, 0, 0, 0, 1, -1, 1, -1, 1, -1, 1, -1};
+const float gradZ[16] = {0, 0, 0, 0, 1, 1, -1, -1, 1, 1, -1, -1, 0, 1, 0, -1};
+
+/*
+ * Returns the quintic fade curve 6t^5 - 15t^4 + 10t^3 and its derivative.
+ */
+static glm::vec3 fade(glm::vec3 t)
+{
+    return t * t * t * (t * (t * 6.0f - 15.0f) + 10.0f);
+}
+
+static glm::vec3 fadeDerivative(glm::vec3 t)
+{
+    return 30.0f * t * t * (t * (t - 2.0f) + 1.0f);
+}
+
+/*
+ * Trilinearly blends the values at the 8 corners of a cell, indexed by
+ * x + 2y + 4z, and writes the derivative with respect to u to derivative if
+ * it isn't null. cornerDerivatives holds the derivative of each corner value
+ * with respect to the sample position, or is null if they are all zero.
+ */
+static float blendCorners(const float* n, const glm::vec3* cornerDerivatives,
+        glm::vec3 u, glm::vec3 du, glm::vec3* derivative)
+{
+    float k0 = n[0];
+    float k1 = n[1] - n[0];
+    float k2 = n[2] - n[0];
+    float k3 = n[4] - n[0];
+    float k4 = n[0] - n[1] - n[2] + n[3];
+    float k5 = n[0] - n[2] - n[4] + n[6];
+    float k6 = n[0] - n[1] - n[4] + n[5];
+    float k7 = -n[0] + n[1] + n[2] - n[3] + n[4] - n[5] - n[6] + n[7];
+
+    if (derivative != nullptr)
+    {
+        *derivative = du * glm::vec3(
+                k1 + k4 * u.y + k6 * u.z + k7 * u.y * u.z,
+                k2 + k5 * u.z + k4 * u.x + k7 * u.z * u.x,
+                k3 + k6 * u.x + k5 * u.y + k7 * u.x * u.y);
+
+        if (cornerDerivatives != nullptr)
+        {
+            const glm::vec3* g = cornerDerivatives;
+            *derivative += g[0] + u.x * (g[1] - g[0]) + u.y * (g[2] - g[0])
+                + u.z * (g[4] - g[0])
+                + u.x * u.y * (g[0] - g[1] - g[2] + g[3])
+                + u.y * u.z * (g[0] - g[2] - g[4] + g[6])
+                + u.z * u.x * (g[0] - g[1] - g[4] + g[5])
+                + u.x * u.y * u.z
+                    * (-g[0] + g[1] + g[2] - g[3] + g[4] - g[5] - g[6] + g[7]);
+        }
+    }
+
+    return k0 + k1 * u.x + k2 * u.y + k3 * u.z + k4 * u.x * u.y
+        + k5 * u.y * u.z + k6 * u.z * u.x + k7 * u.x * u.y * u.z;
+}
+
+NoiseSDF::NoiseSDF(unsigned int seed, float frequency, float amplitude)
+    : freq(frequency), amp(amplitude)
+{
+    // A Fisher-Yates shuffle driven directly by the engine's output, so the
+    // same seed gives the same table with every standard library.
+    std::mt19937 engine(seed);
+    for (int i = 0; i < 256; i++)
+    {
+        perm[i] = (unsigned char)i;
+    }
+    for (int i = 255; i > 0; i--)
+    {
+        std::swap(perm[i], perm[engine() % (i + 1)]);
+    }
+    for (int i = 0; i < 256; i++)
+    {
+        perm[i + 256] = perm[i];
+    }
+}
+
+float NoiseSDF::distance(glm::vec3 p)
+{
+    return amp * noise(p * freq);
+}
+
+void NoiseSDF::distances(const glm::vec3* points, float* out, int count)
+{
+    noiseBatch(points, freq, out, count);
+    for (int i = 0; i < count; i++)
+    {
+        out[i] *= amp;
+    }
+}
+
+glm::vec3 NoiseSDF::gradient(glm::vec3 p)
+{
+    glm::vec3 derivative;
+    noise(p * freq, &derivative);
+    return derivative * (amp * freq);
+}
+
+void NoiseSDF::noiseBatch(const glm::vec3* points, float scale, float* out,
+        int count) const
+{
+    for (int i = 0; i < count; i++)
+    {
+        out[i] = noise(points[i] * scale);
+    }
+}
+
+int NoiseSDF::hash(int x, int y, int z) const
+{
+    return perm[perm[perm[x & 255] + (y & 255)] + (z & 255)];
+}
+
+/*
+ * Finds the hashes of the 8 corners of the cell with minimum corner (x, y, z),
+ * indexed by dx + 2dy + 4dz.
+ */
+static void cornerHashes(const std::array<unsigned char, 512> &perm, int x,
+        int y, int z, int* hashes)
+{
+    x &= 255;
+    y &= 255;
+    z &= 255;
+    int a = perm[x] + y;
+    int b = perm[x + 1] + y;
+    int aa = perm[a] + z;
+    int ab = perm[a + 1] + z;
+    int ba = perm[b] + z;
+    int bb = perm[b + 1] + z;
+    hashes[0] = perm[aa];
+    hashes[1] = perm[ba];
+    hashes[2] = perm[ab];
+    hashes[3] = perm[bb];
+    hashes[4] = perm[aa + 1];
+    hashes[5] = perm[ba + 1];
+    hashes[6] = perm[ab + 1];
+    hashes[7] = perm[bb + 1];
+}
+
+PerlinNoiseSDF::PerlinNoiseSDF(unsigned int seed, float frequency,
+        float amplitude)
+    : NoiseSDF(seed, frequency, amplitude) {}
+
+float PerlinNoiseSDF::noise(glm::vec3 p, glm::vec3* derivative) const
+{
+    glm::vec3 cell = glm::floor(p);
+    glm::vec3 f = p - cell;
+
+    int hashes[8];
+    cornerHashes(perm, (int)cell.x, (int)cell.y, (int)cell.z, hashes);
+
+    float n[8];
+    glm::vec3 g[8];
+    for (int c = 0; c < 8; c++)
+    {
+        int h = hashes[c] & 15;
+        g[c] = glm::vec3(gradX[h], gradY[h], gradZ[h]);
+        n[c] = glm::dot(g[c], f - glm::vec3(c & 1, (c >> 1) & 1, c >> 2));
+    }
+
+    return blendCorners(n, g, fade(f), fadeDerivative(f), derivative);
+}
+
+void PerlinNoiseSDF::noiseBatch(const glm::vec3* points, float scale,
+        float* out, int count) const
+{
+    int i = 0;
+
+#if defined(__SSE2__)
+    // Four points at a time: the floor, fade curves, dot products and blends
+    // run in SSE registers, and only the table lookups are done per lane.
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 s = _mm_set1_ps(scale);
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 p[3];
+        __m128 f[3];
+        __m128 u[3];
+        alignas(16) int cell[3][4];
+        for (int axis = 0; axis < 3; axis++)
+        {
+            p[axis] = _mm_mul_ps(s, _mm_set_ps(points[i + 3][axis],
+                    points[i + 2][axis], points[i + 1][axis],
+                    points[i][axis]));
+
+            // Truncation rounds towards zero, so negative inputs that aren't
+            // already integers need one subtracted to get their floor.
+            __m128 t = _mm_cvtepi32_ps(_mm_cvttps_epi32(p[axis]));
+            t = _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, p[axis]), one));
+            _mm_store_si128((__m128i*)cell[axis], _mm_cvttps_epi32(t));
+
+            f[axis] = _mm_sub_ps(p[axis], t);
+            __m128 ft = _mm_sub_ps(_mm_mul_ps(f[axis], _mm_set1_ps(6.0f)),
+                    _mm_set1_ps(15.0f));
+            ft = _mm_add_ps(_mm_mul_ps(f[axis], ft), _mm_set1_ps(10.0f));
+            u[axis] = _mm_mul_ps(_mm_mul_ps(f[axis], f[axis]),
+                    _mm_mul_ps(f[axis], ft));
+        }
+
+        alignas(16) float gx[8][4];
+        alignas(16) float gy[8][4];
+        alignas(16) float gz[8][4];
+        for (int lane = 0; lane < 4; lane++)
+        {
+            int hashes[8];
+            cornerHashes(perm, cell[0][lane], cell[1][lane], cell[2][lane],
+                    hashes);
+            for (int c = 0; c < 8; c++)
+            {
+                int h = hashes[c] & 15;
+                gx[c][lane] = gradX[h];
+                gy[c][lane] = gradY[h];
+                gz[c][lane] = gradZ[h];
+            }
+        }
+
+        __m128 n[8];
+        for (int c = 0; c < 8; c++)
+        {
+            __m128 dx = (c & 1) ? _mm_sub_ps(f[0], one) : f[0];
+            __m128 dy = (c & 2) ? _mm_sub_ps(f[1], one) : f[1];
+            __m128 dz = (c & 4) ? _mm_sub_ps(f[2], one) : f[2];
+            n[c] = _mm_add_ps(_mm_add_ps(
+                    _mm_mul_ps(_mm_load_ps(gx[c]), dx),
+                    _mm_mul_ps(_mm_load_ps(gy[c]), dy)),
+                    _mm_mul_ps(_mm_load_ps(gz[c]), dz));
+        }
+
+        for (int axis = 0, stride = 1; axis < 3; axis++, stride *= 2)
+        {
+            for (int c = 0; c < 8; c += 2 * stride)
+            {
+                n[c] = _mm_add_ps(n[c], _mm_mul_ps(u[axis],
+                        _mm_sub_ps(n[c + stride], n[c])));
+            }
+        }
+        _mm_storeu_ps(out + i, n[0]);
+    }
+#endif
+
+    for (; i < count; i++)
+    {
+        out[i] = noise(points[i] * scale);
+    }
+}
+
+SimplexNoiseSDF::SimplexNoiseSDF(unsigned int seed, float frequency,
+        float amplitude)
+    : NoiseSDF(seed, frequency, amplitude) {}
+
+float SimplexNoiseSDF::noise(glm::vec3 p, glm::vec3* derivative) const
+{
+    const float F3 = 1.0f / 3.0f;
+    const float G3 = 1.0f / 6.0f;
+
+    // Skew the input space to find which simplex cell the point is in.
+    glm::vec3 cell = glm::floor(p + (p.x + p.y + p.z) * F3);
+    glm::vec3 x0 = p - (cell - (cell.x + cell.y + cell.z) * G3);
+
+    // Find the second and third corners of the simplex by ranking the
+    // coordinates within the cell.
+    glm::vec3 offset1;
+    glm::vec3 offset2;
+    if (x0.x >= x0.y)
+    {
+        if (x0.y >= x0.z)
+        {
+            offset1 = glm::vec3(1, 0, 0);
+            offset2 = glm::vec3(1, 1, 0);
+        }
+        else if (x0.x >= x0.z)
+        {
+            offset1 = glm::vec3(1, 0, 0);
+            offset2 = glm::vec3(1, 0, 1);
+        }
+        else
+        {
+            offset1 = glm::vec3(0, 0, 1);
+            offset2 = glm::vec3(1, 0, 1);
+        }
+    }
+    else
+    {
+        if (x0.y < x0.z)
+        {
+            offset1 = glm::vec3(0, 0, 1);
+            offset2 = glm::vec3(0, 1, 1);
+        }
+        else if (x0.x < x0.z)
+        {
+            offset1 = glm::vec3(0, 1, 0);
+            offset2 = glm::vec3(0, 1, 1);
+        }
+        else
+        {
+            offset1 = glm::vec3(0, 1, 0);
+            offset2 = glm::vec3(1, 1, 0);
+        }
+    }
+
+    const glm::vec3 offsets[4] = {
+        glm::vec3(0.0f), offset1, offset2, glm::vec3(1.0f)};
+
+    // Each corner contributes (0.5 - r^2)^4 * dot(gradient, offset) out to a
+    // radius where it falls to zero before reaching the neighbouring
+    // simplices, which keeps the noise and its derivative continuous.
+    float n = 0.0f;
+    glm::vec3 d(0.0f);
+    for (int corner = 0; corner < 4; corner++)
+    {
+        glm::vec3 x = x0 - offsets[corner] + G3 * corner;
+        float t = 0.5f - glm::dot(x, x);
+        if (t <= 0.0f)
+        {
+            continue;
+        }
+
+        glm::ivec3 c = glm::ivec3(cell + offsets[corner]);
+        int h = hash(c.x, c.y, c.z) % 12;
+        glm::vec3 g(gradX[h], gradY[h], gradZ[h]);
+        float gx = glm::dot(g, x);
+        float t2 = t * t;
+        n += t2 * t2 * gx;
+        d += t2 * t2 * g - 8.0f * t2 * t * gx * x;
+    }
+
+    if (derivative != nullptr)
+    {
+        *derivative = 76.0f * d;
+    }
+    return 76.0f * n;
+}
+
+ValueNoiseSDF::ValueNoiseSDF(unsigned int seed, float frequency,
+        float amplitude)
+    : NoiseSDF(seed, frequency, amplitude) {}
+
+float ValueNoiseSDF::noise(glm::vec3 p, glm::vec3* derivative) const
+{
+    glm::vec3 cell = glm::floor(p);
+    glm::vec3 f = p - cell;
+
+    int hashes[8];
+    cornerHashes(perm, (int)cell.x, (int)cell.y, (int)cell.z, hashes);
+
+    float n[8];
+    for (int c = 0; c < 8; c++)
+    {
+        n[c] = hashes[c] * (2.0f / 255.0f) - 1.0f;
+    }
+
+    return blendCorners(n, nullptr, fade(f), fadeDerivative(f), derivative);
+}
+
+void ValueNoiseSDF::noiseBatch(const glm::vec3* points, float scale,
+        float* out, int count) const
+{
+    int i = 0;
+
+#if defined(__SSE2__)
+    // The same layout as PerlinNoiseSDF::noiseBatch(), with lattice values in
+    // place of gradient dot products.
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 s = _mm_set1_ps(scale);
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 u[3];
+        alignas(16) int cell[3][4];
+        for (int axis = 0; axis < 3; axis++)
+        {
+            __m128 p = _mm_mul_ps(s, _mm_set_ps(points[i + 3][axis],
+                    points[i + 2][axis], points[i + 1][axis],
+                    points[i][axis]));
+            __m128 t = _mm_cvtepi32_ps(_mm_cvttps_epi32(p));
+            t = _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, p), one));
+            _mm_store_si128((__m128i*)cell[axis], _mm_cvttps_epi32(t));
+
+            __m128 f = _mm_sub_ps(p, t);
+            __m128 ft = _mm_sub_ps(_mm_mul_ps(f, _mm_set1_ps(6.0f)),
+                    _mm_set1_ps(15.0f));
+            ft = _mm_add_ps(_mm_mul_ps(f, ft), _mm_set1_ps(10.0f));
+            u[axis] = _mm_mul_ps(_mm_mul_ps(f, f), _mm_mul_ps(f, ft));
+        }
+
+        alignas(16) float values[8][4];
+        for (int lane = 0; lane < 4; lane++)
+        {
+            int hashes[8];
+            cornerHashes(perm, cell[0][lane], cell[1][lane], cell[2][lane],
+                    hashes);
+            for (int c = 0; c < 8; c++)
+            {
+                values[c][lane] = hashes[c] * (2.0f / 255.0f) - 1.0f;
+            }
+        }
+
+        __m128 n[8];
+        for (int c = 0; c < 8; c++)
+        {
+            n[c] = _mm_load_ps(values[c]);
+        }
+        for (int axis = 0, stride = 1; axis < 3; axis++, stride *= 2)
+        {
+            for (int c = 0; c < 8; c += 2 * stride)
+            {
+                n[c] = _mm_add_ps(n[c], _mm_mul_ps(u[axis],
+                        _mm_sub_ps(n[c + stride], n[c])));
+            }
+        }
+        _mm_storeu_ps(out + i, n[0]);
+    }
+#endif
+
+    for (; i < count; i++)
+    {
+        out[i] = noise(points[i] * scale);
+    }
+}
+
+FbmSDF::FbmSDF(SignedDistanceFunction* base, int octaves, float lacunarity,
+        float gain)
+    : sdf(base), n(octaves), l(lacunarity), g(gain) {}
+
+float FbmSDF::distance(glm::vec3 p)
+{
+    float sum = 0.0f;
+    float amplitude = 1.0f;
+    for (int i = 0; i < n; i++)
+    {
+        sum += amplitude * sdf->distance(p);
+        p *= l;
+        amplitude *= g;
+    }
+    return sum;
+}
+
+void FbmSDF::distances(const glm::vec3* points, float* out, int count)
+{
+    // One batch per octave keeps the base SDF's kernel busy on long runs.
+    std::vector<glm::vec3> scaled(points, points + count);
+    std::vector<float> octave(count);
+    std::fill(out, out + count, 0.0f);
+
+    float amplitude = 1.0f;
+    for (int i = 0; i < n; i++)
+    {
+        sdf->distances(scaled.data(), octave.data(), count);
+        for (int j = 0; j < count; j++)
+        {
+            out[j] += amplitude * octave[j];
+            scaled[j] *= l;
+        }
+        amplitude *= g;
+    }
+}
+
+glm::vec3 FbmSDF::gradient(glm::vec3 p)
+{
+    glm::vec3 sum(0.0f);
+    float amplitude = 1.0f;
+    float frequency = 1.0f;
+    for (int i = 0; i < n; i++)
+    {
+        sum += amplitude * frequency * sdf->gradient(p * frequency);
+        frequency *= l;
+        amplitude *= g;
+    }
+    return sum;
+}
+
+RidgedSDF::RidgedSDF(SignedDistanceFunction* base, int octaves,
+        float lacunarity, float gain, float offset)
+    : sdf(base), n(octaves), l(lacunarity), g(gain), o(offset) {}
+
+float RidgedSDF::distance(glm::vec3 p)
+{
+    float sum = 0.0f;
+    float amplitude = 1.0f;
+    for (int i = 0; i < n; i++)
+    {
+        float ridge = o - std::abs(sdf->distance(p));
+        sum += amplitude * ridge * ridge;
+        p *= l;
+        amplitude *= g;
+    }
+    return sum;
+}
+
+void RidgedSDF::distances(const glm::vec3* points, float* out, int count)
+{
+    std::vector<glm::vec3> scaled(points, points + count);
+    std::vector<float> octave(count);
+    std::fill(out, out + count, 0.0f);
+
+    float amplitude = 1.0f;
+    for (int i = 0; i < n; i++)
+    {
+        sdf->distances(scaled.data(), octave.data(), count);
+        for (int j = 0; j < count; j++)
+        {
+            float ridge = o - std::abs(octave[j]);
+            out[j] += amplitude * ridge * ridge;
+            scaled[j] *= l;
+        }
+        amplitude *= g;
+    }
+}
+
+glm::vec3 RidgedSDF::gradient(glm::vec3 p)
+{
+    glm::vec3 sum(0.0f);
+    float amplitude = 1.0f;
+    float frequency = 1.0f;
+    for (int i = 0; i < n; i++)
+    {
+        glm::vec3 q = p * frequency;
+        float d = sdf->distance(q);
+        float ridge = o - std::abs(d);
+        float sign = d < 0.0f ? -1.0f : 1.0f;
+        sum += amplitude * frequency * -2.0f * ridge * sign * sdf->gradient(q);
+        frequency *= l;
+        amplitude *= g;
+    }
+    return sum;
+}
+
+// Identifies each HeightfieldSDF for the column cache. Addresses can be
+// reused once an SDF is destroyed, so they can't serve as the key.
+static std::atomic<unsigned long long> nextHeightfieldId(1);
+
+HeightfieldSDF::HeightfieldSDF(SignedDistanceFunction* height)
+    : h(height), id(nextHeightfieldId++) {}
+
+float HeightfieldSDF::distance(glm::vec3 p)
+{
+    return p.y - h->distance(glm::vec3(p.x, 0.0f, p.z));
+}
+
+void HeightfieldSDF::distances(const glm::vec3* points, float* out, int count)
+{
+    // The columns and heights of the previous batch on this thread. Lattice
+    // rows that differ only in y hit this cache.
+    static thread_local unsigned long long cachedOwner = 0;
+    static thread_local std::vector<glm::vec3> cachedColumns;
+    static thread_local std::vector<float> cachedHeights;
+
+    bool hit = cachedOwner == id && (int)cachedColumns.size() == count;
+    for (int i = 0; hit && i < count; i++)
+    {
+        hit = cachedColumns[i].x == points[i].x
+            && cachedColumns[i].z == points[i].z;
+    }
+
+    if (!hit)
+    {
+        cachedOwner = id;
+        cachedColumns.resize(count);
+        cachedHeights.resize(count);
+        for (int i = 0; i < count; i++)
+        {
+            cachedColumns[i] = glm::vec3(points[i].x, 0.0f, points[i].z);
+        }
+        h->distances(cachedColumns.data(), cachedHeights.data(), count);
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        out[i] = points[i].y - cachedHeights[i];
+    }
+}
+
+glm::vec3 HeightfieldSDF::gradient(glm::vec3 p)
+{
+    glm::vec3 slope = h->gradient(glm::vec3(p.x, 0.0f, p.z));
+    return glm::vec3(-slope.x, 1.0f, -slope.z);
+}
@@ -0,0 +1,493 @@
+#include "marching_cubes/occlusion_culling.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+void findOccluders(const SampleLattice &lattice, float isolevel, int blocks,
+        BoxList &occluders)
+{
+    glm::ivec3 cubes = lattice.size - 1;
+    if (cubes.x < 1 || cubes.y < 1 || cubes.z < 1)
+    {
+        return;
+    }
+    glm::ivec3 span = (cubes + std::max(blocks, 1) - 1) / std::max(blocks, 1);
+    glm::ivec3 count = (cubes + span - 1) / span;
+
+    // A block is solid when every sample on or inside its faces is below the
+    // isolevel.
+    std::vector<unsigned char> solid(count.x * count.y * count.z);
+    for (int bz = 0; bz < count.z; bz++)
+    {
+        for (int by = 0; by < count.y; by++)
+        {
+            for (int bx = 0; bx < count.x; bx++)
+            {
+                glm::ivec3 first = glm::ivec3(bx, by, bz) * span;
+                glm::ivec3 last = glm::min(first + span, cubes);
+                bool inside = true;
+                for (int z = first.z; z <= last.z && inside; z++)
+                {
+                    for (int y = first.y; y <= last.y && inside; y++)
+                    {
+                        for (int x = first.x; x <= last.x && inside; x++)
+                        {
+                            inside = lattice.value(x, y, z) < isolevel;
+                        }
+                    }
+                }
+                solid[(bz * count.y + by) * count.x + bx] = inside;
+            }
+        }
+    }
+
+    // Solid blocks are cleared as they are merged into boxes.
+    auto isSolid = [&](int x, int y, int z)
+    {
+        return solid[(z * count.y + y) * count.x + x] != 0;
+    };
+    for (int z = 0; z < count.z; z++)
+    {
+        for (int y = 0; y < count.y; y++)
+        {
+            for (int x = 0; x < count.x; x++)
+            {
+                if (!isSolid(x, y, z))
+                {
+                    continue;
+                }
+                int x1 = x + 1;
+                while (x1 < count.x && isSolid(x1, y, z))
+                {
+                    x1++;
+                }
+                int y1 = y + 1;
+                for (bool full = true; y1 < count.y && full; y1 += full)
+                {
+                    for (int i = x; i < x1 && full; i++)
+                    {
+                        full = isSolid(i, y1, z);
+                    }
+                }
+                int z1 = z + 1;
+                for (bool full = true; z1 < count.z && full; z1 += full)
+                {
+                    for (int j = y; j < y1 && full; j++)
+                    {
+                        for (int i = x; i < x1 && full; i++)
+                        {
+                            full = isSolid(i, j, z1);
+                        }
+                    }
+                }
+                for (int k = z; k < z1; k++)
+                {
+                    for (int j = y; j < y1; j++)
+                    {
+                        for (int i = x; i < x1; i++)
+                        {
+                            solid[(k * count.y + j) * count.x + i] = 0;
+                        }
+                    }
+                }
+
+                glm::ivec3 first = glm::ivec3(x, y, z) * span;
+                glm::ivec3 last = glm::min(glm::ivec3(x1, y1, z1) * span,
+                        cubes);
+                occluders.add(lattice.position(first.x, first.y, first.z),
+                        lattice.position(last.x, last.y, last.z));
+            }
+        }
+    }
+}
+
+// The corners of each face of a box, counterclockwise seen from outside. Bit
+// 0 of a corner's index picks max.x over min.x, bit 1 max.y and bit 2 max.z.
+static const int FACES[6][4] = {
+    {1, 3, 7, 5}, {0, 4, 6, 2},
+    {2, 6, 7, 3}, {0, 1, 5, 4},
+    {4, 5, 7, 6}, {0, 2, 3, 1}
+};
+
+static float cross(glm::vec2 o, glm::vec2 a, glm::vec2 b)
+{
+    return (a.x - o.x) * (b.y - o.y) - (a.y - o.y) * (b.x - o.x);
+}
+
+/*
+ * Stores the convex hull of 8 points in hull counterclockwise, with Andrew's
+ * monotone chain, and returns its number of vertices. Sorts the points.
+ */
+static int convexHull(glm::vec2 points[8], glm::vec2 hull[16])
+{
+    std::sort(points, points + 8, [](glm::vec2 a, glm::vec2 b)
+    {
+        return a.x < b.x || (a.x == b.x && a.y < b.y);
+    });
+    int k = 0;
+    for (int i = 0; i < 8; i++)
+    {
+        while (k >= 2 && cross(hull[k - 2], hull[k - 1], points[i]) <= 0.0f)
+        {
+            k--;
+        }
+        hull[k++] = points[i];
+    }
+    for (int i = 6, lower = k + 1; i >= 0; i--)
+    {
+        while (k >= lower
+                && cross(hull[k - 2], hull[k - 1], points[i]) <= 0.0f)
+        {
+            k--;
+        }
+        hull[k++] = points[i];
+    }
+    return k - 1;
+}
+
+/*
+ * Clamps the pixels a range of screen coordinates touches to [0, size).
+ * Pixel i covers [i, i + 1).
+ */
+static void pixelRange(float lo, float hi, int size, int &first, int &last)
+{
+    first = (int)std::floor(std::min(std::max(lo, 0.0f), (float)size));
+    last = (int)std::floor(std::min(std::max(hi, -1.0f), size - 1.0f));
+}
+
+OcclusionBuffer::OcclusionBuffer(int width, int height)
+    : w((std::max(width, 1) + 3) & ~3), h(std::max(height, 1)),
+      matrix(1.0f)
+{
+    glm::ivec2 size(w, h);
+    sizes.push_back(size);
+    while (size.x > 1 || size.y > 1)
+    {
+        size = (size + 1) / 2;
+        sizes.push_back(size);
+    }
+    for (glm::ivec2 level : sizes)
+    {
+        levels.push_back(std::vector<float>(level.x * level.y, 1.0f));
+    }
+}
+
+void OcclusionBuffer::clear(const glm::mat4 &viewProjection)
+{
+    matrix = viewProjection;
+    for (std::vector<float> &level : levels)
+    {
+        std::fill(level.begin(), level.end(), 1.0f);
+    }
+}
+
+void OcclusionBuffer::addOccluder(glm::vec3 min, glm::vec3 max)
+{
+    glm::vec3 screen[8];
+    if (!project(min, max, screen))
+    {
+        return;
+    }
+    glm::vec2 points[8];
+    glm::vec2 lo(screen[0]);
+    glm::vec2 hi(screen[0]);
+    for (int i = 0; i < 8; i++)
+    {
+        points[i] = glm::vec2(screen[i]);
+        lo = glm::min(lo, points[i]);
+        hi = glm::max(hi, points[i]);
+    }
+    int x0, x1, y0, y1;
+    pixelRange(lo.x, hi.x, w, x0, x1);
+    pixelRange(lo.y, hi.y, h, y0, y1);
+    if (x0 > x1 || y0 > y1)
+    {
+        return;
+    }
+
+    // Each edge function is non-negative at the centers of the pixels whose
+    // every point is on the inner side of the edge.
+    glm::vec2 hull[16];
+    int edges = convexHull(points, hull);
+    if (edges < 3)
+    {
+        return;
+    }
+    float ea[16];
+    float eb[16];
+    float ec[16];
+    for (int i = 0; i < edges; i++)
+    {
+        glm::vec2 p = hull[i];
+        glm::vec2 q = hull[(i + 1) % edges];
+        ea[i] = p.y - q.y;
+        eb[i] = q.x - p.x;
+        ec[i] = -(ea[i] * p.x + eb[i] * p.y)
+            - 0.5f * (std::fabs(ea[i]) + std::fabs(eb[i]));
+    }
+
+    // The nearest depth of a convex box at a screen position is the maximum
+    // of its front faces' depth planes there, and the maximum of a plane
+    // over a pixel is at its center plus half its slopes.
+    float pa[6];
+    float pb[6];
+    float pc[6];
+    int planes = 0;
+    for (int f = 0; f < 6; f++)
+    {
+        glm::vec3 s[4];
+        float area = 0.0f;
+        for (int i = 0; i < 4; i++)
+        {
+            s[i] = screen[FACES[f][i]];
+        }
+        for (int i = 0; i < 4; i++)
+        {
+            glm::vec3 a = s[i];
+            glm::vec3 b = s[(i + 1) % 4];
+            area += a.x * b.y - b.x * a.y;
+        }
+        if (area <= 0.0f)
+        {
+            continue;
+        }
+        glm::vec3 u = s[1] - s[0];
+        glm::vec3 v = s[2] - s[0];
+        float d = u.x * v.y - v.x * u.y;
+        if (std::fabs(d) < 1e-12f)
+        {
+            u = s[2] - s[0];
+            v = s[3] - s[0];
+            d = u.x * v.y - v.x * u.y;
+        }
+        if (std::fabs(d) < 1e-12f)
+        {
+            return;
+        }
+        pa[planes] = (u.z * v.y - v.z * u.y) / d;
+        pb[planes] = (u.x * v.z - v.x * u.z) / d;
+        pc[planes] = s[0].z - pa[planes] * s[0].x - pb[planes] * s[0].y
+            + 0.5f * (std::fabs(pa[planes]) + std::fabs(pb[planes]));
+        planes++;
+    }
+    if (planes == 0)
+    {
+        return;
+    }
+
+    std::vector<float> &depths = levels[0];
+    for (int y = y0; y <= y1; y++)
+    {
+        float py = y + 0.5f;
+        float* row = &depths[y * w];
+
+        // The buffer's width is a multiple of 4, so aligning the first pixel
+        // keeps every group of 4 in the row. Pixels outside the hull fail
+        // the edge tests.
+        int x = x0 & ~3;
+
+#if defined(__SSE2__)
+        __m128 edgeA[16];
+        __m128 edgeC[16];
+        for (int i = 0; i < edges; i++)
+        {
+            edgeA[i] = _mm_set1_ps(ea[i]);
+            edgeC[i] = _mm_set1_ps(eb[i] * py + ec[i]);
+        }
+        __m128 planeA[6];
+        __m128 planeC[6];
+        for (int i = 0; i < planes; i++)
+        {
+            planeA[i] = _mm_set1_ps(pa[i]);
+            planeC[i] = _mm_set1_ps(pb[i] * py + pc[i]);
+        }
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 lanes = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+        for (; x <= x1; x += 4)
+        {
+            __m128 px = _mm_add_ps(_mm_set1_ps((float)x), lanes);
+            __m128 inside = _mm_cmpge_ps(
+                    _mm_add_ps(_mm_mul_ps(edgeA[0], px), edgeC[0]), zero);
+            for (int i = 1; i < edges; i++)
+            {
+                inside = _mm_and_ps(inside, _mm_cmpge_ps(
+                        _mm_add_ps(_mm_mul_ps(edgeA[i], px), edgeC[i]),
+                        zero));
+            }
+            if (_mm_movemask_ps(inside) == 0)
+            {
+                continue;
+            }
+            __m128 depth = _mm_add_ps(_mm_mul_ps(planeA[0], px), planeC[0]);
+            for (int i = 1; i < planes; i++)
+            {
+                depth = _mm_max_ps(depth,
+                        _mm_add_ps(_mm_mul_ps(planeA[i], px), planeC[i]));
+            }
+            __m128 old = _mm_loadu_ps(row + x);
+            __m128 nearer = _mm_min_ps(depth, old);
+            _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearer),
+                    _mm_andnot_ps(inside, old)));
+        }
+#endif
+
+        for (; x <= x1; x++)
+        {
+            float px = x + 0.5f;
+            bool inside = true;
+            for (int i = 0; i < edges && inside; i++)
+            {
+                inside = ea[i] * px + eb[i] * py + ec[i] >= 0.0f;
+            }
+            if (!inside)
+            {
+                continue;
+            }
+            float depth = pa[0] * px + pb[0] * py + pc[0];
+            for (int i = 1; i < planes; i++)
+            {
+                depth = std::max(depth, pa[i] * px + pb[i] * py + pc[i]);
+            }
+            if (depth < row[x])
+            {
+                row[x] = depth;
+            }
+        }
+    }
+}
+
+void OcclusionBuffer::addOccluders(const BoxList &boxes, size_t count)
+{
+    count = std::min(count, boxes.size());
+    for (size_t i = 0; i < count; i++)
+    {
+        addOccluder(glm::vec3(boxes.minX[i], boxes.minY[i], boxes.minZ[i]),
+                glm::vec3(boxes.maxX[i], boxes.maxY[i], boxes.maxZ[i]));
+    }
+}
+
+void OcclusionBuffer::buildHierarchy()
+{
+    for (size_t k = 1; k < levels.size(); k++)
+    {
+        const std::vector<float> &fine = levels[k - 1];
+        glm::ivec2 fineSize = sizes[k - 1];
+        glm::ivec2 size = sizes[k];
+        for (int y = 0; y < size.y; y++)
+        {
+            int y1 = std::min(2 * y + 1, fineSize.y - 1);
+            for (int x = 0; x < size.x; x++)
+            {
+                int x1 = std::min(2 * x + 1, fineSize.x - 1);
+                float depth = std::max(
+                        std::max(fine[2 * y * fineSize.x + 2 * x],
+                            fine[2 * y * fineSize.x + x1]),
+                        std::max(fine[y1 * fineSize.x + 2 * x],
+                            fine[y1 * fineSize.x + x1]));
+                levels[k][y * size.x + x] = depth;
+            }
+        }
+    }
+}
+
+bool OcclusionBuffer::boxVisible(glm::vec3 min, glm::vec3 max) const
+{
+    glm::vec3 screen[8];
+    if (!project(min, max, screen))
+    {
+        return true;
+    }
+    glm::vec3 lo = screen[0];
+    glm::vec3 hi = screen[0];
+    for (int i = 1; i < 8; i++)
+    {
+        lo = glm::min(lo, screen[i]);
+        hi = glm::max(hi, screen[i]);
+    }
+    int x0, x1, y0, y1;
+    pixelRange(lo.x, hi.x, w, x0, x1);
+    pixelRange(lo.y, hi.y, h, y0, y1);
+    if (x0 > x1 || y0 > y1)
+    {
+        return true;
+    }
+
+    // Climb the pyramid until the box spans at most 4 by 4 values.
+    size_t level = 0;
+    while (level + 1 < levels.size()
+            && ((x1 >> level) - (x0 >> level) >= 4
+                || (y1 >> level) - (y0 >> level) >= 4))
+    {
+        level++;
+    }
+    const std::vector<float> &depths = levels[level];
+    int width = sizes[level].x;
+    for (int y = y0 >> level; y <= y1 >> level; y++)
+    {
+        for (int x = x0 >> level; x <= x1 >> level; x++)
+        {
+            if (depths[y * width + x] >= lo.z)
+            {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+size_t OcclusionBuffer::testBoxes(const BoxList &boxes,
+        std::vector<unsigned char> &visible) const
+{
+    size_t visibleCount = 0;
+    for (size_t i = 0; i < boxes.size(); i++)
+    {
+        if (visible[i])
+        {
+            visible[i] = boxVisible(
+                    glm::vec3(boxes.minX[i], boxes.minY[i], boxes.minZ[i]),
+                    glm::vec3(boxes.maxX[i], boxes.maxY[i], boxes.maxZ[i]));
+            visibleCount += visible[i];
+        }
+    }
+    return visibleCount;
+}
+
+int OcclusionBuffer::width() const
+{
+    return w;
+}
+
+int OcclusionBuffer::height() const
+{
+    return h;
+}
+
+float OcclusionBuffer::depth(int x, int y) const
+{
+    return levels[0][y * w + x];
+}
+
+/*
+ * Stores the pixel coordinates and depth of a box's corners, indexed like
+ * FACES. Returns false if the box crosses the near plane.
+ */
+bool OcclusionBuffer::project(glm::vec3 min, glm::vec3 max,
+        glm::vec3 screen[8]) const
+{
+    for (int i = 0; i < 8; i++)
+    {
+        glm::vec4 p = matrix * glm::vec4(i & 1 ? max.x : min.x,
+                i & 2 ? max.y : min.y, i & 4 ? max.z : min.z, 1.0f);
+        if (p.w <= 0.0f || p.z < -p.w)
+        {
+            return false;
+        }
+        screen[i] = glm::vec3((0.5f * p.x / p.w + 0.5f) * w,
+                (0.5f * p.y / p.w + 0.5f) * h, p.z / p.w);
+    }
+    return true;
+}
@@ -0,0 +1,113 @@
+#include "marching_cubes/parallel.h"
+
+#include <algorithm>
+
+// Set on ThreadPool workers, where parallelFor() runs serially.
+static thread_local bool poolWorker = false;
+
+int workerCount()
+{
+    unsigned int count = std::thread::hardware_concurrency();
+    return count > 0 ? (int)count : 1;
+}
+
+void parallelFor(int begin, int end, const std::function<void(int)> &body)
+{
+    int count = end - begin;
+    if (count <= 0)
+    {
+        return;
+    }
+
+    int threadCount = poolWorker ? 1 : std::min(workerCount(), count);
+    if (threadCount == 1)
+    {
+        for (int i = begin; i < end; i++)
+        {
+            body(i);
+        }
+        return;
+    }
+
+    // Each thread gets a contiguous block so that neighbouring indices, which
+    // usually touch neighbouring memory, stay on the same core.
+    std::vector<std::thread> threads;
+    for (int t = 0; t < threadCount; t++)
+    {
+        int blockBegin = begin + (int)((long long)count * t / threadCount);
+        int blockEnd = begin + (int)((long long)count * (t + 1) / threadCount);
+        threads.push_back(std::thread([&body, blockBegin, blockEnd]()
+        {
+            for (int i = blockBegin; i < blockEnd; i++)
+            {
+                body(i);
+            }
+        }));
+    }
+
+    for (std::thread &thread : threads)
+    {
+        thread.join();
+    }
+}
+
+ThreadPool::ThreadPool(int threads) : stopping(false)
+{
+    for (int t = 0; t < std::max(threads, 1); t++)
+    {
+        this->threads.push_back(std::thread(&ThreadPool::work, this));
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread &thread : threads)
+    {
+        thread.join();
+    }
+}
+
+void ThreadPool::submit(std::function<void()> task)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        tasks.push_back(std::move(task));
+    }
+    wake.notify_one();
+}
+
+int ThreadPool::size() const
+{
+    return (int)threads.size();
+}
+
+void ThreadPool::work()
+{
+    poolWorker = true;
+    while (true)
+    {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [this]() { return stopping || !tasks.empty(); });
+            if (tasks.empty())
+            {
+                return;
+            }
+            task = std::move(tasks.front());
+            tasks.pop_front();
+        }
+        task();
+    }
+}
+
+ThreadPool &sharedThreadPool()
+{
+    static ThreadPool pool;
+    return pool;
+}
@@ -0,0 +1,278 @@
+#include "marching_cubes/particle_field_sdf.h"
+#include "marching_cubes/parallel.h"
+
+#include <algorithm>
+#include <cmath>
+
+ParticleFieldSDF::ParticleFieldSDF(float radius, float threshold)
+    : h(radius), iso(threshold), buckets(1), bucketStart(2, 0) {}
+
+void ParticleFieldSDF::setParticles(const std::vector<glm::vec3> &particles)
+{
+    int count = (int)particles.size();
+
+    // Twice as many buckets as particles keeps collisions rare.
+    buckets = 1;
+    while (buckets < 2 * count)
+    {
+        buckets *= 2;
+    }
+
+    // The particles are sorted by bucket in two levels so that no two threads
+    // ever write to the same place. Each thread owns a contiguous block of
+    // particles for the first pass and a contiguous range of buckets for the
+    // second.
+    int threads = std::max(1, std::min(workerCount(), count / 1024));
+    std::vector<int> bucketIds(count);
+    std::vector<std::vector<int>> ownerCounts(threads,
+            std::vector<int>(threads, 0));
+
+    auto blockBegin = [&](int t)
+    {
+        return (int)((long long)count * t / threads);
+    };
+    auto ownerOf = [&](int bucket)
+    {
+        return (int)((long long)bucket * threads / buckets);
+    };
+    auto ownerBucketBegin = [&](int t)
+    {
+        // The first bucket b with ownerOf(b) == t.
+        return (int)(((long long)buckets * t + threads - 1) / threads);
+    };
+
+    parallelFor(0, threads, [&](int t)
+    {
+        for (int i = blockBegin(t); i < blockBegin(t + 1); i++)
+        {
+            bucketIds[i] = bucketOf(cellOf(particles[i]));
+            ownerCounts[t][ownerOf(bucketIds[i])]++;
+        }
+    });
+
+    // Where each block starts writing within each owner's region.
+    std::vector<std::vector<int>> offsets(threads, std::vector<int>(threads));
+    std::vector<int> ownerStart(threads + 1, 0);
+    for (int owner = 0, offset = 0; owner < threads; owner++)
+    {
+        ownerStart[owner] = offset;
+        for (int t = 0; t < threads; t++)
+        {
+            offsets[t][owner] = offset;
+            offset += ownerCounts[t][owner];
+        }
+    }
+    ownerStart[threads] = count;
+
+    std::vector<int> byOwner(count);
+    parallelFor(0, threads, [&](int t)
+    {
+        for (int i = blockBegin(t); i < blockBegin(t + 1); i++)
+        {
+            byOwner[offsets[t][ownerOf(bucketIds[i])]++] = i;
+        }
+    });
+
+    sorted.resize(count);
+    sortedCells.resize(count);
+    bucketStart.assign(buckets + 1, 0);
+    parallelFor(0, threads, [&](int owner)
+    {
+        int first = ownerBucketBegin(owner);
+        int last = ownerBucketBegin(owner + 1);
+
+        // A counting sort of this owner's particles by bucket, which only
+        // touches the owner's own range of bucketStart.
+        for (int j = ownerStart[owner]; j < ownerStart[owner + 1]; j++)
+        {
+            bucketStart[bucketIds[byOwner[j]]]++;
+        }
+        for (int b = first, offset = ownerStart[owner]; b < last; b++)
+        {
+            int bucketCount = bucketStart[b];
+            bucketStart[b] = offset;
+            offset += bucketCount;
+        }
+
+        std::vector<int> next(bucketStart.begin() + first,
+                bucketStart.begin() + last);
+        for (int j = ownerStart[owner]; j < ownerStart[owner + 1]; j++)
+        {
+            int i = byOwner[j];
+            int slot = next[bucketIds[i] - first]++;
+            sorted[slot] = particles[i];
+            sortedCells[slot] = cellOf(particles[i]);
+        }
+    });
+    bucketStart[buckets] = count;
+}
+
+float ParticleFieldSDF::distance(glm::vec3 p)
+{
+    glm::ivec3 center = cellOf(p);
+    float h2 = h * h;
+    float field = 0.0f;
+    for (int z = -1; z <= 1; z++)
+    {
+        for (int y = -1; y <= 1; y++)
+        {
+            for (int x = -1; x <= 1; x++)
+            {
+                glm::ivec3 cell = center + glm::ivec3(x, y, z);
+                int bucket = bucketOf(cell);
+                for (int j = bucketStart[bucket]; j < bucketStart[bucket + 1];
+                        j++)
+                {
+                    // Buckets can be shared by distant cells, so particles from
+                    // other cells are skipped to avoid counting them twice.
+                    glm::vec3 d = p - sorted[j];
+                    float r2 = glm::dot(d, d);
+                    if (r2 < h2 && sortedCells[j] == cell)
+                    {
+                        float w = 1.0f - r2 / h2;
+                        field += w * w * w;
+                    }
+                }
+            }
+        }
+    }
+    return iso - field;
+}
+
+glm::vec3 ParticleFieldSDF::gradient(glm::vec3 p)
+{
+    glm::ivec3 center = cellOf(p);
+    float h2 = h * h;
+    glm::vec3 gradient(0.0f);
+    for (int z = -1; z <= 1; z++)
+    {
+        for (int y = -1; y <= 1; y++)
+        {
+            for (int x = -1; x <= 1; x++)
+            {
+                glm::ivec3 cell = center + glm::ivec3(x, y, z);
+                int bucket = bucketOf(cell);
+                for (int j = bucketStart[bucket]; j < bucketStart[bucket + 1];
+                        j++)
+                {
+                    glm::vec3 d = p - sorted[j];
+                    float r2 = glm::dot(d, d);
+                    if (r2 < h2 && sortedCells[j] == cell)
+                    {
+                        float w = 1.0f - r2 / h2;
+                        gradient += 6.0f * w * w / h2 * d;
+                    }
+                }
+            }
+        }
+    }
+
+    // The field decreases away from each particle, and distance() is
+    // threshold - field.
+    return gradient;
+}
+
+void ParticleFieldSDF::splat(SampleLattice &lattice) const
+{
+    std::fill(lattice.values.begin(), lattice.values.end(), iso);
+    if (sorted.empty() || lattice.values.empty())
+    {
+        return;
+    }
+
+    glm::vec3 origin = lattice.position(0, 0, 0);
+
+    // Bucket the particles by the lattice slice they fall in, including the
+    // slices just outside the lattice whose particles still reach into it.
+    glm::ivec3 reach = glm::ivec3(glm::ceil(glm::vec3(h) / lattice.step));
+    int firstSlice = -reach.z - 1;
+    int sliceCount = lattice.size.z + 2 * reach.z + 2;
+    std::vector<int> sliceStart(sliceCount + 1, 0);
+    std::vector<int> sliceOf(sorted.size());
+    for (size_t i = 0; i < sorted.size(); i++)
+    {
+        float z = (sorted[i].z - origin.z) / lattice.step.z;
+        int slice = (int)std::floor(z) - firstSlice;
+        sliceOf[i] = slice >= 0 && slice < sliceCount ? slice : -1;
+        if (sliceOf[i] >= 0)
+        {
+            sliceStart[sliceOf[i] + 1]++;
+        }
+    }
+    for (int s = 0; s < sliceCount; s++)
+    {
+        sliceStart[s + 1] += sliceStart[s];
+    }
+    std::vector<glm::vec3> bySlice(sliceStart[sliceCount]);
+    std::vector<int> next(sliceStart.begin(), sliceStart.end() - 1);
+    for (size_t i = 0; i < sorted.size(); i++)
+    {
+        if (sliceOf[i] >= 0)
+        {
+            bySlice[next[sliceOf[i]]++] = sorted[i];
+        }
+    }
+
+    // Each thread scatters into its own lattice slices only, visiting the
+    // particles from the slices within reach of them.
+    float h2 = h * h;
+    parallelFor(0, lattice.size.z, [&](int z)
+    {
+        float sampleZ = origin.z + lattice.step.z * z;
+        int first = std::max(z - reach.z - firstSlice - 1, 0);
+        int last = std::min(z + reach.z - firstSlice + 1, sliceCount - 1);
+        for (int j = sliceStart[first]; j < sliceStart[last + 1]; j++)
+        {
+            glm::vec3 particle = bySlice[j];
+            float dz = sampleZ - particle.z;
+            if (dz * dz >= h2)
+            {
+                continue;
+            }
+
+            glm::vec3 lo = glm::ceil((particle - h - origin)
+                    / lattice.step);
+            glm::vec3 hi = glm::floor((particle + h - origin)
+                    / lattice.step);
+            int x0 = std::max((int)lo.x, 0);
+            int x1 = std::min((int)hi.x, lattice.size.x - 1);
+            int y0 = std::max((int)lo.y, 0);
+            int y1 = std::min((int)hi.y, lattice.size.y - 1);
+            for (int y = y0; y <= y1; y++)
+            {
+                float dy = origin.y + lattice.step.y * y - particle.y;
+                float ryz = dy * dy + dz * dz;
+                if (ryz >= h2)
+                {
+                    continue;
+                }
+
+                float* row = &lattice.values[lattice.index(0, y, z)];
+                for (int x = x0; x <= x1; x++)
+                {
+                    float dx = origin.x + lattice.step.x * x
+                        - particle.x;
+                    float r2 = dx * dx + ryz;
+                    if (r2 < h2)
+                    {
+                        float w = 1.0f - r2 / h2;
+                        row[x] -= w * w * w;
+                    }
+                }
+            }
+        }
+    });
+}
+
+glm::ivec3 ParticleFieldSDF::cellOf(glm::vec3 p) const
+{
+    return glm::ivec3(glm::floor(p / h));
+}
+
+int ParticleFieldSDF::bucketOf(glm::ivec3 cell) const
+{
+    unsigned int hash = ((unsigned int)cell.x * 73856093u)
+        ^ ((unsigned int)cell.y * 19349663u)
+        ^ ((unsigned int)cell.z * 83492791u);
+    return (int)(hash & (unsigned int)(buckets - 1));
+}
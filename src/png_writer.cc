@@ -0,0 +1,248 @@
+#include "marching_cubes/png_writer.h"
+
+#include <array>
+#include <cstdint>
+#include <fstream>
+
+/*
+ * Packs bits into bytes least significant bit first, as deflate expects.
+ */
+class BitWriter
+{
+    public:
+        explicit BitWriter(std::vector<unsigned char> &out)
+            : out(out), buffer(0), count(0)
+        {
+        }
+
+        void write(uint32_t bits, int length)
+        {
+            buffer |= bits << count;
+            count += length;
+            while (count >= 8)
+            {
+                out.push_back((unsigned char)buffer);
+                buffer >>= 8;
+                count -= 8;
+            }
+        }
+
+        /*
+         * Writes a Huffman code, which deflate stores most significant bit
+         * first.
+         */
+        void writeCode(uint32_t code, int length)
+        {
+            uint32_t reversed = 0;
+            for (int i = 0; i < length; i++)
+            {
+                reversed = (reversed << 1) | ((code >> i) & 1);
+            }
+            write(reversed, length);
+        }
+
+        void flush()
+        {
+            if (count > 0)
+            {
+                out.push_back((unsigned char)buffer);
+            }
+            buffer = 0;
+            count = 0;
+        }
+
+    private:
+        std::vector<unsigned char> &out;
+        uint32_t buffer;
+        int count;
+};
+
+/*
+ * Writes a literal byte or length symbol with deflate's fixed Huffman code.
+ */
+static void writeSymbol(BitWriter &bits, int symbol)
+{
+    if (symbol < 144)
+    {
+        bits.writeCode(0x30 + symbol, 8);
+    }
+    else if (symbol < 256)
+    {
+        bits.writeCode(0x190 + symbol - 144, 9);
+    }
+    else if (symbol < 280)
+    {
+        bits.writeCode(symbol - 256, 7);
+    }
+    else
+    {
+        bits.writeCode(0xc0 + symbol - 280, 8);
+    }
+}
+
+/*
+ * Writes a match of 3 to 258 bytes at distance 1.
+ */
+static void writeRun(BitWriter &bits, int length)
+{
+    static const int bases[] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19,
+        23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+    static const int extras[] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2,
+        2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+    int code = 28;
+    while (bases[code] > length)
+    {
+        code--;
+    }
+    writeSymbol(bits, 257 + code);
+    bits.write(length - bases[code], extras[code]);
+
+    // Distance code 0, for a distance of 1.
+    bits.writeCode(0, 5);
+}
+
+/*
+ * Returns a zlib stream of data, in a single fixed Huffman block.
+ */
+static std::vector<unsigned char> compress(
+        const std::vector<unsigned char> &data)
+{
+    std::vector<unsigned char> out;
+    out.push_back(0x78);
+    out.push_back(0x01);
+
+    BitWriter bits(out);
+    bits.write(1, 1);
+    bits.write(1, 2);
+    size_t i = 0;
+    while (i < data.size())
+    {
+        size_t run = 0;
+        if (i > 0)
+        {
+            while (run < 258 && i + run < data.size()
+                    && data[i + run] == data[i - 1])
+            {
+                run++;
+            }
+        }
+        if (run >= 3)
+        {
+            writeRun(bits, (int)run);
+            i += run;
+        }
+        else
+        {
+            writeSymbol(bits, data[i]);
+            i++;
+        }
+    }
+    writeSymbol(bits, 256);
+    bits.flush();
+
+    uint32_t a = 1;
+    uint32_t b = 0;
+    for (unsigned char c : data)
+    {
+        a = (a + c) % 65521;
+        b = (b + a) % 65521;
+    }
+    uint32_t adler = (b << 16) | a;
+    for (int shift = 24; shift >= 0; shift -= 8)
+    {
+        out.push_back((unsigned char)(adler >> shift));
+    }
+    return out;
+}
+
+static std::array<uint32_t, 256> crcTable()
+{
+    std::array<uint32_t, 256> table;
+    for (uint32_t n = 0; n < 256; n++)
+    {
+        uint32_t c = n;
+        for (int k = 0; k < 8; k++)
+        {
+            c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+        }
+        table[n] = c;
+    }
+    return table;
+}
+
+static uint32_t crc32(const unsigned char* data, size_t size, uint32_t crc)
+{
+    static const std::array<uint32_t, 256> table = crcTable();
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++)
+    {
+        crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+static void writeBigEndian(std::ofstream &file, uint32_t value)
+{
+    unsigned char bytes[] = {(unsigned char)(value >> 24),
+        (unsigned char)(value >> 16), (unsigned char)(value >> 8),
+        (unsigned char)value};
+    file.write((const char*)bytes, 4);
+}
+
+static void writeChunk(std::ofstream &file, const char* type,
+        const std::vector<unsigned char> &data)
+{
+    writeBigEndian(file, (uint32_t)data.size());
+    file.write(type, 4);
+    file.write((const char*)data.data(), data.size());
+    uint32_t crc = crc32((const unsigned char*)type, 4, 0);
+    crc = crc32(data.data(), data.size(), crc);
+    writeBigEndian(file, crc);
+}
+
+bool savePNG(const std::string &path, int width, int height,
+        const std::vector<unsigned char> &rgba)
+{
+    if (width <= 0 || height <= 0
+            || rgba.size() < (size_t)width * height * 4)
+    {
+        return false;
+    }
+    std::ofstream file(path, std::ios::binary);
+    if (!file)
+    {
+        return false;
+    }
+
+    // Filter type 1 stores each byte minus the one 4 bytes to its left.
+    size_t stride = (size_t)width * 4;
+    std::vector<unsigned char> filtered;
+    filtered.reserve((stride + 1) * height);
+    for (int y = 0; y < height; y++)
+    {
+        const unsigned char* row = &rgba[y * stride];
+        filtered.push_back(1);
+        for (size_t x = 0; x < stride; x++)
+        {
+            filtered.push_back(
+                    (unsigned char)(row[x] - (x >= 4 ? row[x - 4] : 0)));
+        }
+    }
+
+    std::vector<unsigned char> header(13, 0);
+    for (int i = 0; i < 4; i++)
+    {
+        header[i] = (unsigned char)(width >> (24 - 8 * i));
+        header[4 + i] = (unsigned char)(height >> (24 - 8 * i));
+    }
+    header[8] = 8;
+    header[9] = 6;
+
+    static const unsigned char signature[] = {0x89, 'P', 'N', 'G', '\r',
+        '\n', 0x1a, '\n'};
+    file.write((const char*)signature, sizeof(signature));
+    writeChunk(file, "IHDR", header);
+    writeChunk(file, "IDAT", compress(filtered));
+    writeChunk(file, "IEND", std::vector<unsigned char>());
+    return (bool)file;
+}
@@ -0,0 +1,82 @@
+#include "marching_cubes/progressive.h"
+#include "marching_cubes/marching_cubes.h"
+#include "marching_cubes/parallel.h"
+
+#include <algorithm>
+
+/*
+ * Fills a level of the nested lattice, whose sample (x, y, z) lies at sample
+ * stride * (x, y, z) of the full lattice. Samples of the full lattice are
+ * written back to it, and samples already taken by the level with twice the
+ * stride are copied from it instead of being evaluated again. Samples past
+ * the far side of the full lattice are only kept in the level.
+ */
+static void sampleLevel(SignedDistanceFunction* sdf, SampleLattice &full,
+        int stride, bool reuse, SampleLattice &level)
+{
+    parallelFor(0, level.size.z, [&](int z)
+    {
+        std::vector<glm::vec3> points(level.size.x);
+        std::vector<float> values(level.size.x);
+        std::vector<int> columns(level.size.x);
+        for (int y = 0; y < level.size.y; y++)
+        {
+            glm::ivec3 fine(0, y * stride, z * stride);
+            bool rowInside = fine.y < full.size.y && fine.z < full.size.z;
+
+            // Every other sample of every other row was taken by the
+            // previous level.
+            bool rowKnown = reuse && rowInside && y % 2 == 0 && z % 2 == 0;
+
+            int count = 0;
+            for (int x = 0; x < level.size.x; x++)
+            {
+                fine.x = x * stride;
+                bool inside = rowInside && fine.x < full.size.x;
+                if (rowKnown && inside && x % 2 == 0)
+                {
+                    level.values[level.index(x, y, z)]
+                        = full.value(fine.x, fine.y, fine.z);
+                    continue;
+                }
+                points[count] = full.position(fine.x, fine.y, fine.z);
+                columns[count] = x;
+                count++;
+            }
+
+            sdf->distances(points.data(), values.data(), count);
+            for (int i = 0; i < count; i++)
+            {
+                int x = columns[i];
+                level.values[level.index(x, y, z)] = values[i];
+                if (rowInside && x * stride < full.size.x)
+                {
+                    full.values[full.index(x * stride, fine.y, fine.z)]
+                        = values[i];
+                }
+            }
+        }
+    });
+}
+
+bool progressiveMarchingCubes(SignedDistanceFunction* sdf, glm::vec3 min,
+        glm::vec3 max, int resolution, int levels,
+        const RefinementCallback &callback)
+{
+    SampleLattice full = marchingCubesLattice(min, max, resolution);
+    for (int level = std::max(levels, 0); level >= 0; level--)
+    {
+        int stride = 1 << level;
+        glm::ivec3 size = (full.size - 1 + stride - 1) / stride + 1;
+        SampleLattice lattice(full.origin, full.step * (float)stride, size);
+        sampleLevel(sdf, full, stride, level < levels, lattice);
+
+        std::vector<glm::vec3> vertexBufferData;
+        polygonizeLattice(sdf, lattice, 0.0f, vertexBufferData);
+        if (!callback(vertexBufferData, stride))
+        {
+            return level == 0;
+        }
+    }
+    return true;
+}
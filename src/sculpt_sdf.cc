@@ -0,0 +1,203 @@
+#include "marching_cubes/sculpt_sdf.h"
+
+#include <algorithm>
+
+// Edits overlapping more bricks than this go in the list every point visits,
+// so a huge edit box doesn't fill the index.
+const float MAX_EDIT_BRICKS = 64.0f;
+
+// Smaller bricks would put every edit in that list.
+const float MIN_BRICK_SIZE = 1e-4f;
+
+/*
+ * The shape as of one moment, read without locking.
+ */
+class SculptSDF::Snapshot : public SignedDistanceFunction
+{
+    public:
+        Snapshot(SignedDistanceFunction* base, float brick,
+                std::shared_ptr<const EditIndex> edits)
+            : base(base), brick(brick), edits(edits) {}
+
+        float distance(glm::vec3 p)
+        {
+            float d = base->distance(p);
+            return edits->count > 0 ? apply(p, brickEdits(brickOf(p)), d)
+                : d;
+        }
+
+        void distances(const glm::vec3* points, float* out, int count)
+        {
+            base->distances(points, out, count);
+            if (edits->count == 0)
+            {
+                return;
+            }
+
+            // Neighbouring points are usually in the same brick.
+            glm::ivec3 key;
+            const EditList* local = nullptr;
+            for (int i = 0; i < count; i++)
+            {
+                glm::ivec3 next = brickOf(points[i]);
+                if (local == nullptr || next != key)
+                {
+                    key = next;
+                    local = &brickEdits(key);
+                }
+                out[i] = apply(points[i], *local, out[i]);
+            }
+        }
+
+    private:
+        glm::ivec3 brickOf(glm::vec3 p) const
+        {
+            return glm::ivec3(glm::floor(p / brick));
+        }
+
+        const EditList &brickEdits(glm::ivec3 key) const
+        {
+            static const EditList none;
+            const BrickMap &bricks = *edits->shards[shardOf(key)];
+            auto found = bricks.find(key);
+            return found != bricks.end() ? *found->second : none;
+        }
+
+        /*
+         * Applies the edits of a point's brick and the large edits, merged
+         * back into the order they were made.
+         */
+        float apply(glm::vec3 p, const EditList &local, float d) const
+        {
+            const EditList &large = *edits->large;
+            size_t i = 0;
+            size_t j = 0;
+            while (i < local.size() || j < large.size())
+            {
+                const Edit &edit = j == large.size()
+                    || (i < local.size() && local[i].order < large[j].order)
+                    ? local[i++] : large[j++];
+                if (glm::any(glm::lessThan(p, edit.min))
+                        || glm::any(glm::greaterThan(p, edit.max)))
+                {
+                    continue;
+                }
+                float e = edit.primitive->distance(p);
+                d = edit.subtract ? std::max(d, -e) : std::min(d, e);
+            }
+            return d;
+        }
+
+        SignedDistanceFunction* base;
+        float brick;
+        std::shared_ptr<const EditIndex> edits;
+};
+
+SculptSDF::SculptSDF(SignedDistanceFunction* base, float brickSize)
+    : base(base), brick(std::max(brickSize, MIN_BRICK_SIZE))
+{
+    std::shared_ptr<EditIndex> empty = std::make_shared<EditIndex>();
+    empty->shards.fill(std::make_shared<const BrickMap>());
+    empty->large = std::make_shared<const EditList>();
+    empty->count = 0;
+    edits = empty;
+}
+
+void SculptSDF::add(SignedDistanceFunction* primitive, glm::vec3 min,
+        glm::vec3 max)
+{
+    Edit edit = {primitive, min, max, false, 0};
+    append(edit);
+}
+
+void SculptSDF::subtract(SignedDistanceFunction* primitive, glm::vec3 min,
+        glm::vec3 max)
+{
+    Edit edit = {primitive, min, max, true, 0};
+    append(edit);
+}
+
+float SculptSDF::distance(glm::vec3 p)
+{
+    return Snapshot(base, brick, current()).distance(p);
+}
+
+void SculptSDF::distances(const glm::vec3* points, float* out, int count)
+{
+    Snapshot(base, brick, current()).distances(points, out, count);
+}
+
+std::shared_ptr<SignedDistanceFunction> SculptSDF::snapshot()
+{
+    return std::make_shared<Snapshot>(base, brick, current());
+}
+
+int SculptSDF::editCount() const
+{
+    return current()->count;
+}
+
+/*
+ * Replaces the index with one that has one more edit, so that threads still
+ * evaluating the old index are unaffected.
+ */
+void SculptSDF::append(Edit edit)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    std::shared_ptr<EditIndex> next = std::make_shared<EditIndex>(*edits);
+    edit.order = next->count++;
+
+    glm::vec3 first = glm::floor(edit.min / brick);
+    glm::vec3 last = glm::floor(edit.max / brick);
+    glm::vec3 span = glm::max(last - first + 1.0f, glm::vec3(0.0f));
+    if (span.x * span.y * span.z > MAX_EDIT_BRICKS)
+    {
+        std::shared_ptr<EditList> large =
+            std::make_shared<EditList>(*next->large);
+        large->push_back(edit);
+        next->large = large;
+    }
+    else
+    {
+        // Each shard the edit reaches is copied once, when first reached.
+        std::array<std::shared_ptr<BrickMap>, SHARDS> copies;
+        glm::ivec3 lo(first);
+        glm::ivec3 hi(last);
+        for (int z = lo.z; z <= hi.z; z++)
+        {
+            for (int y = lo.y; y <= hi.y; y++)
+            {
+                for (int x = lo.x; x <= hi.x; x++)
+                {
+                    glm::ivec3 key(x, y, z);
+                    int shard = shardOf(key);
+                    if (!copies[shard])
+                    {
+                        copies[shard] =
+                            std::make_shared<BrickMap>(*next->shards[shard]);
+                        next->shards[shard] = copies[shard];
+                    }
+                    std::shared_ptr<const EditList> &slot =
+                        (*copies[shard])[key];
+                    std::shared_ptr<EditList> list = slot
+                        ? std::make_shared<EditList>(*slot)
+                        : std::make_shared<EditList>();
+                    list->push_back(edit);
+                    slot = list;
+                }
+            }
+        }
+    }
+    edits = next;
+}
+
+int SculptSDF::shardOf(glm::ivec3 brick)
+{
+    return (int)(IVec3Hash()(brick) % SHARDS);
+}
+
+std::shared_ptr<const SculptSDF::EditIndex> SculptSDF::current() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return edits;
+}
@@ -1,5 +1,37 @@
 #include "marching_cubes/signed_distance_functions.h"
 
+#include "glm/gtc/constants.hpp"
+
+#include <algorithm>
+
+void SignedDistanceFunction::distances(const glm::vec3* points, float* out,
+        int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        out[i] = distance(points[i]);
+    }
+}
+
+glm::vec3 SignedDistanceFunction::gradient(glm::vec3 p)
+{
+    const float h = 0.0001f;
+    return (glm::vec3(1.0f, -1.0f, -1.0f)
+            * distance(p + glm::vec3( 1.0f, -1.0f, -1.0f) * h) +
+        glm::vec3(-1.0f, -1.0f, 1.0f)
+            * distance(p + glm::vec3(-1.0f, -1.0f,  1.0f) * h) +
+        glm::vec3(-1.0f, 1.0f, -1.0f)
+            * distance(p + glm::vec3(-1.0f,  1.0f, -1.0f) * h) +
+        glm::vec3(1.0f, 1.0f, 1.0f)
+            * distance(p + glm::vec3( 1.0f,  1.0f,  1.0f) * h)) / (4.0f * h);
+}
+
+std::shared_ptr<SignedDistanceFunction> SignedDistanceFunction::snapshot()
+{
+    return std::shared_ptr<SignedDistanceFunction>(this,
+            [](SignedDistanceFunction*) {});
+}
+
 SphereSDF::SphereSDF(glm::vec3 center, float radius) : c(center), r(radius) {}
 
 // Equation from iqulezlez.org/www/articles/distfunctions/distfunctions.htm
@@ -26,3 +58,90 @@ float TorusSDF::distance(glm::vec3 p)
     glm::vec2 q(glm::length(glm::vec2(p.x, p.z)) - r.x, p.y);
     return glm::length(q) - r.y;
 }
+
+/*
+ * Returns the minimum of an SDF over the grid cells id + k * side for every k
+ * in {0, 1}^3 (or just id when neighbours is false). The cell indices are
+ * clamped to [-limits, limits].
+ */
+static float repeatedDistance(SignedDistanceFunction* sdf, glm::vec3 p,
+        glm::vec3 period, glm::vec3 limits, bool neighbours)
+{
+    // Axes without a period are left in place by giving them a single cell.
+    glm::vec3 safePeriod = glm::max(period, glm::vec3(1e-30f));
+    glm::vec3 repeated = glm::vec3(glm::greaterThan(period, glm::vec3(0.0f)));
+    glm::vec3 id = glm::clamp(glm::round(p * repeated / safePeriod), -limits,
+            limits);
+    glm::vec3 side = glm::sign(p - period * id) * repeated;
+
+    float d = sdf->distance(p - period * id);
+    if (neighbours)
+    {
+        for (int k = 1; k < 8; k++)
+        {
+            glm::vec3 offset = glm::vec3(k & 1, (k >> 1) & 1, k >> 2) * side;
+            if (offset == glm::vec3(0.0f))
+            {
+                continue;
+            }
+            glm::vec3 neighbour = glm::clamp(id + offset, -limits, limits);
+            if (neighbour != id)
+            {
+                d = glm::min(d, sdf->distance(p - period * neighbour));
+            }
+        }
+    }
+    return d;
+}
+
+RepeatSDF::RepeatSDF(SignedDistanceFunction* sdf, glm::vec3 period,
+        bool neighbours)
+    : child(sdf), s(period), n(neighbours) {}
+
+// Technique from iquilezles.org/articles/sdfrepetition
+float RepeatSDF::distance(glm::vec3 p)
+{
+    return repeatedDistance(child, p, s, glm::vec3(1e30f), n);
+}
+
+LimitedRepeatSDF::LimitedRepeatSDF(SignedDistanceFunction* sdf,
+        glm::vec3 period, glm::ivec3 limits, bool neighbours)
+    : child(sdf), s(period), l(limits), n(neighbours) {}
+
+// Technique from iquilezles.org/articles/sdfrepetition
+float LimitedRepeatSDF::distance(glm::vec3 p)
+{
+    return repeatedDistance(child, p, s, l, n);
+}
+
+PolarRepeatSDF::PolarRepeatSDF(SignedDistanceFunction* sdf, int count,
+        bool neighbours)
+    : child(sdf), c(std::max(count, 1)), n(neighbours) {}
+
+float PolarRepeatSDF::distance(glm::vec3 p)
+{
+    // Rotate the query back into sector 0 about the y axis.
+    float sector = 2.0f * glm::pi<float>() / c;
+    float angle = std::atan2(p.z, p.x);
+    float id = glm::round(angle / sector);
+    float radius = glm::length(glm::vec2(p.x, p.z));
+
+    float a = angle - id * sector;
+    float d = child->distance(
+            glm::vec3(radius * std::cos(a), p.y, radius * std::sin(a)));
+    if (n && c > 1)
+    {
+        a -= (a < 0.0f ? -1.0f : 1.0f) * sector;
+        d = glm::min(d, child->distance(
+                    glm::vec3(radius * std::cos(a), p.y, radius * std::sin(a))));
+    }
+    return d;
+}
+
+MirrorSDF::MirrorSDF(SignedDistanceFunction* sdf, glm::bvec3 axes)
+    : child(sdf), a(axes) {}
+
+float MirrorSDF::distance(glm::vec3 p)
+{
+    return child->distance(glm::mix(p, glm::abs(p), glm::vec3(a)));
+}
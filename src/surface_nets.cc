@@ -0,0 +1,182 @@
+#include "marching_cubes/surface_nets.h"
+#include "marching_cubes/parallel.h"
+
+#include <array>
+#include <utility>
+
+void dualQuads(const SampleLattice &lattice, float isolevel,
+        const std::vector<int> &cubeVertices,
+        std::vector<unsigned int> &indexBufferData)
+{
+    glm::ivec3 cubes = lattice.size - 1;
+    auto cube = [&](int x, int y, int z)
+    {
+        return cubeVertices[(z * cubes.y + y) * cubes.x + x];
+    };
+
+    // The 4 cubes around an edge along each axis, relative to the edge's
+    // lower sample and ordered counterclockwise about the axis.
+    const glm::ivec3 around[3][4] = {
+        {glm::ivec3(0, -1, -1), glm::ivec3(0, 0, -1), glm::ivec3(0, 0, 0),
+            glm::ivec3(0, -1, 0)},
+        {glm::ivec3(-1, 0, -1), glm::ivec3(-1, 0, 0), glm::ivec3(0, 0, 0),
+            glm::ivec3(0, 0, -1)},
+        {glm::ivec3(-1, -1, 0), glm::ivec3(0, -1, 0), glm::ivec3(0, 0, 0),
+            glm::ivec3(-1, 0, 0)}};
+
+    // Edges are grouped by the slice of their lower sample, and each slice
+    // fills its own buffer.
+    std::vector<std::vector<unsigned int>> slices(lattice.size.z);
+    parallelFor(0, lattice.size.z, [&](int z)
+    {
+        for (int y = 0; y < lattice.size.y; y++)
+        {
+            for (int x = 0; x < lattice.size.x; x++)
+            {
+                bool inside = lattice.value(x, y, z) < isolevel;
+                for (int axis = 0; axis < 3; axis++)
+                {
+                    glm::ivec3 next(x, y, z);
+                    next[axis]++;
+                    if (next[axis] >= lattice.size[axis]
+                            || (lattice.value(next.x, next.y, next.z)
+                                < isolevel) == inside)
+                    {
+                        continue;
+                    }
+
+                    std::array<int, 4> quad;
+                    bool complete = true;
+                    for (int i = 0; i < 4 && complete; i++)
+                    {
+                        glm::ivec3 c = glm::ivec3(x, y, z) + around[axis][i];
+                        complete = glm::all(glm::greaterThanEqual(c,
+                                    glm::ivec3(0)))
+                            && glm::all(glm::lessThan(c, cubes));
+                        quad[i] = complete ? cube(c.x, c.y, c.z) : -1;
+                    }
+                    if (!complete)
+                    {
+                        continue;
+                    }
+
+                    // Quads are wound clockwise seen from above the
+                    // isolevel, like marching cubes' triangles.
+                    if (inside)
+                    {
+                        std::swap(quad[1], quad[3]);
+                    }
+                    std::vector<unsigned int> &out = slices[z];
+                    out.push_back(quad[0]);
+                    out.push_back(quad[1]);
+                    out.push_back(quad[2]);
+                    out.push_back(quad[0]);
+                    out.push_back(quad[2]);
+                    out.push_back(quad[3]);
+                }
+            }
+        }
+    });
+
+    for (const std::vector<unsigned int> &slice : slices)
+    {
+        indexBufferData.insert(indexBufferData.end(), slice.begin(),
+                slice.end());
+    }
+}
+
+void mergeSlices(const std::vector<std::vector<glm::vec3>> &slices,
+        glm::ivec3 cubes, std::vector<int> &cubeVertices,
+        std::vector<glm::vec3> &vertexBufferData)
+{
+    std::vector<int> sliceOffsets(cubes.z);
+    int base = (int)vertexBufferData.size() / 2;
+    for (int z = 0; z < cubes.z; z++)
+    {
+        sliceOffsets[z] = base;
+        base += (int)slices[z].size() / 2;
+        vertexBufferData.insert(vertexBufferData.end(), slices[z].begin(),
+                slices[z].end());
+    }
+    parallelFor(0, cubes.z, [&](int z)
+    {
+        int* slice = &cubeVertices[(size_t)z * cubes.y * cubes.x];
+        for (int i = 0; i < cubes.y * cubes.x; i++)
+        {
+            if (slice[i] >= 0)
+            {
+                slice[i] += sliceOffsets[z];
+            }
+        }
+    });
+}
+
+void surfaceNetsLattice(SignedDistanceFunction* sdf,
+        const SampleLattice &lattice, float isolevel,
+        std::vector<glm::vec3> &vertexBufferData,
+        std::vector<unsigned int> &indexBufferData)
+{
+    glm::ivec3 cubes = lattice.size - 1;
+    if (cubes.x <= 0 || cubes.y <= 0 || cubes.z <= 0)
+    {
+        return;
+    }
+
+    // Place one vertex in every cube the surface passes through. Each slice
+    // of cubes numbers its vertices locally, then the slices are offset.
+    std::vector<int> cubeVertices((size_t)cubes.x * cubes.y * cubes.z, -1);
+    std::vector<std::vector<glm::vec3>> slices(cubes.z);
+    parallelFor(0, cubes.z, [&](int z)
+    {
+        std::array<glm::vec4, 8> corners;
+        for (int y = 0; y < cubes.y; y++)
+        {
+            for (int x = 0; x < cubes.x; x++)
+            {
+                int inside = 0;
+                for (int n = 0; n < 8; n++)
+                {
+                    glm::ivec3 c = glm::ivec3(x, y, z) + cornerOffsets[n];
+                    corners[n] = glm::vec4(lattice.position(c.x, c.y, c.z),
+                            lattice.value(c.x, c.y, c.z));
+                    inside += corners[n].w < isolevel ? 1 : 0;
+                }
+                if (inside == 0 || inside == 8)
+                {
+                    continue;
+                }
+
+                glm::vec3 sum(0.0f);
+                int crossings = 0;
+                for (const std::array<int, 2> &edge : edgeCorners)
+                {
+                    glm::vec4 a = corners[edge[0]];
+                    glm::vec4 b = corners[edge[1]];
+                    if ((a.w < isolevel) != (b.w < isolevel))
+                    {
+                        sum += interpolateVertex(a, b, isolevel);
+                        crossings++;
+                    }
+                }
+
+                glm::vec3 vertex = sum / (float)crossings;
+                cubeVertices[(z * cubes.y + y) * cubes.x + x] =
+                    (int)slices[z].size() / 2;
+                slices[z].push_back(vertex);
+                slices[z].push_back(vertexNormal(sdf, vertex));
+            }
+        }
+    });
+
+    mergeSlices(slices, cubes, cubeVertices, vertexBufferData);
+    dualQuads(lattice, isolevel, cubeVertices, indexBufferData);
+}
+
+void surfaceNets(SignedDistanceFunction* sdf, glm::vec3 min, glm::vec3 max,
+        int resolution, std::vector<glm::vec3> &vertexBufferData,
+        std::vector<unsigned int> &indexBufferData)
+{
+    SampleLattice lattice = marchingCubesLattice(min, max, resolution);
+    sampleLattice(sdf, lattice);
+    surfaceNetsLattice(sdf, lattice, 0.0f, vertexBufferData, indexBufferData);
+}
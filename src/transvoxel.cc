@@ -0,0 +1,568 @@
+#include "marching_cubes/transvoxel.h"
+#include "marching_cubes/ivec3_hash.h"
+#include "marching_cubes/marching_cubes.h"
+
+#include <algorithm>
+#include <array>
+#include <unordered_set>
+
+// The faces of a transition cell, as indices into its 13 corners. Corners 0-8
+// are the finer neighbour's 3x3 samples on the chunk's face, numbered a + 3b
+// across the face, and corners 9-12 are the chunk's own samples pulled
+// inwards, numbered 9 + a + 2b. The first 4 faces are the outer face, the
+// next is the inner face and the last 4 are the sides. Each runs
+// counterclockwise seen from outside the cell when the a and b axes and the
+// inward direction form a right-handed frame.
+static const int transitionFaces[9][5] = {
+    {0, 3, 4, 1, -1}, {1, 4, 5, 2, -1}, {3, 6, 7, 4, -1}, {4, 7, 8, 5, -1},
+    {9, 10, 12, 11, -1},
+    {0, 1, 2, 10, 9}, {2, 5, 8, 12, 10}, {8, 7, 6, 11, 12}, {6, 3, 0, 9, 11}};
+
+static const int TRANSITION_CORNERS = 13;
+
+/*
+ * Returns floor(a / b) for each component and a positive b.
+ */
+static glm::ivec3 floorDiv(glm::ivec3 a, int b)
+{
+    glm::ivec3 q;
+    for (int i = 0; i < 3; i++)
+    {
+        q[i] = a[i] >= 0 ? a[i] / b : -((-a[i] + b - 1) / b);
+    }
+    return q;
+}
+
+/*
+ * Appends a triangle unless two of its vertices are at the same place, which
+ * happens when crossings next to a sample on the isolevel all snap onto it.
+ * Once the chunks are welded, such a triangle would use one of its edges
+ * twice.
+ */
+static void addTriangle(const std::vector<glm::vec3> &vertexBufferData,
+        std::vector<unsigned int> &indexBufferData, int a, int b, int c)
+{
+    const glm::vec3 &p = vertexBufferData[2 * (size_t)a];
+    const glm::vec3 &q = vertexBufferData[2 * (size_t)b];
+    const glm::vec3 &r = vertexBufferData[2 * (size_t)c];
+    if (p == q || q == r || r == p)
+    {
+        return;
+    }
+    indexBufferData.push_back(a);
+    indexBufferData.push_back(b);
+    indexBufferData.push_back(c);
+}
+
+/*
+ * Stores the surface inside a transition cell. Walking each face with its
+ * outside towards the viewer, every run of corners below the isolevel is
+ * closed off by a segment joining the crossings at either end, so the
+ * segments of all faces link up into loops around the cell, which are then
+ * filled with triangles. mirrored is set when the cell's frame is
+ * left-handed. The faces' winding can't be worked out from the corners, as
+ * cells along some chunk edges have flat sides.
+ */
+static void polygonizeTransitionCell(SignedDistanceFunction* sdf,
+        const std::array<glm::vec4, TRANSITION_CORNERS> &corners,
+        bool mirrored, std::vector<glm::vec3> &vertexBufferData,
+        std::vector<unsigned int> &indexBufferData)
+{
+    const int keys = TRANSITION_CORNERS * TRANSITION_CORNERS;
+    std::array<int, keys> vertexOf;
+    std::array<int, keys> next;
+    vertexOf.fill(-1);
+    next.fill(-1);
+
+    auto addVertex = [&](glm::vec3 vertex)
+    {
+        vertexBufferData.push_back(vertex);
+        vertexBufferData.push_back(vertexNormal(sdf, vertex));
+        return (int)vertexBufferData.size() / 2 - 1;
+    };
+
+    // Crossings are keyed by their edge's corners, lowest first, which is
+    // also the order shared edges are interpolated in by the regular cells and
+    // the finer neighbour.
+    auto crossing = [&](int p, int q)
+    {
+        int key = std::min(p, q) * TRANSITION_CORNERS + std::max(p, q);
+        if (vertexOf[key] < 0)
+        {
+            vertexOf[key] = addVertex(interpolateVertex(
+                        corners[std::min(p, q)], corners[std::max(p, q)],
+                        0.0f));
+        }
+        return key;
+    };
+
+    for (const int* face : transitionFaces)
+    {
+        int verts[5];
+        int m = 0;
+        for (; m < 5 && face[m] >= 0; m++)
+        {
+            verts[m] = face[m];
+        }
+        if (mirrored)
+        {
+            std::reverse(verts, verts + m);
+        }
+
+        int crossings = 0;
+        int crossingKeys[5];
+        bool leaving[5];
+        float mean = 0.0f;
+        for (int k = 0; k < m; k++)
+        {
+            int p = verts[k];
+            int q = verts[(k + 1) % m];
+            mean += corners[p].w / m;
+            if ((corners[p].w < 0.0f) != (corners[q].w < 0.0f))
+            {
+                crossingKeys[crossings] = crossing(p, q);
+                leaving[crossings] = corners[p].w < 0.0f;
+                crossings++;
+            }
+        }
+
+        // A face with 4 crossings is ambiguous. The corners below the
+        // isolevel are joined across it when its mean value is too.
+        bool joined = mean < 0.0f;
+        for (int t = 0; t < crossings; t++)
+        {
+            if (leaving[t])
+            {
+                int partner = joined ? (t + 1) % crossings
+                    : (t + crossings - 1) % crossings;
+                next[crossingKeys[t]] = crossingKeys[partner];
+            }
+        }
+    }
+
+    std::array<bool, keys> visited;
+    visited.fill(false);
+    std::vector<int> loop;
+    for (int key = 0; key < keys; key++)
+    {
+        if (next[key] < 0 || visited[key])
+        {
+            continue;
+        }
+
+        loop.clear();
+        int k = key;
+        while (k >= 0 && !visited[k])
+        {
+            visited[k] = true;
+            loop.push_back(vertexOf[k]);
+            k = next[k];
+        }
+        if (k != key || loop.size() < 3)
+        {
+            continue;
+        }
+
+        // The loops run clockwise seen from above the isolevel, the same
+        // way as marching cubes' triangles.
+        auto triangle = [&](int a, int b, int c)
+        {
+            addTriangle(vertexBufferData, indexBufferData, a, b, c);
+        };
+        auto position = [&](int v)
+        {
+            return vertexBufferData[2 * (size_t)v];
+        };
+
+        if (loop.size() == 3)
+        {
+            triangle(loop[0], loop[1], loop[2]);
+        }
+        else if (loop.size() == 4)
+        {
+            if (glm::length(position(loop[0]) - position(loop[2]))
+                    < glm::length(position(loop[1]) - position(loop[3])))
+            {
+                triangle(loop[0], loop[1], loop[2]);
+                triangle(loop[0], loop[2], loop[3]);
+            }
+            else
+            {
+                triangle(loop[0], loop[1], loop[3]);
+                triangle(loop[1], loop[2], loop[3]);
+            }
+        }
+        else
+        {
+            glm::vec3 centroid(0.0f);
+            for (int v : loop)
+            {
+                centroid += position(v) / (float)loop.size();
+            }
+            int c = addVertex(centroid);
+            for (size_t i = 0; i < loop.size(); i++)
+            {
+                triangle(c, loop[i], loop[(i + 1) % loop.size()]);
+            }
+        }
+    }
+}
+
+TransvoxelMesher::TransvoxelMesher(SignedDistanceFunction* sdf,
+        glm::vec3 origin, float voxelSize, int chunkCells,
+        float transitionWidth)
+    : sdf(sdf), o(origin), size(voxelSize), n(chunkCells),
+      w(transitionWidth) {}
+
+glm::vec3 TransvoxelMesher::chunkMin(const LODChunk &chunk) const
+{
+    return o + size * glm::vec3(chunk.position * n * (1 << chunk.level));
+}
+
+float TransvoxelMesher::chunkSize(int level) const
+{
+    return size * n * (1 << level);
+}
+
+void TransvoxelMesher::mesh(const LODChunk &chunk,
+        std::vector<glm::vec3> &vertexBufferData,
+        std::vector<unsigned int> &indexBufferData) const
+{
+    int u = 1 << chunk.level;
+    int transitions = chunk.level > 0 ? chunk.transitions : 0;
+    int s = n + 1;
+    glm::ivec3 g0 = chunk.position * n * u;
+
+    auto world = [&](glm::ivec3 g)
+    {
+        return o + size * glm::vec3(g);
+    };
+
+    // Where the chunk's sample i is placed, with the samples on transition
+    // faces pulled inwards to make room for the transition cells. Samples
+    // that also lie on a face shared with a chunk of the same level stay put,
+    // as that chunk doesn't know about the transition; the transition cells
+    // along that edge then taper to nothing.
+    auto samplePosition = [&](glm::ivec3 i)
+    {
+        glm::ivec3 g = g0 + i * u;
+        glm::vec3 p = world(g);
+        int plainFaces = 0;
+        for (int d = 0; d < 3; d++)
+        {
+            if ((i[d] == 0 && (transitions & (1 << 2 * d)) == 0)
+                    || (i[d] == n && (transitions & (2 << 2 * d)) == 0))
+            {
+                plainFaces |= 1 << d;
+            }
+        }
+        for (int d = 0; d < 3; d++)
+        {
+            if ((plainFaces & ~(1 << d)) != 0)
+            {
+                continue;
+            }
+            if (i[d] == 0 && (transitions & (1 << 2 * d)) != 0)
+            {
+                p[d] = o[d] + size * ((float)g[d] + u * w);
+            }
+            else if (i[d] == n && (transitions & (2 << 2 * d)) != 0)
+            {
+                p[d] = o[d] + size * ((float)g[d] - u * w);
+            }
+        }
+        return p;
+    };
+
+    std::vector<float> values((size_t)s * s * s);
+    std::vector<glm::vec3> points(2 * n + 1);
+    for (int z = 0; z < s; z++)
+    {
+        for (int y = 0; y < s; y++)
+        {
+            for (int x = 0; x < s; x++)
+            {
+                points[x] = world(g0 + glm::ivec3(x, y, z) * u);
+            }
+            sdf->distances(points.data(), &values[(z * s + y) * s], s);
+        }
+    }
+    auto index = [&](glm::ivec3 i)
+    {
+        return (i.z * s + i.y) * s + i.x;
+    };
+
+    // Regular cells share one vertex per crossed lattice edge, numbered by
+    // the edge's lower sample and axis.
+    std::vector<int> edgeVertices((size_t)s * s * s * 3, -1);
+    for (int z = 0; z < s; z++)
+    {
+        for (int y = 0; y < s; y++)
+        {
+            for (int x = 0; x < s; x++)
+            {
+                glm::ivec3 i(x, y, z);
+                float a = values[index(i)];
+                for (int axis = 0; axis < 3; axis++)
+                {
+                    glm::ivec3 j = i;
+                    j[axis]++;
+                    if (j[axis] > n || (a < 0.0f) == (values[index(j)] < 0.0f))
+                    {
+                        continue;
+                    }
+
+                    glm::vec3 vertex = interpolateVertex(
+                            glm::vec4(samplePosition(i), a),
+                            glm::vec4(samplePosition(j), values[index(j)]),
+                            0.0f);
+                    edgeVertices[index(i) * 3 + axis] =
+                        (int)vertexBufferData.size() / 2;
+                    vertexBufferData.push_back(vertex);
+                    vertexBufferData.push_back(vertexNormal(sdf, vertex));
+                }
+            }
+        }
+    }
+
+    glm::ivec3 edgeLower[12];
+    int edgeAxis[12];
+    for (int e = 0; e < 12; e++)
+    {
+        glm::ivec3 a = cornerOffsets[edgeCorners[e][0]];
+        glm::ivec3 b = cornerOffsets[edgeCorners[e][1]];
+        edgeLower[e] = glm::min(a, b);
+        edgeAxis[e] = a.x != b.x ? 0 : (a.y != b.y ? 1 : 2);
+    }
+
+    for (int z = 0; z < n; z++)
+    {
+        for (int y = 0; y < n; y++)
+        {
+            for (int x = 0; x < n; x++)
+            {
+                glm::ivec3 cell(x, y, z);
+                int cubeIndex = 0;
+                for (int c = 0; c < 8; c++)
+                {
+                    if (values[index(cell + cornerOffsets[c])] < 0.0f)
+                    {
+                        cubeIndex |= 1 << c;
+                    }
+                }
+                for (int t = 0; triTable[cubeIndex][t] != -1; t += 3)
+                {
+                    int v[3];
+                    for (int k = 0; k < 3; k++)
+                    {
+                        int e = triTable[cubeIndex][t + k];
+                        v[k] = edgeVertices[
+                            index(cell + edgeLower[e]) * 3 + edgeAxis[e]];
+                    }
+                    addTriangle(vertexBufferData, indexBufferData,
+                            v[0], v[1], v[2]);
+                }
+            }
+        }
+    }
+
+    // Fill the gap left on each transition face with transition cells.
+    int f = 2 * n + 1;
+    std::vector<float> fineValues((size_t)f * f);
+    for (int d = 0; d < 3; d++)
+    {
+        for (int side = 0; side < 2; side++)
+        {
+            if ((transitions & (1 << (2 * d + side))) == 0)
+            {
+                continue;
+            }
+
+            int a1 = (d + 1) % 3;
+            int a2 = (d + 2) % 3;
+            auto fineSample = [&](int a, int b)
+            {
+                glm::ivec3 g = g0;
+                g[d] += side * n * u;
+                g[a1] += a * u / 2;
+                g[a2] += b * u / 2;
+                return g;
+            };
+            for (int b = 0; b < f; b++)
+            {
+                for (int a = 0; a < f; a++)
+                {
+                    points[a] = world(fineSample(a, b));
+                }
+                sdf->distances(points.data(), &fineValues[b * f], f);
+            }
+
+            std::array<glm::vec4, TRANSITION_CORNERS> corners;
+            for (int j = 0; j < n; j++)
+            {
+                for (int i = 0; i < n; i++)
+                {
+                    for (int c = 0; c < 9; c++)
+                    {
+                        int a = 2 * i + c % 3;
+                        int b = 2 * j + c / 3;
+                        corners[c] = glm::vec4(world(fineSample(a, b)),
+                                fineValues[b * f + a]);
+                    }
+                    for (int c = 0; c < 4; c++)
+                    {
+                        glm::ivec3 sample;
+                        sample[d] = side * n;
+                        sample[a1] = i + c % 2;
+                        sample[a2] = j + c / 2;
+                        corners[9 + c] = glm::vec4(samplePosition(sample),
+                                values[index(sample)]);
+                    }
+                    polygonizeTransitionCell(sdf, corners, side == 1,
+                            vertexBufferData, indexBufferData);
+                }
+            }
+        }
+    }
+}
+
+std::vector<LODChunk> TransvoxelMesher::selectChunks(glm::vec3 viewer,
+        glm::ivec3 minRoot, glm::ivec3 maxRoot, int maxLevel,
+        float detail) const
+{
+    std::vector<std::unordered_set<glm::ivec3, IVec3Hash>> leaves(
+            maxLevel + 1);
+
+    std::vector<LODChunk> pending;
+    for (int z = minRoot.z; z <= maxRoot.z; z++)
+    {
+        for (int y = minRoot.y; y <= maxRoot.y; y++)
+        {
+            for (int x = minRoot.x; x <= maxRoot.x; x++)
+            {
+                LODChunk root = {glm::ivec3(x, y, z), maxLevel, 0};
+                pending.push_back(root);
+            }
+        }
+    }
+    while (!pending.empty())
+    {
+        LODChunk chunk = pending.back();
+        pending.pop_back();
+        glm::vec3 lo = chunkMin(chunk);
+        float extent = chunkSize(chunk.level);
+        glm::vec3 closest = glm::clamp(viewer, lo, lo + extent);
+        if (chunk.level > 0 && glm::length(viewer - closest) < detail * extent)
+        {
+            for (int c = 0; c < 8; c++)
+            {
+                LODChunk child = {chunk.position * 2
+                    + glm::ivec3(c & 1, (c >> 1) & 1, c >> 2),
+                    chunk.level - 1, 0};
+                pending.push_back(child);
+            }
+        }
+        else
+        {
+            leaves[chunk.level].insert(chunk.position);
+        }
+    }
+
+    // The level of the leaf covering chunk p of a level, or -1 if that space
+    // is covered by finer chunks or lies outside the roots.
+    auto coveringLevel = [&](glm::ivec3 p, int level)
+    {
+        for (int l = level; l <= maxLevel; l++)
+        {
+            if (leaves[l].count(floorDiv(p, 1 << (l - level))) != 0)
+            {
+                return l;
+            }
+        }
+        return -1;
+    };
+    auto insideRoots = [&](glm::ivec3 p, int level)
+    {
+        glm::ivec3 root = floorDiv(p, 1 << (maxLevel - level));
+        return glm::all(glm::greaterThanEqual(root, minRoot))
+            && glm::all(glm::lessThanEqual(root, maxRoot));
+    };
+    auto faceNeighbour = [](glm::ivec3 p, int face)
+    {
+        p[face / 2] += face % 2 == 0 ? -1 : 1;
+        return p;
+    };
+
+    // Split any leaf more than one level coarser than a neighbour until none
+    // are left. Splits only ever make leaves finer, so this terminates.
+    for (bool changed = true; changed; )
+    {
+        changed = false;
+        for (int level = 0; level + 2 <= maxLevel; level++)
+        {
+            std::vector<glm::ivec3> current(leaves[level].begin(),
+                    leaves[level].end());
+            for (const glm::ivec3 &p : current)
+            {
+                for (int face = 0; face < 6; face++)
+                {
+                    glm::ivec3 q = faceNeighbour(p, face);
+                    if (!insideRoots(q, level))
+                    {
+                        continue;
+                    }
+                    int l = coveringLevel(q, level);
+                    if (l > level + 1)
+                    {
+                        glm::ivec3 coarse = floorDiv(q, 1 << (l - level));
+                        leaves[l].erase(coarse);
+                        for (int c = 0; c < 8; c++)
+                        {
+                            leaves[l - 1].insert(coarse * 2
+                                    + glm::ivec3(c & 1, (c >> 1) & 1, c >> 2));
+                        }
+                        changed = true;
+                    }
+                }
+            }
+        }
+    }
+
+    std::vector<LODChunk> chunks;
+    for (int level = maxLevel; level >= 0; level--)
+    {
+        for (const glm::ivec3 &p : leaves[level])
+        {
+            LODChunk chunk = {p, level, 0};
+            for (int face = 0; face < 6 && level > 0; face++)
+            {
+                glm::ivec3 q = faceNeighbour(p, face);
+                if (insideRoots(q, level) && coveringLevel(q, level) < 0)
+                {
+                    chunk.transitions |= 1 << face;
+                }
+            }
+            chunks.push_back(chunk);
+        }
+    }
+
+    // Sort within each level so the result doesn't depend on hash order.
+    std::sort(chunks.begin(), chunks.end(),
+            [](const LODChunk &a, const LODChunk &b)
+            {
+                if (a.level != b.level)
+                {
+                    return a.level > b.level;
+                }
+                if (a.position.z != b.position.z)
+                {
+                    return a.position.z < b.position.z;
+                }
+                if (a.position.y != b.position.y)
+                {
+                    return a.position.y < b.position.y;
+                }
+                return a.position.x < b.position.x;
+            });
+    return chunks;
+}
@@ -0,0 +1,346 @@
+#include "marching_cubes/tsdf_volume.h"
+#include "marching_cubes/marching_cubes.h"
+#include "marching_cubes/parallel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <utility>
+
+// Caps the weight of a voxel so that the volume can still follow changes in
+// the scene after many frames.
+const float MAX_WEIGHT = 64.0f;
+
+bool loadDepthImage(const std::string &path, float scale, DepthImage &image)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+    {
+        return false;
+    }
+
+    // The header is the magic number, width, height and maximum value,
+    // separated by whitespace and possibly interleaved with # comments.
+    std::string magic;
+    file >> magic;
+    if (magic != "P5")
+    {
+        return false;
+    }
+    int header[3];
+    for (int i = 0; i < 3; i++)
+    {
+        file >> std::ws;
+        while (file.peek() == '#')
+        {
+            std::string comment;
+            std::getline(file, comment);
+            file >> std::ws;
+        }
+        file >> header[i];
+    }
+    file.get();
+    if (!file || header[0] <= 0 || header[1] <= 0 || header[2] <= 0
+            || header[2] > 65535)
+    {
+        return false;
+    }
+
+    image.width = header[0];
+    image.height = header[1];
+    int bytesPerPixel = header[2] > 255 ? 2 : 1;
+    std::vector<unsigned char> raw(
+            (size_t)image.width * image.height * bytesPerPixel);
+    file.read((char*)raw.data(), raw.size());
+    if (!file)
+    {
+        return false;
+    }
+
+    // 16-bit samples are stored most significant byte first.
+    image.depth.resize((size_t)image.width * image.height);
+    for (size_t i = 0; i < image.depth.size(); i++)
+    {
+        int value = bytesPerPixel == 2
+            ? (raw[2 * i] << 8) | raw[2 * i + 1]
+            : raw[i];
+        image.depth[i] = value * scale;
+    }
+    return true;
+}
+
+/*
+ * Returns floor(a / b) for a positive b.
+ */
+static int floorDiv(int a, int b)
+{
+    return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+TSDFVolume::TSDFVolume(float voxelSize, float truncation)
+    : size(voxelSize), trunc(truncation) {}
+
+int TSDFVolume::integrate(const DepthImage &image,
+        const CameraIntrinsics &intrinsics, const glm::mat4 &cameraToWorld)
+{
+    float brickWorldSize = size * BRICK_SIZE;
+
+    // Find the bricks within the truncation band of every measurement by
+    // walking each pixel's ray through the band. Rows are walked in parallel.
+    std::vector<std::vector<glm::ivec3>> rowBricks(image.height);
+    parallelFor(0, image.height, [&](int v)
+    {
+        std::unordered_set<glm::ivec3, IVec3Hash> seen;
+        for (int u = 0; u < image.width; u++)
+        {
+            float d = image.depth[(size_t)v * image.width + u];
+            if (!(d > 0.0f) || !std::isfinite(d))
+            {
+                continue;
+            }
+
+            glm::vec3 ray((u - intrinsics.cx) / intrinsics.fx,
+                    (v - intrinsics.cy) / intrinsics.fy, 1.0f);
+            float near = std::max(d - trunc, 0.0f);
+            float far = d + trunc;
+            float stepLength = 0.5f * brickWorldSize / glm::length(ray);
+            for (float z = near; ; z += stepLength)
+            {
+                z = std::min(z, far);
+                glm::vec3 world = glm::vec3(cameraToWorld
+                        * glm::vec4(ray * z, 1.0f));
+                glm::ivec3 key(glm::floor(world / brickWorldSize));
+                if (seen.insert(key).second)
+                {
+                    rowBricks[v].push_back(key);
+                }
+                if (z >= far)
+                {
+                    break;
+                }
+            }
+        }
+    });
+
+    // Allocation changes the map, so it happens on one thread. Pointers to
+    // bricks stay valid as the map grows.
+    std::unordered_set<glm::ivec3, IVec3Hash> touched;
+    for (const std::vector<glm::ivec3> &row : rowBricks)
+    {
+        touched.insert(row.begin(), row.end());
+    }
+    std::vector<std::pair<glm::ivec3, Brick*>> frameBricks;
+    frameBricks.reserve(touched.size());
+    for (const glm::ivec3 &key : touched)
+    {
+        auto inserted = bricks.insert(std::make_pair(key, Brick()));
+        if (inserted.second)
+        {
+            Voxel empty = {trunc, 0.0f};
+            inserted.first->second.fill(empty);
+        }
+        frameBricks.push_back(std::make_pair(key, &inserted.first->second));
+    }
+
+    // Update each touched voxel with the projective distance to the
+    // measured surface, as a running weighted average.
+    glm::mat4 worldToCamera = glm::inverse(cameraToWorld);
+    parallelFor(0, (int)frameBricks.size(), [&](int b)
+    {
+        glm::ivec3 origin = frameBricks[b].first * BRICK_SIZE;
+        Brick &brick = *frameBricks[b].second;
+        for (int z = 0, i = 0; z < BRICK_SIZE; z++)
+        {
+            for (int y = 0; y < BRICK_SIZE; y++)
+            {
+                for (int x = 0; x < BRICK_SIZE; x++, i++)
+                {
+                    glm::vec3 world = glm::vec3(origin + glm::ivec3(x, y, z))
+                        * size;
+                    glm::vec3 camera = glm::vec3(worldToCamera
+                            * glm::vec4(world, 1.0f));
+                    if (camera.z <= 0.0f)
+                    {
+                        continue;
+                    }
+
+                    int u = (int)std::floor(intrinsics.fx * camera.x / camera.z
+                            + intrinsics.cx + 0.5f);
+                    int v = (int)std::floor(intrinsics.fy * camera.y / camera.z
+                            + intrinsics.cy + 0.5f);
+                    if (u < 0 || v < 0 || u >= image.width
+                            || v >= image.height)
+                    {
+                        continue;
+                    }
+
+                    float d = image.depth[(size_t)v * image.width + u];
+                    if (!(d > 0.0f) || !std::isfinite(d))
+                    {
+                        continue;
+                    }
+
+                    // Voxels far behind the surface are occluded and left
+                    // alone.
+                    float sdf = d - camera.z;
+                    if (sdf < -trunc)
+                    {
+                        continue;
+                    }
+
+                    Voxel &voxel = brick[i];
+                    float weight = voxel.weight + 1.0f;
+                    voxel.distance = (voxel.distance * voxel.weight
+                            + std::min(sdf, trunc)) / weight;
+                    voxel.weight = std::min(weight, MAX_WEIGHT);
+                }
+            }
+        }
+    });
+
+    // A brick's cubes reach one sample into its +x, +y and +z neighbours, so
+    // the neighbours on the other side of a changed brick need re-meshing
+    // too.
+    for (const glm::ivec3 &key : touched)
+    {
+        for (int n = 0; n < 8; n++)
+        {
+            dirty.insert(key - glm::ivec3(n & 1, (n >> 1) & 1, n >> 2));
+        }
+    }
+
+    return (int)touched.size();
+}
+
+float TSDFVolume::distance(glm::vec3 p)
+{
+    glm::vec3 g = p / size;
+    glm::vec3 base = glm::floor(g);
+    glm::vec3 f = g - base;
+
+    float values[8];
+    for (int n = 0; n < 8; n++)
+    {
+        const Voxel* v = voxel(glm::ivec3(base)
+                + glm::ivec3(n & 1, (n >> 1) & 1, n >> 2));
+        if (v == nullptr || v->weight <= 0.0f)
+        {
+            return trunc;
+        }
+        values[n] = v->distance;
+    }
+
+    return glm::mix(
+            glm::mix(glm::mix(values[0], values[1], f.x),
+                glm::mix(values[2], values[3], f.x), f.y),
+            glm::mix(glm::mix(values[4], values[5], f.x),
+                glm::mix(values[6], values[7], f.x), f.y),
+            f.z);
+}
+
+int TSDFVolume::updateMeshes()
+{
+    // Create or drop the map entries on this thread, then mesh each dirty
+    // brick into its own entry in parallel.
+    std::vector<std::vector<glm::vec3>*> targets;
+    std::vector<glm::ivec3> keys;
+    for (const glm::ivec3 &key : dirty)
+    {
+        if (bricks.count(key) == 0)
+        {
+            meshes.erase(key);
+            continue;
+        }
+        keys.push_back(key);
+        targets.push_back(&meshes[key]);
+    }
+    dirty.clear();
+
+    parallelFor(0, (int)keys.size(), [&](int i)
+    {
+        targets[i]->clear();
+        meshBrick(keys[i], *targets[i]);
+    });
+
+    for (const glm::ivec3 &key : keys)
+    {
+        auto mesh = meshes.find(key);
+        if (mesh->second.empty())
+        {
+            meshes.erase(mesh);
+        }
+    }
+
+    return (int)keys.size();
+}
+
+void TSDFVolume::mesh(std::vector<glm::vec3> &vertexBufferData) const
+{
+    for (const auto &mesh : meshes)
+    {
+        vertexBufferData.insert(vertexBufferData.end(), mesh.second.begin(),
+                mesh.second.end());
+    }
+}
+
+const std::unordered_map<glm::ivec3, std::vector<glm::vec3>, IVec3Hash>
+    &TSDFVolume::brickMeshes() const
+{
+    return meshes;
+}
+
+size_t TSDFVolume::brickCount() const
+{
+    return bricks.size();
+}
+
+const TSDFVolume::Voxel* TSDFVolume::voxel(glm::ivec3 v) const
+{
+    glm::ivec3 key(floorDiv(v.x, BRICK_SIZE), floorDiv(v.y, BRICK_SIZE),
+            floorDiv(v.z, BRICK_SIZE));
+    auto brick = bricks.find(key);
+    if (brick == bricks.end())
+    {
+        return nullptr;
+    }
+
+    glm::ivec3 local = v - key * BRICK_SIZE;
+    return &brick->second[(local.z * BRICK_SIZE + local.y) * BRICK_SIZE
+        + local.x];
+}
+
+void TSDFVolume::meshBrick(glm::ivec3 key,
+        std::vector<glm::vec3> &vertexBufferData)
+{
+    glm::ivec3 origin = key * BRICK_SIZE;
+    std::array<glm::vec4, 8> corners;
+    for (int z = 0; z < BRICK_SIZE; z++)
+    {
+        for (int y = 0; y < BRICK_SIZE; y++)
+        {
+            for (int x = 0; x < BRICK_SIZE; x++)
+            {
+                // Cubes with an unobserved corner are skipped, otherwise the
+                // edge of the observed region would be meshed as a surface.
+                bool observed = true;
+                for (int n = 0; n < 8 && observed; n++)
+                {
+                    glm::ivec3 v = origin + glm::ivec3(x, y, z)
+                        + cornerOffsets[n];
+                    const Voxel* corner = voxel(v);
+                    observed = corner != nullptr && corner->weight > 0.0f;
+                    if (observed)
+                    {
+                        corners[n] = glm::vec4(glm::vec3(v) * size,
+                                corner->distance);
+                    }
+                }
+
+                if (observed)
+                {
+                    polygonize(this, corners, 0.0f, vertexBufferData);
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,148 @@
+#include "marching_cubes/vertex_format.h"
+#include "marching_cubes/marching_cubes.h"
+#include "marching_cubes/parallel.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+static float signNotZero(float v)
+{
+    return v >= 0.0f ? 1.0f : -1.0f;
+}
+
+size_t vertexSize(VertexFormat format)
+{
+    switch (format)
+    {
+        case VERTEX_PACKED:
+            return sizeof(PackedVertex);
+        case VERTEX_POSITION:
+            return sizeof(glm::vec3);
+        default:
+            return 2 * sizeof(glm::vec3);
+    }
+}
+
+glm::vec2 octahedralEncode(glm::vec3 normal)
+{
+    glm::vec3 n = normal / (std::fabs(normal.x) + std::fabs(normal.y)
+            + std::fabs(normal.z));
+    glm::vec2 e(n.x, n.y);
+    if (n.z < 0.0f)
+    {
+        e = glm::vec2((1.0f - std::fabs(n.y)) * signNotZero(n.x),
+                (1.0f - std::fabs(n.x)) * signNotZero(n.y));
+    }
+    return e;
+}
+
+glm::vec3 octahedralDecode(glm::vec2 encoded)
+{
+    glm::vec3 n(encoded.x, encoded.y,
+            1.0f - std::fabs(encoded.x) - std::fabs(encoded.y));
+    if (n.z < 0.0f)
+    {
+        n.x = (1.0f - std::fabs(encoded.y)) * signNotZero(encoded.x);
+        n.y = (1.0f - std::fabs(encoded.x)) * signNotZero(encoded.y);
+    }
+    return glm::normalize(n);
+}
+
+PackedVertex packVertex(glm::vec3 position, glm::vec3 normal, glm::vec3 min,
+        glm::vec3 max)
+{
+    PackedVertex vertex;
+    glm::vec3 extent = glm::max(max - min, glm::vec3(1e-30f));
+    glm::vec3 q = glm::clamp((position - min) / extent, 0.0f, 1.0f);
+    for (int i = 0; i < 3; i++)
+    {
+        vertex.position[i] = (uint16_t)std::lround(q[i] * 65535.0f);
+    }
+    vertex.position[3] = 0;
+
+    // A zero normal, which vertexNormal() can return at a saddle of the
+    // SDF, encodes as +z rather than NaN.
+    glm::vec2 e = glm::dot(normal, normal) > 0.0f
+        ? octahedralEncode(normal) : glm::vec2(0.0f);
+    for (int i = 0; i < 2; i++)
+    {
+        vertex.normal[i] = (int16_t)std::lround(
+                glm::clamp(e[i], -1.0f, 1.0f) * 32767.0f);
+    }
+    return vertex;
+}
+
+glm::vec3 unpackPosition(const PackedVertex &vertex, glm::vec3 min,
+        glm::vec3 max)
+{
+    glm::vec3 q(vertex.position[0], vertex.position[1], vertex.position[2]);
+    return min + (max - min) * (q / 65535.0f);
+}
+
+glm::vec3 unpackNormal(const PackedVertex &vertex)
+{
+    // The same mapping as OpenGL's for normalized signed integers.
+    glm::vec2 e(std::max(vertex.normal[0] / 32767.0f, -1.0f),
+            std::max(vertex.normal[1] / 32767.0f, -1.0f));
+    return octahedralDecode(e);
+}
+
+void packVertices(const std::vector<glm::vec3> &vertexBufferData,
+        glm::vec3 min, glm::vec3 max, std::vector<PackedVertex> &vertices)
+{
+    vertices.reserve(vertices.size() + vertexBufferData.size() / 2);
+    for (size_t i = 0; i + 1 < vertexBufferData.size(); i += 2)
+    {
+        vertices.push_back(packVertex(vertexBufferData[i],
+                    vertexBufferData[i + 1], min, max));
+    }
+}
+
+void marchingCubesPacked(SignedDistanceFunction* sdf, glm::vec3 min,
+        glm::vec3 max, int resolution, PackedMesh &mesh)
+{
+    SampleLattice lattice = marchingCubesLattice(min, max, resolution);
+    sampleLattice(sdf, lattice);
+
+    mesh.min = lattice.position(0, 0, 0);
+    mesh.max = lattice.position(lattice.size.x - 1, lattice.size.y - 1,
+            lattice.size.z - 1);
+    mesh.vertices.clear();
+
+    // The cube loop of polygonizeLattice(), with each slice packed into its
+    // own buffer as soon as it is done.
+    glm::ivec3 cells = lattice.size - 1;
+    std::vector<std::vector<PackedVertex>> slices(cells.z);
+    parallelFor(0, cells.z, [&](int z)
+    {
+        std::vector<glm::vec3> vertexBufferData;
+        std::array<glm::vec4, 8> corners;
+        for (int y = 0; y < cells.y; y++)
+        {
+            for (int x = 0; x < cells.x; x++)
+            {
+                for (int n = 0; n < 8; n++)
+                {
+                    glm::ivec3 c = glm::ivec3(x, y, z) + cornerOffsets[n];
+                    corners[n] = glm::vec4(lattice.position(c.x, c.y, c.z),
+                            lattice.value(c.x, c.y, c.z));
+                }
+                polygonize(sdf, corners, 0.0f, vertexBufferData);
+            }
+        }
+        packVertices(vertexBufferData, mesh.min, mesh.max, slices[z]);
+    });
+
+    size_t total = 0;
+    for (const std::vector<PackedVertex> &slice : slices)
+    {
+        total += slice.size();
+    }
+    mesh.vertices.reserve(total);
+    for (const std::vector<PackedVertex> &slice : slices)
+    {
+        mesh.vertices.insert(mesh.vertices.end(), slice.begin(),
+                slice.end());
+    }
+}